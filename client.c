@@ -217,6 +217,33 @@ client_exit_message(void)
 	return ("unknown reason");
 }
 
+/* Print the control mode exit line, framed if the client asked for frames. */
+static void
+client_control_exit(void)
+{
+	char	*line;
+	size_t	 size;
+	u_char	 length[4];
+
+	if (client_exitreason != CLIENT_EXIT_NONE)
+		xasprintf(&line, "%%exit %s", client_exit_message());
+	else
+		line = xstrdup("%exit");
+	size = strlen(line);
+
+	if (client_flags & CLIENT_CONTROL_FRAMES) {
+		length[0] = (size >> 24) & 0xff;
+		length[1] = (size >> 16) & 0xff;
+		length[2] = (size >> 8) & 0xff;
+		length[3] = size & 0xff;
+		fwrite(length, sizeof length, 1, stdout);
+		fwrite(line, size, 1, stdout);
+	} else
+		printf("%s\n", line);
+	fflush(stdout);
+	free(line);
+}
+
 /* Exit if all streams flushed. */
 static void
 client_exit(void)
@@ -410,11 +437,7 @@ client_main(struct event_base *base, int argc, char **argv, uint64_t flags,
 		if (client_exittype == MSG_DETACHKILL && ppid > 1)
 			kill(ppid, SIGHUP);
 	} else if (client_flags & CLIENT_CONTROL) {
-		if (client_exitreason != CLIENT_EXIT_NONE)
-			printf("%%exit %s\n", client_exit_message());
-		else
-			printf("%%exit\n");
-		fflush(stdout);
+		client_control_exit();
 		if (client_flags & CLIENT_CONTROL_WAITEXIT) {
 			setvbuf(stdin, NULL, _IOLBF, 0);
 			for (;;) {
@@ -31,7 +31,9 @@
 #define LIST_CLIENTS_TEMPLATE						\
 	"#{client_name}: #{session_name} "				\
 	"[#{client_width}x#{client_height} #{client_termname}] "	\
-	"#{?client_flags,(,}#{client_flags}#{?client_flags,),}"
+	"#{?client_flags,(,}#{client_flags}#{?client_flags,),}"		\
+	"#{?client_blocks, (blocked #{client_blocks} times "		\
+	"for #{client_blocked_time} ms),}"
 
 static enum cmd_retval	cmd_list_clients_exec(struct cmd *, struct cmdq_item *);
 
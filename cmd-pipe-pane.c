@@ -36,7 +36,6 @@
 static enum cmd_retval	cmd_pipe_pane_exec(struct cmd *, struct cmdq_item *);
 
 static void cmd_pipe_pane_read_callback(struct bufferevent *, void *);
-static void cmd_pipe_pane_write_callback(struct bufferevent *, void *);
 static void cmd_pipe_pane_error_callback(struct bufferevent *, short, void *);
 
 const struct cmd_entry cmd_pipe_pane_entry = {
@@ -70,9 +69,7 @@ cmd_pipe_pane_exec(struct cmd *self, struct cmdq_item *item)
 	/* Destroy the old pipe. */
 	old_fd = wp->pipe_fd;
 	if (wp->pipe_fd != -1) {
-		bufferevent_free(wp->pipe_event);
-		close(wp->pipe_fd);
-		wp->pipe_fd = -1;
+		window_pane_close_pipe(wp);
 
 		if (window_pane_destroy_ready(wp)) {
 			server_destroy_pane(wp, 1);
@@ -164,13 +161,15 @@ cmd_pipe_pane_exec(struct cmd *self, struct cmdq_item *item)
 		setblocking(wp->pipe_fd, 0);
 		wp->pipe_event = bufferevent_new(wp->pipe_fd,
 		    cmd_pipe_pane_read_callback,
-		    cmd_pipe_pane_write_callback,
+		    NULL,
 		    cmd_pipe_pane_error_callback,
 		    wp);
 		if (wp->pipe_event == NULL)
 			fatalx("out of memory");
 		if (out)
-			bufferevent_enable(wp->pipe_event, EV_WRITE);
+			wp->flags |= PANE_PIPEOUT;
+		else
+			wp->flags &= ~PANE_PIPEOUT;
 		if (in)
 			bufferevent_enable(wp->pipe_event, EV_READ);
 
@@ -196,17 +195,6 @@ cmd_pipe_pane_read_callback(__unused struct bufferevent *bufev, void *data)
 		server_destroy_pane(wp, 1);
 }
 
-static void
-cmd_pipe_pane_write_callback(__unused struct bufferevent *bufev, void *data)
-{
-	struct window_pane	*wp = data;
-
-	log_debug("%%%u pipe empty", wp->id);
-
-	if (window_pane_destroy_ready(wp))
-		server_destroy_pane(wp, 1);
-}
-
 static void
 cmd_pipe_pane_error_callback(__unused struct bufferevent *bufev,
     __unused short what, void *data)
@@ -215,9 +203,7 @@ cmd_pipe_pane_error_callback(__unused struct bufferevent *bufev,
 
 	log_debug("%%%u pipe error", wp->id);
 
-	bufferevent_free(wp->pipe_event);
-	close(wp->pipe_fd);
-	wp->pipe_fd = -1;
+	window_pane_close_pipe(wp);
 
 	if (window_pane_destroy_ready(wp))
 		server_destroy_pane(wp, 1);
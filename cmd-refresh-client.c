@@ -226,6 +226,7 @@ cmd_refresh_client_exec(struct cmd *self, struct cmdq_item *item)
 		server_status_client(tc);
 	} else {
 		tc->flags |= CLIENT_STATUSFORCE;
+		tty_shadow_reset(&tc->tty);
 		server_redraw_client(tc);
 	}
 	return (CMD_RETURN_NORMAL);
@@ -106,6 +106,8 @@ cmd_rotate_window_exec(struct cmd *self, struct cmdq_item *item)
 			wp = TAILQ_FIRST(&w->panes);
 	}
 
+	w->flags |= WINDOW_BORDERSCHANGED;
+
 	window_set_active_pane(w, wp, 1);
 	cmd_find_from_winlink_pane(current, wl, wp, 0);
 	window_pop_zoom(w);
@@ -112,6 +112,8 @@ cmd_swap_pane_exec(struct cmd *self, struct cmdq_item *item)
 	window_pane_resize(src_wp, dst_wp->sx, dst_wp->sy);
 	dst_wp->xoff = xoff; dst_wp->yoff = yoff;
 	window_pane_resize(dst_wp, sx, sy);
+	src_w->flags |= WINDOW_BORDERSCHANGED;
+	dst_w->flags |= WINDOW_BORDERSCHANGED;
 
 	if (!args_has(args, 'd')) {
 		if (src_w != dst_w) {
@@ -51,6 +51,25 @@ struct control_block {
 	TAILQ_ENTRY(control_block)	 all_entry;
 };
 
+/*
+ * Escaped pane output shared between clients. Control clients which are keeping
+ * up usually write the same piece of a pane's data, from the same offset and
+ * with the same limit, so it is escaped once and copied to each client. The
+ * pieces are discarded each time round the server loop.
+ */
+struct control_output {
+	u_int				 pane;
+	size_t				 offset;
+	size_t				 size;
+
+	struct evbuffer			*data;
+
+	RB_ENTRY(control_output)	 entry;
+};
+RB_HEAD(control_outputs, control_output);
+static struct control_outputs control_outputs =
+    RB_INITIALIZER(&control_outputs);
+
 /* Control client pane. */
 struct control_pane {
 	u_int				 pane;
@@ -123,6 +142,7 @@ struct control_state {
 
 	struct bufferevent		*read_event;
 	struct bufferevent		*write_event;
+	struct event			 coalesce_timer;
 
 	struct control_subs		 subs;
 	struct event			 subs_timer;
@@ -132,6 +152,9 @@ struct control_state {
 #define CONTROL_BUFFER_LOW 512
 #define CONTROL_BUFFER_HIGH 8192
 
+/* Default size at which coalesced output is written. */
+#define CONTROL_COALESCE_SIZE CONTROL_BUFFER_HIGH
+
 /* Minimum to write to each client. */
 #define CONTROL_WRITE_MINIMUM 32
 
@@ -155,6 +178,26 @@ control_pane_cmp(struct control_pane *cp1, struct control_pane *cp2)
 }
 RB_GENERATE_STATIC(control_panes, control_pane, entry, control_pane_cmp);
 
+/* Compare shared output. */
+static int
+control_output_cmp(struct control_output *co1, struct control_output *co2)
+{
+	if (co1->pane < co2->pane)
+		return (-1);
+	if (co1->pane > co2->pane)
+		return (1);
+	if (co1->offset < co2->offset)
+		return (-1);
+	if (co1->offset > co2->offset)
+		return (1);
+	if (co1->size < co2->size)
+		return (-1);
+	if (co1->size > co2->size)
+		return (1);
+	return (0);
+}
+RB_GENERATE_STATIC(control_outputs, control_output, entry, control_output_cmp);
+
 /* Compare client subs. */
 static int
 control_sub_cmp(struct control_sub *csub1, struct control_sub *csub2)
@@ -371,6 +414,31 @@ control_continue_pane(struct client *c, struct window_pane *wp)
 	}
 }
 
+/*
+ * Client is too far behind with a pane: pause it if the client has asked for
+ * that, otherwise discard the output and tell the client.
+ */
+void
+control_overflow_pane(struct client *c, struct window_pane *wp, size_t size)
+{
+	struct control_pane	*cp;
+
+	cp = control_get_pane(c, wp);
+	if (cp == NULL || (cp->flags & (CONTROL_PANE_OFF|CONTROL_PANE_PAUSED)))
+		return;
+	log_debug("%s: %s: %zu behind for %%%u", __func__, c->name, size,
+	    wp->id);
+
+	if (c->flags & CLIENT_CONTROL_PAUSEAFTER) {
+		control_pause_pane(c, wp);
+		return;
+	}
+	control_discard_pane(c, cp);
+	window_pane_update_used_data(wp, &cp->offset, SIZE_MAX);
+	window_pane_update_used_data(wp, &cp->queued, SIZE_MAX);
+	control_write(c, "%%output-dropped %%%u %zu", wp->id, size);
+}
+
 /* Pause a pane. */
 void
 control_pause_pane(struct client *c, struct window_pane *wp)
@@ -385,6 +453,38 @@ control_pause_pane(struct client *c, struct window_pane *wp)
 	}
 }
 
+/*
+ * Write the length which starts a frame, as four bytes in network byte order.
+ */
+static void
+control_write_length(struct client *c, size_t size)
+{
+	struct control_state	*cs = c->control_state;
+	u_char			 length[4];
+
+	length[0] = (size >> 24) & 0xff;
+	length[1] = (size >> 16) & 0xff;
+	length[2] = (size >> 8) & 0xff;
+	length[3] = size & 0xff;
+	bufferevent_write(cs->write_event, length, sizeof length);
+}
+
+/* Write a line, or a frame if the client has asked for them. */
+static void
+control_write_line(struct client *c, const char *line)
+{
+	struct control_state	*cs = c->control_state;
+	size_t			 size = strlen(line);
+
+	if (c->flags & CLIENT_CONTROL_FRAMES) {
+		control_write_length(c, size);
+		bufferevent_write(cs->write_event, line, size);
+	} else {
+		bufferevent_write(cs->write_event, line, size);
+		bufferevent_write(cs->write_event, "\n", 1);
+	}
+}
+
 /* Write a line. */
 static void
 control_vwrite(struct client *c, const char *fmt, va_list ap)
@@ -395,8 +495,7 @@ control_vwrite(struct client *c, const char *fmt, va_list ap)
 	xvasprintf(&s, fmt, ap);
 	log_debug("%s: %s: writing line: %s", __func__, c->name, s);
 
-	bufferevent_write(cs->write_event, s, strlen(s));
-	bufferevent_write(cs->write_event, "\n", 1);
+	control_write_line(c, s);
 
 	bufferevent_enable(cs->write_event, EV_WRITE);
 	free(s);
@@ -599,20 +698,106 @@ control_flush_all_blocks(struct client *c)
 		log_debug("%s: %s: flushing line: %s", __func__, c->name,
 		    cb->line);
 
-		bufferevent_write(cs->write_event, cb->line, strlen(cb->line));
-		bufferevent_write(cs->write_event, "\n", 1);
+		control_write_line(c, cb->line);
 		control_free_block(cs, cb);
 	}
 }
 
+/*
+ * Append pane output to a buffer for a control client. Bytes below space and
+ * backslash are replaced by an octal escape; everything else is copied in
+ * runs, through a local buffer so output with many escapes is still added to
+ * the evbuffer in large pieces.
+ */
+void
+control_escape(struct evbuffer *evb, const u_char *data, size_t size)
+{
+	char	 buf[4096];
+	size_t	 used = 0, i, start, n;
+	u_char	 ch;
+
+	for (i = 0; i < size; /* nothing */) {
+		start = i;
+		while (i < size && data[i] >= ' ' && data[i] != '\\')
+			i++;
+		while (start != i) {
+			if (used == sizeof buf) {
+				evbuffer_add(evb, buf, used);
+				used = 0;
+			}
+			n = i - start;
+			if (n > (sizeof buf) - used)
+				n = (sizeof buf) - used;
+			memcpy(buf + used, data + start, n);
+			used += n;
+			start += n;
+		}
+		if (i == size)
+			break;
+
+		if (used > (sizeof buf) - 4) {
+			evbuffer_add(evb, buf, used);
+			used = 0;
+		}
+		ch = data[i++];
+		buf[used++] = '\\';
+		buf[used++] = '0' + (ch >> 6);
+		buf[used++] = '0' + ((ch >> 3) & 7);
+		buf[used++] = '0' + (ch & 7);
+	}
+	if (used != 0)
+		evbuffer_add(evb, buf, used);
+}
+
+/* Discard shared output, called once each time round the server loop. */
+void
+control_free_output(void)
+{
+	struct control_output	*co, *co1;
+
+	RB_FOREACH_SAFE(co, control_outputs, &control_outputs, co1) {
+		RB_REMOVE(control_outputs, &control_outputs, co);
+		evbuffer_free(co->data);
+		free(co);
+	}
+}
+
+/* Get escaped pane data, from shared output if another client has used it. */
+static struct evbuffer *
+control_get_output(struct window_pane *wp, struct window_pane_offset *wpo,
+    const u_char *data, size_t size)
+{
+	struct control_output	 find, *co;
+
+	find.pane = wp->id;
+	find.offset = wpo->used;
+	find.size = size;
+	if ((co = RB_FIND(control_outputs, &control_outputs, &find)) != NULL) {
+		log_debug("%s: %%%u: shared %zu at %zu", __func__, wp->id, size,
+		    wpo->used);
+		return (co->data);
+	}
+
+	co = xcalloc(1, sizeof *co);
+	co->pane = wp->id;
+	co->offset = wpo->used;
+	co->size = size;
+	co->data = evbuffer_new();
+	if (co->data == NULL)
+		fatalx("out of memory");
+	control_escape(co->data, data, size);
+	RB_INSERT(control_outputs, &control_outputs, co);
+	return (co->data);
+}
+
 /* Append data to buffer. */
 static struct evbuffer *
 control_append_data(struct client *c, struct control_pane *cp, uint64_t age,
     struct evbuffer *message, struct window_pane *wp, size_t size)
 {
-	u_char	*new_data;
-	size_t	 new_size;
-	u_int	 i;
+	struct evbuffer	*escaped;
+	u_char		*new_data;
+	size_t		 new_size;
 
 	if (message == NULL) {
 		message = evbuffer_new();
@@ -629,11 +814,12 @@ control_append_data(struct client *c, struct control_pane *cp, uint64_t age,
 	new_data = window_pane_get_new_data(wp, &cp->offset, &new_size);
 	if (new_size < size)
 		fatalx("not enough data: %zu < %zu", new_size, size);
-	for (i = 0; i < size; i++) {
-		if (new_data[i] < ' ' || new_data[i] == '\\')
-			evbuffer_add_printf(message, "\\%03o", new_data[i]);
-		else
-			evbuffer_add_printf(message, "%c", new_data[i]);
+	if (c->flags & CLIENT_CONTROL_FRAMES)
+		evbuffer_add(message, new_data, size);
+	else {
+		escaped = control_get_output(wp, &cp->offset, new_data, size);
+		evbuffer_add(message, EVBUFFER_DATA(escaped),
+		    EVBUFFER_LENGTH(escaped));
 	}
 	window_pane_update_used_data(wp, &cp->offset, size);
 	return (message);
@@ -648,7 +834,10 @@ control_write_data(struct client *c, struct evbuffer *message)
 	log_debug("%s: %s: %.*s", __func__, c->name,
 	    (int)EVBUFFER_LENGTH(message), EVBUFFER_DATA(message));
 
-	evbuffer_add(message, "\n", 1);
+	if (c->flags & CLIENT_CONTROL_FRAMES)
+		control_write_length(c, EVBUFFER_LENGTH(message));
+	else
+		evbuffer_add(message, "\n", 1);
 	bufferevent_write_buffer(cs->write_event, message);
 	evbuffer_free(message);
 }
@@ -718,6 +907,50 @@ control_write_pending(struct client *c, struct control_pane *cp, size_t limit)
 	return (!TAILQ_EMPTY(&cp->blocks));
 }
 
+/*
+ * Check if output for a pane should be held back to be coalesced with any that
+ * follows it. If it should, return the time in milliseconds until it must be
+ * written.
+ */
+static int
+control_coalesce_pane(struct client *c, struct control_pane *cp,
+    uint64_t *wait)
+{
+	struct control_block	*cb;
+	size_t			 size, limit = c->coalesce_size;
+	uint64_t		 t;
+
+	if (~c->flags & CLIENT_CONTROL_COALESCE)
+		return (0);
+	if ((cb = TAILQ_FIRST(&cp->blocks)) == NULL)
+		return (0);
+
+	if (limit == 0)
+		limit = CONTROL_COALESCE_SIZE;
+	size = cp->queued.used - cp->offset.used;
+	if (size >= limit)
+		return (0);
+
+	t = get_timer();
+	if (cb->t + c->coalesce_age <= t)
+		return (0);
+	*wait = cb->t + c->coalesce_age - t;
+	log_debug("%s: %s: holding %zu for %%%u (%llu ms)", __func__, c->name,
+	    size, cp->pane, (unsigned long long)*wait);
+	return (1);
+}
+
+/* Coalesce timer has fired, write any output that was held back. */
+static void
+control_coalesce_timer(__unused int fd, __unused short events, void *data)
+{
+	struct client		*c = data;
+	struct control_state	*cs = c->control_state;
+
+	log_debug("%s: %s: timer fired", __func__, c->name);
+	bufferevent_enable(cs->write_event, EV_WRITE);
+}
+
 /* Control client write callback. */
 static void
 control_write_callback(__unused struct bufferevent *bufev, void *data)
@@ -727,6 +960,9 @@ control_write_callback(__unused struct bufferevent *bufev, void *data)
 	struct control_pane	*cp, *cp1;
 	struct evbuffer		*evb = cs->write_event->output;
 	size_t			 space, limit;
+	u_int			 held = 0;
+	uint64_t		 wait, next = 0;
+	struct timeval		 tv;
 
 	control_flush_all_blocks(c);
 
@@ -741,15 +977,28 @@ control_write_callback(__unused struct bufferevent *bufev, void *data)
 		if (limit < CONTROL_WRITE_MINIMUM)
 			limit = CONTROL_WRITE_MINIMUM;
 
+		held = 0;
 		TAILQ_FOREACH_SAFE(cp, &cs->pending_list, pending_entry, cp1) {
 			if (EVBUFFER_LENGTH(evb) >= CONTROL_BUFFER_HIGH)
 				break;
+			if (control_coalesce_pane(c, cp, &wait)) {
+				if (held++ == 0 || wait < next)
+					next = wait;
+				continue;
+			}
 			if (control_write_pending(c, cp, limit))
 				continue;
 			TAILQ_REMOVE(&cs->pending_list, cp, pending_entry);
 			cp->pending_flag = 0;
 			cs->pending_count--;
 		}
+		if (held == cs->pending_count)
+			break;
+	}
+	if (held != 0) {
+		tv.tv_sec = next / 1000;
+		tv.tv_usec = (next % 1000) * 1000;
+		evtimer_add(&cs->coalesce_timer, &tv);
 	}
 	if (EVBUFFER_LENGTH(evb) == 0)
 		bufferevent_disable(cs->write_event, EV_WRITE);
@@ -773,6 +1022,7 @@ control_start(struct client *c)
 	TAILQ_INIT(&cs->pending_list);
 	TAILQ_INIT(&cs->all_blocks);
 	RB_INIT(&cs->subs);
+	evtimer_set(&cs->coalesce_timer, control_coalesce_timer, c);
 
 	cs->read_event = bufferevent_new(c->fd, control_read_callback,
 	    control_write_callback, control_error_callback, c);
@@ -821,6 +1071,7 @@ control_stop(struct client *c)
 		control_free_sub(cs, csub);
 	if (evtimer_initialized(&cs->subs_timer))
 		evtimer_del(&cs->subs_timer);
+	evtimer_del(&cs->coalesce_timer);
 
 	TAILQ_FOREACH_SAFE(cb, &cs->all_blocks, all_entry, cb1)
 		control_free_block(cs, cb);
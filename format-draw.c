@@ -544,12 +544,12 @@ format_draw(struct screen_write_ctx *octx, const struct grid_cell *base,
 	/*
 	 * We build three screens for left, right, centre alignment, one for
 	 * the list, one for anything after the list and two for the list left
-	 * and right markers.
+	 * and right markers. Only the cells written are copied out of these
+	 * screens, so they do not need to be cleared first.
 	 */
 	for (i = 0; i < TOTAL; i++) {
 		screen_init(&s[i], size, 1, 0);
 		screen_write_start(&ctx[i], &s[i]);
-		screen_write_clearendofline(&ctx[i], current_default.bg);
 		width[i] = 0;
 	}
 
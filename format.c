@@ -39,12 +39,17 @@
  */
 
 struct format_expand_state;
+struct format_op;
+struct format_compiled;
 
 static char	*format_job_get(struct format_expand_state *, const char *);
 static void	 format_job_timer(int, short, void *);
 static char	*format_expand1(struct format_expand_state *, const char *);
-static int	 format_replace(struct format_expand_state *, const char *,
-		     size_t, char **, size_t *, size_t *);
+static int	 format_expand_op(struct format_expand_state *,
+		     struct format_compiled *, struct format_op *, char **,
+		     size_t *, size_t *);
+static int	 format_replace(struct format_expand_state *,
+		     const struct format_op *, char **, size_t *, size_t *);
 static void	 format_defaults_session(struct format_tree *,
 		     struct session *);
 static void	 format_defaults_client(struct format_tree *, struct client *);
@@ -124,11 +129,13 @@ struct format_tree {
 	struct winlink		*wl;
 	struct window		*w;
 	struct window_pane	*wp;
+	struct paste_buffer	*pb;
 
 	struct cmdq_item	*item;
 	struct client		*client;
 	int			 flags;
 	u_int			 tag;
+	int			 defaults;
 
 	struct mouse_event	 m;
 
@@ -137,6 +144,18 @@ struct format_tree {
 static int format_entry_cmp(struct format_entry *, struct format_entry *);
 RB_GENERATE_STATIC(format_entry_tree, format_entry, entry, format_entry_cmp);
 
+/* What was given to format_defaults. */
+#define FORMAT_DEFAULTS_DONE 0x1
+#define FORMAT_DEFAULTS_SESSION 0x2
+#define FORMAT_DEFAULTS_WINLINK 0x4
+#define FORMAT_DEFAULTS_PANE 0x8
+
+/* Entry in format table. */
+struct format_table_entry {
+	const char	*key;
+	format_cb	 cb;
+};
+
 /* Format expand state. */
 struct format_expand_state {
 	struct format_tree	*ft;
@@ -154,6 +173,166 @@ struct format_modifier {
 	int	  argc;
 };
 
+/* Compiled format operation. */
+enum format_op_type {
+	FORMAT_OP_TEXT,
+	FORMAT_OP_JOB,
+	FORMAT_OP_REPLACE
+};
+struct format_op {
+	enum format_op_type	 type;
+
+	size_t			 offset;
+	size_t			 size;
+
+	char			*key;
+	const char		*copy;
+	struct format_modifier	*list;
+	u_int			 count;
+};
+
+/* Compiled format. */
+struct format_compiled {
+	char			*fmt;
+
+	struct format_op	*ops;
+	u_int			 nops;
+
+	char			*text;
+	size_t			 textlen;
+
+	RB_ENTRY(format_compiled) entry;
+};
+RB_HEAD(format_compiled_tree, format_compiled);
+static int format_compiled_cmp(struct format_compiled *,
+    struct format_compiled *);
+RB_GENERATE_STATIC(format_compiled_tree, format_compiled, entry,
+    format_compiled_cmp);
+
+/* Compiled formats. */
+#define FORMAT_COMPILED_LIMIT 1000
+static struct format_compiled_tree format_compiled =
+    RB_INITIALIZER(&format_compiled);
+static u_int format_compiled_count;
+static u_int format_compiled_depth;
+
+/* Type of value a cached part of an expanded format used. */
+enum format_dep_type {
+	FORMAT_DEP_FIND,
+	FORMAT_DEP_JOB,
+	FORMAT_DEP_LOOP,
+	FORMAT_DEP_TIME,
+	FORMAT_DEP_ALWAYS
+};
+
+/* Tree a value was found in, by index and ID so it can be made again. */
+struct format_context {
+	u_int			 tag;
+	int			 flags;
+	int			 defaults;
+
+	u_int			 s;
+	int			 wl;
+	u_int			 w;
+	u_int			 wp;
+};
+
+/* Value a cached part of an expanded format used. */
+struct format_dep {
+	enum format_dep_type	 type;
+	struct format_context	 context;
+
+	char			*key;
+	int			 modifiers;
+	char			*time_format;
+	char			*value;
+};
+struct format_deps {
+	struct format_dep	*list;
+	u_int			 count;
+};
+
+/* Values being recorded while expanding, if any. */
+static struct format_deps *format_deps;
+
+/* Cached part of an expanded format: a #{}, a #() or some text. */
+struct format_cache_part {
+	enum format_op_type	 type;
+	char			*key;
+
+	char			*value;
+	int			 failed;
+	struct format_deps	 deps;
+};
+
+/* Expanded format kept between expansions. */
+struct format_cache {
+	struct format_cache_part *parts;
+	u_int			  nparts;
+};
+
+/*
+ * Expanded format shared between clients. Status line and pane border formats
+ * expanded during a redraw are kept until the redraw is finished, so when
+ * several clients are attached to the same session and window only the first
+ * has to expand them. Results which depended on the client are not kept.
+ */
+struct format_memo {
+	char			*fmt;
+	int			 flags;
+	int			 expand_flags;
+	u_int			 loop;
+
+	struct session		*s;
+	struct winlink		*wl;
+	struct window		*w;
+	struct window_pane	*wp;
+	int			 recorded;
+
+	char			*value;
+	struct format_deps	 deps;
+
+	RB_ENTRY(format_memo)	 entry;
+};
+RB_HEAD(format_memo_tree, format_memo);
+static int format_memo_cmp(struct format_memo *, struct format_memo *);
+RB_GENERATE_STATIC(format_memo_tree, format_memo, entry, format_memo_cmp);
+
+/* Format memo tree. */
+static struct format_memo_tree format_memos = RB_INITIALIZER(&format_memos);
+static int format_memo_active;
+static int format_memo_client;
+
+/* Compiled format tree comparison function. */
+static int
+format_compiled_cmp(struct format_compiled *fc1, struct format_compiled *fc2)
+{
+	return (strcmp(fc1->fmt, fc2->fmt));
+}
+
+/* Format memo tree comparison function. */
+static int
+format_memo_cmp(struct format_memo *fm1, struct format_memo *fm2)
+{
+	if (fm1->s != fm2->s)
+		return (fm1->s < fm2->s ? -1 : 1);
+	if (fm1->wl != fm2->wl)
+		return (fm1->wl < fm2->wl ? -1 : 1);
+	if (fm1->w != fm2->w)
+		return (fm1->w < fm2->w ? -1 : 1);
+	if (fm1->wp != fm2->wp)
+		return (fm1->wp < fm2->wp ? -1 : 1);
+	if (fm1->flags != fm2->flags)
+		return (fm1->flags < fm2->flags ? -1 : 1);
+	if (fm1->expand_flags != fm2->expand_flags)
+		return (fm1->expand_flags < fm2->expand_flags ? -1 : 1);
+	if (fm1->loop != fm2->loop)
+		return (fm1->loop < fm2->loop ? -1 : 1);
+	if (fm1->recorded != fm2->recorded)
+		return (fm1->recorded < fm2->recorded ? -1 : 1);
+	return (strcmp(fm1->fmt, fm2->fmt));
+}
+
 /* Format entry tree comparison function. */
 static int
 format_entry_cmp(struct format_entry *fe1, struct format_entry *fe2)
@@ -264,6 +443,171 @@ format_copy_state(struct format_expand_state *to,
 	to->flags = from->flags|flags;
 }
 
+/* Get the context of a tree for a recorded value. */
+static void
+format_get_context(struct format_tree *ft, struct format_context *fx)
+{
+	memset(fx, 0, sizeof *fx);
+	fx->tag = ft->tag;
+	fx->flags = ft->flags & ~FORMAT_FORCE;
+	fx->defaults = ft->defaults;
+
+	if (ft->defaults & FORMAT_DEFAULTS_SESSION)
+		fx->s = ft->s->id;
+	if (ft->defaults & FORMAT_DEFAULTS_WINLINK) {
+		fx->wl = ft->wl->idx;
+		fx->w = ft->wl->window->id;
+	}
+	if (ft->defaults & FORMAT_DEFAULTS_PANE)
+		fx->wp = ft->wp->id;
+}
+
+/* Compare two strings either of which may be NULL. */
+static int
+format_dep_strcmp(const char *s1, const char *s2)
+{
+	if (s1 == NULL || s2 == NULL)
+		return (s1 != s2);
+	return (strcmp(s1, s2));
+}
+
+/* Record a value used while expanding. */
+static void
+format_add_dep(struct format_tree *ft, enum format_dep_type type,
+    const char *key, int modifiers, const char *time_format,
+    const char *value)
+{
+	struct format_deps	*deps = format_deps;
+	struct format_dep	*fd;
+	struct format_context	 fx;
+
+	if (deps == NULL)
+		return;
+
+	/* A tree which cannot be made again is never the same. */
+	if (ft->item != NULL || (~ft->defaults & FORMAT_DEFAULTS_DONE))
+		type = FORMAT_DEP_ALWAYS;
+	format_get_context(ft, &fx);
+
+	if (deps->count != 0) {
+		fd = &deps->list[deps->count - 1];
+		if (fd->type == type &&
+		    memcmp(&fd->context, &fx, sizeof fx) == 0 &&
+		    fd->modifiers == modifiers &&
+		    strcmp(fd->key, key) == 0 &&
+		    format_dep_strcmp(fd->time_format, time_format) == 0 &&
+		    format_dep_strcmp(fd->value, value) == 0)
+			return;
+	}
+
+	deps->list = xreallocarray(deps->list, deps->count + 1,
+	    sizeof *deps->list);
+	fd = &deps->list[deps->count++];
+	fd->type = type;
+	memcpy(&fd->context, &fx, sizeof fd->context);
+	fd->key = xstrdup(key);
+	fd->modifiers = modifiers;
+	fd->time_format = (time_format == NULL ? NULL : xstrdup(time_format));
+	fd->value = (value == NULL ? NULL : xstrdup(value));
+}
+
+/* Copy recorded values, from the given one onwards. */
+static void
+format_copy_deps(struct format_deps *to, struct format_deps *from, u_int start)
+{
+	struct format_dep	*fd;
+	u_int			 i;
+
+	if (start >= from->count)
+		return;
+	to->list = xreallocarray(to->list, to->count + from->count - start,
+	    sizeof *to->list);
+	for (i = start; i < from->count; i++) {
+		fd = &to->list[to->count++];
+		memcpy(fd, &from->list[i], sizeof *fd);
+		fd->key = xstrdup(fd->key);
+		if (fd->time_format != NULL)
+			fd->time_format = xstrdup(fd->time_format);
+		if (fd->value != NULL)
+			fd->value = xstrdup(fd->value);
+	}
+}
+
+/* Free recorded values. */
+static void
+format_free_deps(struct format_deps *deps)
+{
+	u_int	i;
+
+	for (i = 0; i < deps->count; i++) {
+		free(deps->list[i].key);
+		free(deps->list[i].time_format);
+		free(deps->list[i].value);
+	}
+	free(deps->list);
+	deps->list = NULL;
+	deps->count = 0;
+}
+
+/* Get the sessions, windows or panes a loop goes over. */
+static char *
+format_loop_list(struct format_tree *ft, int type)
+{
+	struct session		*s;
+	struct winlink		*wl;
+	struct window_pane	*wp;
+	char			*value, tmp[64];
+	size_t			 valuelen;
+
+	if ((type == 'W' && ft->s == NULL) || (type == 'P' && ft->w == NULL))
+		return (NULL);
+
+	value = xcalloc(1, 1);
+	valuelen = 1;
+	switch (type) {
+	case 'S':
+		RB_FOREACH(s, sessions, &sessions) {
+			xsnprintf(tmp, sizeof tmp, "$%u,", s->id);
+			valuelen += strlen(tmp);
+			value = xrealloc(value, valuelen);
+			strlcat(value, tmp, valuelen);
+		}
+		break;
+	case 'W':
+		RB_FOREACH(wl, winlinks, &ft->s->windows) {
+			xsnprintf(tmp, sizeof tmp, "%d@%u%s,", wl->idx,
+			    wl->window->id, wl == ft->s->curw ? "*" : "");
+			valuelen += strlen(tmp);
+			value = xrealloc(value, valuelen);
+			strlcat(value, tmp, valuelen);
+		}
+		break;
+	case 'P':
+		TAILQ_FOREACH(wp, &ft->w->panes, entry) {
+			xsnprintf(tmp, sizeof tmp, "%%%u%s,", wp->id,
+			    wp == ft->w->active ? "*" : "");
+			valuelen += strlen(tmp);
+			value = xrealloc(value, valuelen);
+			strlcat(value, tmp, valuelen);
+		}
+		break;
+	}
+	return (value);
+}
+
+/* Record the sessions, windows or panes used by a loop. */
+static void
+format_add_loop_dep(struct format_tree *ft, const char *type)
+{
+	char	*value;
+
+	if (format_deps == NULL)
+		return;
+	value = format_loop_list(ft, *type);
+	format_add_dep(ft, FORMAT_DEP_LOOP, type, 0, NULL, value);
+	free(value);
+}
+
 /* Format job update callback. */
 static void
 format_job_update(struct job *job)
@@ -337,11 +681,18 @@ format_job_get(struct format_expand_state *es, const char *cmd)
 	struct format_tree		*ft = es->ft;
 	struct format_job_tree		*jobs;
 	struct format_job		 fj0, *fj;
+	struct format_deps		*deps = format_deps;
 	time_t				 t;
-	char				*expanded;
+	char				*expanded, *value;
 	int				 force;
 	struct format_expand_state	 next;
 
+	/*
+	 * If recording, the job output is recorded rather than what is used
+	 * to get it, so looking it up again runs the job if needed.
+	 */
+	format_deps = NULL;
+
 	if (ft->client == NULL)
 		jobs = &format_jobs;
 	else if (ft->client->jobs != NULL)
@@ -392,7 +743,11 @@ format_job_get(struct format_expand_state *es, const char *cmd)
 	if (ft->flags & FORMAT_STATUS)
 		fj->status = 1;
 	format_copy_state(&next, es, FORMAT_EXPAND_NOJOBS);
-	return (format_expand1(&next, fj->out));
+	value = format_expand1(&next, fj->out);
+
+	format_deps = deps;
+	format_add_dep(ft, FORMAT_DEP_JOB, cmd, es->flags, NULL, value);
+	return (value);
 }
 
 /* Remove old jobs. */
@@ -447,6 +802,28 @@ format_job_timer(__unused int fd, __unused short events, __unused void *arg)
 	evtimer_add(&format_job_event, &tv);
 }
 
+/* Allocate a printf-style value. */
+static char * printflike(1, 2)
+format_printf(const char *fmt, ...)
+{
+	va_list	 ap;
+	char	*value;
+
+	va_start(ap, fmt);
+	xvasprintf(&value, fmt, ap);
+	va_end(ap);
+	return (value);
+}
+
+/* Return a time as a value, or NULL if it is not set. */
+static char *
+format_tv(struct timeval *tv)
+{
+	if (tv->tv_sec == 0)
+		return (NULL);
+	return (format_printf("%lld", (long long)tv->tv_sec));
+}
+
 /* Callback for host. */
 static char *
 format_cb_host(__unused struct format_tree *ft)
@@ -506,8 +883,8 @@ format_cb_session_attached_list(struct format_tree *ft)
 		}
 	}
 
-	if ((size = EVBUFFER_LENGTH(buffer)) != 0)
-		xasprintf(&value, "%.*s", size, EVBUFFER_DATA(buffer));
+	size = EVBUFFER_LENGTH(buffer);
+	xasprintf(&value, "%.*s", size, EVBUFFER_DATA(buffer));
 	evbuffer_free(buffer);
 	return (value);
 }
@@ -568,11 +945,15 @@ format_cb_session_stack(struct format_tree *ft)
 static char *
 format_cb_window_stack_index(struct format_tree *ft)
 {
-	struct session	*s = ft->wl->session;
+	struct session	*s;
 	struct winlink	*wl;
 	u_int		 idx;
 	char		*value = NULL;
 
+	if (ft->wl == NULL)
+		return (NULL);
+	s = ft->wl->session;
+
 	idx = 0;
 	TAILQ_FOREACH(wl, &s->lastw, sentry) {
 		idx++;
@@ -589,12 +970,16 @@ format_cb_window_stack_index(struct format_tree *ft)
 static char *
 format_cb_window_linked_sessions_list(struct format_tree *ft)
 {
-	struct window	*w = ft->wl->window;
+	struct window	*w;
 	struct winlink	*wl;
 	struct evbuffer	*buffer;
 	int		 size;
 	char		*value = NULL;
 
+	if (ft->wl == NULL)
+		return (NULL);
+	w = ft->wl->window;
+
 	buffer = evbuffer_new();
 	if (buffer == NULL)
 		fatalx("out of memory");
@@ -605,8 +990,8 @@ format_cb_window_linked_sessions_list(struct format_tree *ft)
 		evbuffer_add_printf(buffer, "%s", wl->session->name);
 	}
 
-	if ((size = EVBUFFER_LENGTH(buffer)) != 0)
-		xasprintf(&value, "%.*s", size, EVBUFFER_DATA(buffer));
+	size = EVBUFFER_LENGTH(buffer);
+	xasprintf(&value, "%.*s", size, EVBUFFER_DATA(buffer));
 	evbuffer_free(buffer);
 	return (value);
 }
@@ -615,11 +1000,15 @@ format_cb_window_linked_sessions_list(struct format_tree *ft)
 static char *
 format_cb_window_active_sessions(struct format_tree *ft)
 {
-	struct window	*w = ft->wl->window;
+	struct window	*w;
 	struct winlink	*wl;
 	u_int		 n = 0;
 	char		*value;
 
+	if (ft->wl == NULL)
+		return (NULL);
+	w = ft->wl->window;
+
 	TAILQ_FOREACH(wl, &w->winlinks, wentry) {
 		if (wl->session->curw == wl)
 			n++;
@@ -633,12 +1022,16 @@ format_cb_window_active_sessions(struct format_tree *ft)
 static char *
 format_cb_window_active_sessions_list(struct format_tree *ft)
 {
-	struct window	*w = ft->wl->window;
+	struct window	*w;
 	struct winlink	*wl;
 	struct evbuffer	*buffer;
 	int		 size;
 	char		*value = NULL;
 
+	if (ft->wl == NULL)
+		return (NULL);
+	w = ft->wl->window;
+
 	buffer = evbuffer_new();
 	if (buffer == NULL)
 		fatalx("out of memory");
@@ -651,8 +1044,8 @@ format_cb_window_active_sessions_list(struct format_tree *ft)
 		}
 	}
 
-	if ((size = EVBUFFER_LENGTH(buffer)) != 0)
-		xasprintf(&value, "%.*s", size, EVBUFFER_DATA(buffer));
+	size = EVBUFFER_LENGTH(buffer);
+	xasprintf(&value, "%.*s", size, EVBUFFER_DATA(buffer));
 	evbuffer_free(buffer);
 	return (value);
 }
@@ -661,12 +1054,16 @@ format_cb_window_active_sessions_list(struct format_tree *ft)
 static char *
 format_cb_window_active_clients(struct format_tree *ft)
 {
-	struct window	*w = ft->wl->window;
+	struct window	*w;
 	struct client	*loop;
 	struct session	*client_session;
 	u_int		 n = 0;
 	char		*value;
 
+	if (ft->wl == NULL)
+		return (NULL);
+	w = ft->wl->window;
+
 	TAILQ_FOREACH(loop, &clients, entry) {
 		client_session = loop->session;
 		if (client_session == NULL)
@@ -684,13 +1081,17 @@ format_cb_window_active_clients(struct format_tree *ft)
 static char *
 format_cb_window_active_clients_list(struct format_tree *ft)
 {
-	struct window	*w = ft->wl->window;
+	struct window	*w;
 	struct client	*loop;
 	struct session	*client_session;
 	struct evbuffer	*buffer;
 	int		 size;
 	char		*value = NULL;
 
+	if (ft->wl == NULL)
+		return (NULL);
+	w = ft->wl->window;
+
 	buffer = evbuffer_new();
 	if (buffer == NULL)
 		fatalx("out of memory");
@@ -707,8 +1108,8 @@ format_cb_window_active_clients_list(struct format_tree *ft)
 		}
 	}
 
-	if ((size = EVBUFFER_LENGTH(buffer)) != 0)
-		xasprintf(&value, "%.*s", size, EVBUFFER_DATA(buffer));
+	size = EVBUFFER_LENGTH(buffer);
+	xasprintf(&value, "%.*s", size, EVBUFFER_DATA(buffer));
 	evbuffer_free(buffer);
 	return (value);
 }
@@ -741,7 +1142,7 @@ format_cb_window_visible_layout(struct format_tree *ft)
 
 /* Callback for pane_start_command. */
 static char *
-format_cb_start_command(struct format_tree *ft)
+format_cb_pane_start_command(struct format_tree *ft)
 {
 	struct window_pane	*wp = ft->wp;
 
@@ -753,7 +1154,7 @@ format_cb_start_command(struct format_tree *ft)
 
 /* Callback for pane_current_command. */
 static char *
-format_cb_current_command(struct format_tree *ft)
+format_cb_pane_current_command(struct format_tree *ft)
 {
 	struct window_pane	*wp = ft->wp;
 	char			*cmd, *value;
@@ -777,7 +1178,7 @@ format_cb_current_command(struct format_tree *ft)
 
 /* Callback for pane_current_path. */
 static char *
-format_cb_current_path(struct format_tree *ft)
+format_cb_pane_current_path(struct format_tree *ft)
 {
 	struct window_pane	*wp = ft->wp;
 	char			*cwd;
@@ -796,24 +1197,14 @@ static char *
 format_cb_history_bytes(struct format_tree *ft)
 {
 	struct window_pane	*wp = ft->wp;
-	struct grid		*gd;
-	struct grid_line	*gl;
-	size_t		         size = 0;
-	u_int			 i;
+	struct grid_usage	 gu;
 	char			*value;
 
 	if (wp == NULL)
 		return (NULL);
-	gd = wp->base.grid;
-
-	for (i = 0; i < gd->hsize + gd->sy; i++) {
-		gl = grid_get_line(gd, i);
-		size += gl->cellsize * sizeof *gl->celldata;
-		size += gl->extdsize * sizeof *gl->extddata;
-	}
-	size += (gd->hsize + gd->sy) * sizeof *gl;
+	grid_get_usage(wp->base.grid, &gu);
 
-	xasprintf(&value, "%zu", size);
+	xasprintf(&value, "%zu", gu.bytes);
 	return (value);
 }
 
@@ -822,25 +1213,129 @@ static char *
 format_cb_history_all_bytes(struct format_tree *ft)
 {
 	struct window_pane	*wp = ft->wp;
-	struct grid		*gd;
+	struct grid_usage	 gu;
 	struct grid_line	*gl;
-	u_int			 i, lines, cells = 0, extended_cells = 0;
 	char			*value;
 
 	if (wp == NULL)
 		return (NULL);
-	gd = wp->base.grid;
+	grid_get_usage(wp->base.grid, &gu);
 
-	lines = gd->hsize + gd->sy;
-	for (i = 0; i < lines; i++) {
-		gl = grid_get_line(gd, i);
-		cells += gl->cellsize;
-		extended_cells += gl->extdsize;
-	}
+	xasprintf(&value, "%u,%zu,%u,%zu,%u,%zu", gu.nlines,
+	    gu.nlines * sizeof *gl, gu.ncells, gu.ncells * sizeof *gl->celldata,
+	    gu.nextended, gu.nextended * sizeof *gl->extddata);
+	return (value);
+}
+
+/* Callback for history_packed_lines. */
+static char *
+format_cb_history_packed_lines(struct format_tree *ft)
+{
+	struct window_pane	*wp = ft->wp;
+	struct grid_usage	 gu;
+	char			*value;
+
+	if (wp == NULL)
+		return (NULL);
+	grid_get_usage(wp->base.grid, &gu);
+
+	xasprintf(&value, "%u", gu.npacked);
+	return (value);
+}
+
+/* Callback for history_index_bytes. */
+static char *
+format_cb_history_index_bytes(struct format_tree *ft)
+{
+	struct window_pane	*wp = ft->wp;
+	struct grid_usage	 gu;
+	char			*value;
+
+	if (wp == NULL)
+		return (NULL);
+	grid_get_usage(wp->base.grid, &gu);
+
+	xasprintf(&value, "%zu", gu.index_bytes);
+	return (value);
+}
+
+/* Callback for history_packed_bytes. */
+static char *
+format_cb_history_packed_bytes(struct format_tree *ft)
+{
+	struct window_pane	*wp = ft->wp;
+	struct grid_usage	 gu;
+	char			*value;
+
+	if (wp == NULL)
+		return (NULL);
+	grid_get_usage(wp->base.grid, &gu);
 
-	xasprintf(&value, "%u,%zu,%u,%zu,%u,%zu", lines,
-	    lines * sizeof *gl, cells, cells * sizeof *gl->celldata,
-	    extended_cells, extended_cells * sizeof *gl->extddata);
+	xasprintf(&value, "%zu", gu.packed_bytes);
+	return (value);
+}
+
+/* Callback for history_shared_lines. */
+static char *
+format_cb_history_shared_lines(struct format_tree *ft)
+{
+	struct window_pane	*wp = ft->wp;
+	struct grid_usage	 gu;
+	char			*value;
+
+	if (wp == NULL)
+		return (NULL);
+	grid_get_usage(wp->base.grid, &gu);
+
+	xasprintf(&value, "%u", gu.nshared);
+	return (value);
+}
+
+/* Callback for history_slab_bytes. */
+static char *
+format_cb_history_slab_bytes(struct format_tree *ft)
+{
+	struct window_pane	*wp = ft->wp;
+	struct grid_usage	 gu;
+	char			*value;
+
+	if (wp == NULL)
+		return (NULL);
+	grid_get_usage(wp->base.grid, &gu);
+
+	xasprintf(&value, "%zu", gu.slab_bytes);
+	return (value);
+}
+
+/* Callback for history_slab_used. */
+static char *
+format_cb_history_slab_used(struct format_tree *ft)
+{
+	struct window_pane	*wp = ft->wp;
+	struct grid_usage	 gu;
+	char			*value;
+
+	if (wp == NULL)
+		return (NULL);
+	grid_get_usage(wp->base.grid, &gu);
+
+	xasprintf(&value, "%zu", gu.slab_used);
+	return (value);
+}
+
+/* Callback for history_slab_blocks. */
+static char *
+format_cb_history_slab_blocks(struct format_tree *ft)
+{
+	struct window_pane	*wp = ft->wp;
+	struct grid_usage	 gu;
+	char			*value;
+
+	if (wp == NULL)
+		return (NULL);
+	grid_get_usage(wp->base.grid, &gu);
+
+	xasprintf(&value, "%u", gu.slab_blocks);
 	return (value);
 }
 
@@ -868,8 +1363,8 @@ format_cb_pane_tabs(struct format_tree *ft)
 			evbuffer_add(buffer, ",", 1);
 		evbuffer_add_printf(buffer, "%u", i);
 	}
-	if ((size = EVBUFFER_LENGTH(buffer)) != 0)
-		xasprintf(&value, "%.*s", size, EVBUFFER_DATA(buffer));
+	size = EVBUFFER_LENGTH(buffer);
+	xasprintf(&value, "%.*s", size, EVBUFFER_DATA(buffer));
 	evbuffer_free(buffer);
 	return (value);
 }
@@ -901,8 +1396,8 @@ format_cb_session_group_list(struct format_tree *ft)
 		evbuffer_add_printf(buffer, "%s", loop->name);
 	}
 
-	if ((size = EVBUFFER_LENGTH(buffer)) != 0)
-		xasprintf(&value, "%.*s", size, EVBUFFER_DATA(buffer));
+	size = EVBUFFER_LENGTH(buffer);
+	xasprintf(&value, "%.*s", size, EVBUFFER_DATA(buffer));
 	evbuffer_free(buffer);
 	return (value);
 }
@@ -941,8 +1436,8 @@ format_cb_session_group_attached_list(struct format_tree *ft)
 		}
 	}
 
-	if ((size = EVBUFFER_LENGTH(buffer)) != 0)
-		xasprintf(&value, "%.*s", size, EVBUFFER_DATA(buffer));
+	size = EVBUFFER_LENGTH(buffer);
+	xasprintf(&value, "%.*s", size, EVBUFFER_DATA(buffer));
 	evbuffer_free(buffer);
 	return (value);
 }
@@ -1026,14 +1521,33 @@ format_cb_cursor_character(struct format_tree *ft)
 	return (value);
 }
 
+/* Get the text of a cell. Padding cells have no text. */
+static void
+format_grid_cell(struct grid *gd, u_int x, u_int y, struct utf8_data *ud)
+{
+	const struct grid_text	*gt;
+	size_t			 start, end;
+
+	gt = grid_get_text(gd, y);
+	if (gt == NULL || x >= gt->ncells) {
+		utf8_set(ud, ' ');
+		return;
+	}
+	start = grid_text_offset(gt, x);
+	end = grid_text_offset(gt, x + 1);
+
+	memcpy(ud->data, gt->text + start, end - start);
+	ud->size = ud->have = end - start;
+	ud->width = 1;
+}
+
 /* Return word at given coordinates. Caller frees. */
 char *
 format_grid_word(struct grid *gd, u_int x, u_int y)
 {
 	const struct grid_line	*gl;
-	struct grid_cell	 gc;
+	struct utf8_data	 ud;
 	const char		*ws;
-	struct utf8_data	*ud = NULL;
 	u_int			 end;
 	size_t			 size = 0;
 	int			 found = 0;
@@ -1042,10 +1556,10 @@ format_grid_word(struct grid *gd, u_int x, u_int y)
 	ws = options_get_string(global_s_options, "word-separators");
 
 	for (;;) {
-		grid_get_cell(gd, x, y, &gc);
-		if (gc.flags & GRID_FLAG_PADDING)
+		format_grid_cell(gd, x, y, &ud);
+		if (ud.size == 0)
 			break;
-		if (utf8_cstrhas(ws, &gc.data)) {
+		if (utf8_cstrhas(ws, &ud)) {
 			found = 1;
 			break;
 		}
@@ -1079,20 +1593,18 @@ format_grid_word(struct grid *gd, u_int x, u_int y)
 		}
 		found = 1;
 
-		grid_get_cell(gd, x, y, &gc);
-		if (gc.flags & GRID_FLAG_PADDING)
+		format_grid_cell(gd, x, y, &ud);
+		if (ud.size == 0)
 			break;
-		if (utf8_cstrhas(ws, &gc.data))
+		if (utf8_cstrhas(ws, &ud))
 			break;
 
-		ud = xreallocarray(ud, size + 2, sizeof *ud);
-		memcpy(&ud[size++], &gc.data, sizeof *ud);
-	}
-	if (size != 0) {
-		ud[size].size = 0;
-		s = utf8_tocstr(ud);
-		free(ud);
+		s = xrealloc(s, size + ud.size + 1);
+		memcpy(s + size, ud.data, ud.size);
+		size += ud.size;
 	}
+	if (s != NULL)
+		s[size] = '\0';
 	return (s);
 }
 
@@ -1127,52 +1639,1451 @@ format_cb_mouse_word(struct format_tree *ft)
 char *
 format_grid_line(struct grid *gd, u_int y)
 {
-	struct grid_cell	 gc;
-	struct utf8_data	*ud = NULL;
-	u_int			 x;
-	size_t			 size = 0;
-	char			*s = NULL;
+	const struct grid_text	*gt;
+	u_int			 x, end;
+	size_t			 size;
 
-	for (x = 0; x < grid_line_length(gd, y); x++) {
-		grid_get_cell(gd, x, y, &gc);
-		if (gc.flags & GRID_FLAG_PADDING)
-			break;
+	end = grid_line_length(gd, y);
+	if (end == 0 || (gt = grid_get_text(gd, y)) == NULL)
+		return (NULL);
 
-		ud = xreallocarray(ud, size + 2, sizeof *ud);
-		memcpy(&ud[size++], &gc.data, sizeof *ud);
-	}
-	if (size != 0) {
-		ud[size].size = 0;
-		s = utf8_tocstr(ud);
-		free(ud);
+	/* Stop at the first padding cell. */
+	if (gt->offsets != NULL) {
+		for (x = 0; x < end; x++) {
+			if (gt->offsets[x] == gt->offsets[x + 1])
+				break;
+		}
+		end = x;
 	}
-	return (s);
+	size = grid_text_offset(gt, end);
+	if (size == 0)
+		return (NULL);
+	return (xstrndup(gt->text, size));
+}
+
+/* Callback for mouse_line. */
+static char *
+format_cb_mouse_line(struct format_tree *ft)
+{
+	struct window_pane	*wp;
+	struct grid		*gd;
+	u_int			 x, y;
+
+	if (!ft->m.valid)
+		return (NULL);
+	wp = cmd_mouse_pane(&ft->m, NULL, NULL);
+	if (wp == NULL)
+		return (NULL);
+	if (cmd_mouse_at(wp, &ft->m, &x, &y, 0) != 0)
+		return (NULL);
+
+	if (!TAILQ_EMPTY(&wp->modes)) {
+		if (TAILQ_FIRST(&wp->modes)->mode == &window_copy_mode ||
+		    TAILQ_FIRST(&wp->modes)->mode == &window_view_mode)
+			return (window_copy_get_line(wp, y));
+		return (NULL);
+	}
+	gd = wp->base.grid;
+	return (format_grid_line(gd, gd->hsize + y));
+}
+
+/* Callback for alternate_on. */
+static char *
+format_cb_alternate_on(struct format_tree *ft)
+{
+	if (ft->wp != NULL)
+		return (format_printf("%d", ft->wp->base.saved_grid != NULL));
+	return (NULL);
+}
+
+/* Callback for client_activity. */
+static char *
+format_cb_client_activity(struct format_tree *ft)
+{
+	if (ft->c != NULL)
+		return (format_tv(&ft->c->activity_time));
+	return (NULL);
+}
+
+/* Callback for client_blocked. */
+static char *
+format_cb_client_blocked(struct format_tree *ft)
+{
+	if (ft->c != NULL)
+		return (format_printf("%d", !!(ft->c->tty.flags & TTY_BLOCK)));
+	return (NULL);
+}
+
+/* Callback for client_blocks. */
+static char *
+format_cb_client_blocks(struct format_tree *ft)
+{
+	if (ft->c != NULL)
+		return (format_printf("%u", ft->c->blocks));
+	return (NULL);
+}
+
+/* Callback for client_cell_height. */
+static char *
+format_cb_client_cell_height(struct format_tree *ft)
+{
+	if (ft->c != NULL)
+		return (format_printf("%u", ft->c->tty.ypixel));
+	return (NULL);
+}
+
+/* Callback for client_cell_width. */
+static char *
+format_cb_client_cell_width(struct format_tree *ft)
+{
+	if (ft->c != NULL)
+		return (format_printf("%u", ft->c->tty.xpixel));
+	return (NULL);
+}
+
+/* Callback for client_control_mode. */
+static char *
+format_cb_client_control_mode(struct format_tree *ft)
+{
+	if (ft->c != NULL)
+		return (format_printf("%d", !!(ft->c->flags & CLIENT_CONTROL)));
+	return (NULL);
+}
+
+/* Callback for client_created. */
+static char *
+format_cb_client_created(struct format_tree *ft)
+{
+	if (ft->c != NULL)
+		return (format_tv(&ft->c->creation_time));
+	return (NULL);
+}
+
+/* Callback for client_discarded. */
+static char *
+format_cb_client_discarded(struct format_tree *ft)
+{
+	if (ft->c != NULL)
+		return (format_printf("%zu", ft->c->discarded));
+	return (NULL);
+}
+
+/* Callback for client_drain_rate. */
+static char *
+format_cb_client_drain_rate(struct format_tree *ft)
+{
+	if (ft->c != NULL)
+		return (format_printf("%zu", ft->c->tty.drain_rate));
+	return (NULL);
+}
+
+/* Callback for client_flags. */
+static char *
+format_cb_client_flags(struct format_tree *ft)
+{
+	if (ft->c != NULL)
+		return (xstrdup(server_client_get_flags(ft->c)));
+	return (NULL);
+}
+
+/* Callback for client_height. */
+static char *
+format_cb_client_height(struct format_tree *ft)
+{
+	if (ft->c != NULL)
+		return (format_printf("%u", ft->c->tty.sy));
+	return (NULL);
+}
+
+/* Callback for client_key_table. */
+static char *
+format_cb_client_key_table(struct format_tree *ft)
+{
+	if (ft->c != NULL)
+		return (xstrdup(ft->c->keytable->name));
+	return (NULL);
+}
+
+/* Callback for client_name. */
+static char *
+format_cb_client_name(struct format_tree *ft)
+{
+	if (ft->c != NULL)
+		return (xstrdup(ft->c->name));
+	return (NULL);
+}
+
+/* Callback for client_pid. */
+static char *
+format_cb_client_pid(struct format_tree *ft)
+{
+	if (ft->c != NULL)
+		return (format_printf("%ld", (long)ft->c->pid));
+	return (NULL);
+}
+
+/* Callback for client_readonly. */
+static char *
+format_cb_client_readonly(struct format_tree *ft)
+{
+	if (ft->c != NULL)
+		return (format_printf("%d",
+		    !!(ft->c->flags & CLIENT_READONLY)));
+	return (NULL);
+}
+
+/* Callback for client_termfeatures. */
+static char *
+format_cb_client_termfeatures(struct format_tree *ft)
+{
+	if (ft->c != NULL)
+		return (xstrdup(tty_get_features(ft->c->term_features)));
+	return (NULL);
+}
+
+/* Callback for client_termname. */
+static char *
+format_cb_client_termname(struct format_tree *ft)
+{
+	if (ft->c != NULL)
+		return (format_printf("%s", ft->c->term_name));
+	return (NULL);
+}
+
+/* Callback for client_tty. */
+static char *
+format_cb_client_tty(struct format_tree *ft)
+{
+	if (ft->c != NULL)
+		return (format_printf("%s", ft->c->ttyname));
+	return (NULL);
+}
+
+/* Callback for client_utf8. */
+static char *
+format_cb_client_utf8(struct format_tree *ft)
+{
+	if (ft->c != NULL)
+		return (format_printf("%d", !!(ft->c->flags & CLIENT_UTF8)));
+	return (NULL);
+}
+
+/* Callback for client_width. */
+static char *
+format_cb_client_width(struct format_tree *ft)
+{
+	if (ft->c != NULL)
+		return (format_printf("%u", ft->c->tty.sx));
+	return (NULL);
+}
+
+/* Callback for client_writes. */
+static char *
+format_cb_client_writes(struct format_tree *ft)
+{
+	if (ft->c != NULL)
+		return (format_printf("%u", ft->c->writes));
+	return (NULL);
+}
+
+/* Callback for client_written. */
+static char *
+format_cb_client_written(struct format_tree *ft)
+{
+	if (ft->c != NULL)
+		return (format_printf("%zu", ft->c->written));
+	return (NULL);
+}
+
+/* Callback for cursor_flag. */
+static char *
+format_cb_cursor_flag(struct format_tree *ft)
+{
+	if (ft->wp != NULL)
+		return (format_printf("%d",
+		    !!(ft->wp->base.mode & MODE_CURSOR)));
+	return (NULL);
+}
+
+/* Callback for cursor_x. */
+static char *
+format_cb_cursor_x(struct format_tree *ft)
+{
+	if (ft->wp != NULL)
+		return (format_printf("%u", ft->wp->base.cx));
+	return (NULL);
+}
+
+/* Callback for cursor_y. */
+static char *
+format_cb_cursor_y(struct format_tree *ft)
+{
+	if (ft->wp != NULL)
+		return (format_printf("%u", ft->wp->base.cy));
+	return (NULL);
+}
+
+/* Callback for history_limit. */
+static char *
+format_cb_history_limit(struct format_tree *ft)
+{
+	if (ft->wp != NULL)
+		return (format_printf("%u", ft->wp->base.grid->hlimit));
+	return (NULL);
+}
+
+/* Callback for history_size. */
+static char *
+format_cb_history_size(struct format_tree *ft)
+{
+	if (ft->wp != NULL)
+		return (format_printf("%u", ft->wp->base.grid->hsize));
+	return (NULL);
+}
+
+/* Callback for insert_flag. */
+static char *
+format_cb_insert_flag(struct format_tree *ft)
+{
+	if (ft->wp != NULL)
+		return (format_printf("%d",
+		    !!(ft->wp->base.mode & MODE_INSERT)));
+	return (NULL);
+}
+
+/* Callback for keypad_cursor_flag. */
+static char *
+format_cb_keypad_cursor_flag(struct format_tree *ft)
+{
+	if (ft->wp != NULL)
+		return (format_printf("%d",
+		    !!(ft->wp->base.mode & MODE_KCURSOR)));
+	return (NULL);
+}
+
+/* Callback for keypad_flag. */
+static char *
+format_cb_keypad_flag(struct format_tree *ft)
+{
+	if (ft->wp != NULL)
+		return (format_printf("%d",
+		    !!(ft->wp->base.mode & MODE_KKEYPAD)));
+	return (NULL);
+}
+
+/* Callback for mouse_all_flag. */
+static char *
+format_cb_mouse_all_flag(struct format_tree *ft)
+{
+	if (ft->wp != NULL)
+		return (format_printf("%d",
+		    !!(ft->wp->base.mode & MODE_MOUSE_ALL)));
+	return (NULL);
+}
+
+/* Callback for mouse_any_flag. */
+static char *
+format_cb_mouse_any_flag(struct format_tree *ft)
+{
+	if (ft->wp != NULL)
+		return (format_printf("%d",
+		    !!(ft->wp->base.mode & ALL_MOUSE_MODES)));
+	return (NULL);
+}
+
+/* Callback for mouse_button_flag. */
+static char *
+format_cb_mouse_button_flag(struct format_tree *ft)
+{
+	if (ft->wp != NULL)
+		return (format_printf("%d",
+		    !!(ft->wp->base.mode & MODE_MOUSE_BUTTON)));
+	return (NULL);
+}
+
+/* Callback for mouse_sgr_flag. */
+static char *
+format_cb_mouse_sgr_flag(struct format_tree *ft)
+{
+	if (ft->wp != NULL)
+		return (format_printf("%d",
+		    !!(ft->wp->base.mode & MODE_MOUSE_SGR)));
+	return (NULL);
+}
+
+/* Callback for mouse_standard_flag. */
+static char *
+format_cb_mouse_standard_flag(struct format_tree *ft)
+{
+	if (ft->wp != NULL)
+		return (format_printf("%d",
+		    !!(ft->wp->base.mode & MODE_MOUSE_STANDARD)));
+	return (NULL);
+}
+
+/* Callback for mouse_utf8_flag. */
+static char *
+format_cb_mouse_utf8_flag(struct format_tree *ft)
+{
+	if (ft->wp != NULL)
+		return (format_printf("%d",
+		    !!(ft->wp->base.mode & MODE_MOUSE_UTF8)));
+	return (NULL);
+}
+
+/* Callback for origin_flag. */
+static char *
+format_cb_origin_flag(struct format_tree *ft)
+{
+	if (ft->wp != NULL)
+		return (format_printf("%d",
+		    !!(ft->wp->base.mode & MODE_ORIGIN)));
+	return (NULL);
+}
+
+/* Callback for pane_active. */
+static char *
+format_cb_pane_active(struct format_tree *ft)
+{
+	if (ft->wp != NULL)
+		return (format_printf("%d", ft->wp == ft->wp->window->active));
+	return (NULL);
+}
+
+/* Callback for pane_at_left. */
+static char *
+format_cb_pane_at_left(struct format_tree *ft)
+{
+	if (ft->wp != NULL)
+		return (format_printf("%d", ft->wp->xoff == 0));
+	return (NULL);
+}
+
+/* Callback for pane_at_right. */
+static char *
+format_cb_pane_at_right(struct format_tree *ft)
+{
+	if (ft->wp != NULL)
+		return (format_printf("%d",
+		    ft->wp->xoff + ft->wp->sx == ft->wp->window->sx));
+	return (NULL);
+}
+
+/* Callback for pane_bottom. */
+static char *
+format_cb_pane_bottom(struct format_tree *ft)
+{
+	if (ft->wp != NULL)
+		return (format_printf("%u", ft->wp->yoff + ft->wp->sy - 1));
+	return (NULL);
+}
+
+/* Callback for pane_height. */
+static char *
+format_cb_pane_height(struct format_tree *ft)
+{
+	if (ft->wp != NULL)
+		return (format_printf("%u", ft->wp->sy));
+	return (NULL);
+}
+
+/* Callback for pane_id. */
+static char *
+format_cb_pane_id(struct format_tree *ft)
+{
+	if (ft->wp != NULL)
+		return (format_printf("%%%u", ft->wp->id));
+	return (NULL);
+}
+
+/* Callback for pane_input_off. */
+static char *
+format_cb_pane_input_off(struct format_tree *ft)
+{
+	if (ft->wp != NULL)
+		return (format_printf("%d", !!(ft->wp->flags & PANE_INPUTOFF)));
+	return (NULL);
+}
+
+/* Callback for pane_last. */
+static char *
+format_cb_pane_last(struct format_tree *ft)
+{
+	if (ft->wp != NULL)
+		return (format_printf("%d", ft->wp == ft->wp->window->last));
+	return (NULL);
+}
+
+/* Callback for pane_left. */
+static char *
+format_cb_pane_left(struct format_tree *ft)
+{
+	if (ft->wp != NULL)
+		return (format_printf("%u", ft->wp->xoff));
+	return (NULL);
+}
+
+/* Callback for pane_output_size. */
+static char *
+format_cb_pane_output_size(struct format_tree *ft)
+{
+	struct window_pane	*wp = ft->wp;
+
+	if (wp != NULL && wp->event != NULL)
+		return (format_printf("%zu", EVBUFFER_LENGTH(wp->event->input)));
+	return (NULL);
+}
+
+/* Callback for pane_pid. */
+static char *
+format_cb_pane_pid(struct format_tree *ft)
+{
+	if (ft->wp != NULL)
+		return (format_printf("%ld", (long)ft->wp->pid));
+	return (NULL);
+}
+
+/* Callback for pane_pipe. */
+static char *
+format_cb_pane_pipe(struct format_tree *ft)
+{
+	if (ft->wp != NULL)
+		return (format_printf("%d", ft->wp->pipe_fd != -1));
+	return (NULL);
+}
+
+/* Callback for pane_right. */
+static char *
+format_cb_pane_right(struct format_tree *ft)
+{
+	if (ft->wp != NULL)
+		return (format_printf("%u", ft->wp->xoff + ft->wp->sx - 1));
+	return (NULL);
+}
+
+/* Callback for pane_skipped. */
+static char *
+format_cb_pane_skipped(struct format_tree *ft)
+{
+	if (ft->wp != NULL)
+		return (format_printf("%zu", ft->wp->skipped));
+	return (NULL);
+}
+
+/* Callback for pane_title. */
+static char *
+format_cb_pane_title(struct format_tree *ft)
+{
+	if (ft->wp != NULL)
+		return (xstrdup(ft->wp->base.title));
+	return (NULL);
+}
+
+/* Callback for pane_top. */
+static char *
+format_cb_pane_top(struct format_tree *ft)
+{
+	if (ft->wp != NULL)
+		return (format_printf("%u", ft->wp->yoff));
+	return (NULL);
+}
+
+/* Callback for pane_tty. */
+static char *
+format_cb_pane_tty(struct format_tree *ft)
+{
+	if (ft->wp != NULL)
+		return (format_printf("%s", ft->wp->tty));
+	return (NULL);
+}
+
+/* Callback for pane_width. */
+static char *
+format_cb_pane_width(struct format_tree *ft)
+{
+	if (ft->wp != NULL)
+		return (format_printf("%u", ft->wp->sx));
+	return (NULL);
+}
+
+/* Callback for pane_written. */
+static char *
+format_cb_pane_written(struct format_tree *ft)
+{
+	if (ft->wp != NULL)
+		return (format_printf("%zu", ft->wp->written));
+	return (NULL);
+}
+
+/* Callback for scroll_region_lower. */
+static char *
+format_cb_scroll_region_lower(struct format_tree *ft)
+{
+	if (ft->wp != NULL)
+		return (format_printf("%u", ft->wp->base.rlower));
+	return (NULL);
+}
+
+/* Callback for scroll_region_upper. */
+static char *
+format_cb_scroll_region_upper(struct format_tree *ft)
+{
+	if (ft->wp != NULL)
+		return (format_printf("%u", ft->wp->base.rupper));
+	return (NULL);
+}
+
+/* Callback for session_activity. */
+static char *
+format_cb_session_activity(struct format_tree *ft)
+{
+	if (ft->s != NULL)
+		return (format_tv(&ft->s->activity_time));
+	return (NULL);
+}
+
+/* Callback for session_attached. */
+static char *
+format_cb_session_attached(struct format_tree *ft)
+{
+	if (ft->s != NULL)
+		return (format_printf("%u", ft->s->attached));
+	return (NULL);
+}
+
+/* Callback for session_created. */
+static char *
+format_cb_session_created(struct format_tree *ft)
+{
+	if (ft->s != NULL)
+		return (format_tv(&ft->s->creation_time));
+	return (NULL);
+}
+
+/* Callback for session_grouped. */
+static char *
+format_cb_session_grouped(struct format_tree *ft)
+{
+	if (ft->s != NULL)
+		return (format_printf("%d",
+		    session_group_contains(ft->s) != NULL));
+	return (NULL);
+}
+
+/* Callback for session_id. */
+static char *
+format_cb_session_id(struct format_tree *ft)
+{
+	if (ft->s != NULL)
+		return (format_printf("$%u", ft->s->id));
+	return (NULL);
+}
+
+/* Callback for session_last_attached. */
+static char *
+format_cb_session_last_attached(struct format_tree *ft)
+{
+	char	*value;
+
+	if (ft->s == NULL)
+		return (NULL);
+	if ((value = format_tv(&ft->s->last_attached_time)) == NULL)
+		return (xstrdup(""));
+	return (value);
+}
+
+/* Callback for session_many_attached. */
+static char *
+format_cb_session_many_attached(struct format_tree *ft)
+{
+	if (ft->s != NULL)
+		return (format_printf("%d", ft->s->attached > 1));
+	return (NULL);
+}
+
+/* Callback for session_name. */
+static char *
+format_cb_session_name(struct format_tree *ft)
+{
+	if (ft->s != NULL)
+		return (xstrdup(ft->s->name));
+	return (NULL);
+}
+
+/* Callback for session_path. */
+static char *
+format_cb_session_path(struct format_tree *ft)
+{
+	if (ft->s != NULL)
+		return (format_printf("%s", ft->s->cwd));
+	return (NULL);
+}
+
+/* Callback for session_windows. */
+static char *
+format_cb_session_windows(struct format_tree *ft)
+{
+	if (ft->s != NULL)
+		return (format_printf("%u", winlink_count(&ft->s->windows)));
+	return (NULL);
+}
+
+/* Callback for socket_path. */
+static char *
+format_cb_socket_path(__unused struct format_tree *ft)
+{
+	return (xstrdup(socket_path));
+}
+
+/* Callback for start_time. */
+static char *
+format_cb_start_time(__unused struct format_tree *ft)
+{
+	return (format_tv(&start_time));
+}
+
+/* Callback for version. */
+static char *
+format_cb_version(__unused struct format_tree *ft)
+{
+	return (xstrdup(getversion()));
+}
+
+/* Callback for window_active. */
+static char *
+format_cb_window_active(struct format_tree *ft)
+{
+	if (ft->wl != NULL)
+		return (format_printf("%d", ft->wl == ft->wl->session->curw));
+	return (NULL);
+}
+
+/* Callback for window_activity. */
+static char *
+format_cb_window_activity(struct format_tree *ft)
+{
+	if (ft->w != NULL)
+		return (format_tv(&ft->w->activity_time));
+	return (NULL);
+}
+
+/* Callback for window_activity_flag. */
+static char *
+format_cb_window_activity_flag(struct format_tree *ft)
+{
+	if (ft->wl != NULL)
+		return (format_printf("%d",
+		    !!(ft->wl->flags & WINLINK_ACTIVITY)));
+	return (NULL);
+}
+
+/* Callback for window_bell_flag. */
+static char *
+format_cb_window_bell_flag(struct format_tree *ft)
+{
+	if (ft->wl != NULL)
+		return (format_printf("%d", !!(ft->wl->flags & WINLINK_BELL)));
+	return (NULL);
+}
+
+/* Callback for window_cell_height. */
+static char *
+format_cb_window_cell_height(struct format_tree *ft)
+{
+	if (ft->w != NULL)
+		return (format_printf("%u", ft->w->ypixel));
+	return (NULL);
+}
+
+/* Callback for window_cell_width. */
+static char *
+format_cb_window_cell_width(struct format_tree *ft)
+{
+	if (ft->w != NULL)
+		return (format_printf("%u", ft->w->xpixel));
+	return (NULL);
+}
+
+/* Callback for window_end_flag. */
+static char *
+format_cb_window_end_flag(struct format_tree *ft)
+{
+	if (ft->wl != NULL)
+		return (format_printf("%d",
+		    ft->wl == RB_MAX(winlinks, &ft->wl->session->windows)));
+	return (NULL);
+}
+
+/* Callback for window_flags. */
+static char *
+format_cb_window_flags(struct format_tree *ft)
+{
+	if (ft->wl != NULL)
+		return (xstrdup(window_printable_flags(ft->wl)));
+	return (NULL);
+}
+
+/* Callback for window_height. */
+static char *
+format_cb_window_height(struct format_tree *ft)
+{
+	if (ft->w != NULL)
+		return (format_printf("%u", ft->w->sy));
+	return (NULL);
+}
+
+/* Callback for window_id. */
+static char *
+format_cb_window_id(struct format_tree *ft)
+{
+	if (ft->w != NULL)
+		return (format_printf("@%u", ft->w->id));
+	return (NULL);
+}
+
+/* Callback for window_index. */
+static char *
+format_cb_window_index(struct format_tree *ft)
+{
+	if (ft->wl != NULL)
+		return (format_printf("%d", ft->wl->idx));
+	return (NULL);
+}
+
+/* Callback for window_last_flag. */
+static char *
+format_cb_window_last_flag(struct format_tree *ft)
+{
+	if (ft->wl != NULL)
+		return (format_printf("%d",
+		    ft->wl == TAILQ_FIRST(&ft->wl->session->lastw)));
+	return (NULL);
+}
+
+/* Callback for window_linked. */
+static char *
+format_cb_window_linked(struct format_tree *ft)
+{
+	if (ft->wl != NULL)
+		return (format_printf("%d",
+		    session_is_linked(ft->wl->session, ft->wl->window)));
+	return (NULL);
+}
+
+/* Callback for window_linked_sessions. */
+static char *
+format_cb_window_linked_sessions(struct format_tree *ft)
+{
+	if (ft->wl != NULL)
+		return (format_printf("%u", ft->wl->window->references));
+	return (NULL);
+}
+
+/* Callback for window_name. */
+static char *
+format_cb_window_name(struct format_tree *ft)
+{
+	if (ft->w != NULL)
+		return (xstrdup(ft->w->name));
+	return (NULL);
+}
+
+/* Callback for window_panes. */
+static char *
+format_cb_window_panes(struct format_tree *ft)
+{
+	if (ft->w != NULL)
+		return (format_printf("%u", window_count_panes(ft->w)));
+	return (NULL);
+}
+
+/* Callback for window_silence_flag. */
+static char *
+format_cb_window_silence_flag(struct format_tree *ft)
+{
+	if (ft->wl != NULL)
+		return (format_printf("%d",
+		    !!(ft->wl->flags & WINLINK_SILENCE)));
+	return (NULL);
+}
+
+/* Callback for window_start_flag. */
+static char *
+format_cb_window_start_flag(struct format_tree *ft)
+{
+	if (ft->wl != NULL)
+		return (format_printf("%d",
+		    ft->wl == RB_MIN(winlinks, &ft->wl->session->windows)));
+	return (NULL);
+}
+
+/* Callback for window_width. */
+static char *
+format_cb_window_width(struct format_tree *ft)
+{
+	if (ft->w != NULL)
+		return (format_printf("%u", ft->w->sx));
+	return (NULL);
+}
+
+/* Callback for window_zoomed_flag. */
+static char *
+format_cb_window_zoomed_flag(struct format_tree *ft)
+{
+	if (ft->w != NULL)
+		return (format_printf("%d", !!(ft->w->flags & WINDOW_ZOOMED)));
+	return (NULL);
+}
+
+/* Callback for wrap_flag. */
+static char *
+format_cb_wrap_flag(struct format_tree *ft)
+{
+	if (ft->wp != NULL)
+		return (format_printf("%d", !!(ft->wp->base.mode & MODE_WRAP)));
+	return (NULL);
+}
+
+/* Callback for client_blocked_time. */
+static char *
+format_cb_client_blocked_time(struct format_tree *ft)
+{
+	struct client	*c = ft->c;
+	struct timeval	 tv, blocked;
+
+	if (c == NULL)
+		return (NULL);
+
+	memcpy(&blocked, &c->block_time, sizeof blocked);
+	if (c->tty.flags & TTY_BLOCK) {
+		gettimeofday(&tv, NULL);
+		timersub(&tv, &c->block_start, &tv);
+		timeradd(&blocked, &tv, &blocked);
+	}
+	return (format_printf("%llu",
+	    (unsigned long long)blocked.tv_sec * 1000 +
+	    blocked.tv_usec / 1000));
+}
+
+/* Callback for client_last_session. */
+static char *
+format_cb_client_last_session(struct format_tree *ft)
+{
+	struct client	*c = ft->c;
+
+	if (c != NULL && c->last_session != NULL &&
+	    session_alive(c->last_session))
+		return (xstrdup(c->last_session->name));
+	return (NULL);
+}
+
+/* Callback for client_output_depth. */
+static char *
+format_cb_client_output_depth(struct format_tree *ft)
+{
+	struct client	*c = ft->c;
+
+	if (c == NULL)
+		return (NULL);
+	if (c->writes == 0)
+		return (xstrdup("0"));
+	return (format_printf("%zu", c->write_depth / c->writes));
+}
+
+/* Callback for client_prefix. */
+static char *
+format_cb_client_prefix(struct format_tree *ft)
+{
+	struct client	*c = ft->c;
+	const char	*name;
+
+	if (c == NULL)
+		return (NULL);
+
+	name = server_client_get_key_table(c);
+	if (strcmp(c->keytable->name, name) == 0)
+		return (xstrdup("0"));
+	return (xstrdup("1"));
+}
+
+/* Callback for client_session. */
+static char *
+format_cb_client_session(struct format_tree *ft)
+{
+	if (ft->c != NULL && ft->c->session != NULL)
+		return (xstrdup(ft->c->session->name));
+	return (NULL);
 }
 
-/* Callback for mouse_line. */
+/* Callback for client_termtype. */
 static char *
-format_cb_mouse_line(struct format_tree *ft)
+format_cb_client_termtype(struct format_tree *ft)
 {
-	struct window_pane	*wp;
-	struct grid		*gd;
-	u_int			 x, y;
+	if (ft->c != NULL && ft->c->term_type != NULL)
+		return (xstrdup(ft->c->term_type));
+	return (NULL);
+}
 
-	if (!ft->m.valid)
+/* Callback for session_group. */
+static char *
+format_cb_session_group(struct format_tree *ft)
+{
+	struct session_group	*sg;
+
+	if (ft->s != NULL && (sg = session_group_contains(ft->s)) != NULL)
+		return (xstrdup(sg->name));
+	return (NULL);
+}
+
+/* Callback for session_group_attached. */
+static char *
+format_cb_session_group_attached(struct format_tree *ft)
+{
+	struct session_group	*sg;
+
+	if (ft->s != NULL && (sg = session_group_contains(ft->s)) != NULL)
+		return (format_printf("%u", session_group_attached_count(sg)));
+	return (NULL);
+}
+
+/* Callback for session_group_many_attached. */
+static char *
+format_cb_session_group_many_attached(struct format_tree *ft)
+{
+	struct session_group	*sg;
+
+	if (ft->s != NULL && (sg = session_group_contains(ft->s)) != NULL)
+		return (format_printf("%d",
+		    session_group_attached_count(sg) > 1));
+	return (NULL);
+}
+
+/* Callback for session_group_size. */
+static char *
+format_cb_session_group_size(struct format_tree *ft)
+{
+	struct session_group	*sg;
+
+	if (ft->s != NULL && (sg = session_group_contains(ft->s)) != NULL)
+		return (format_printf("%u", session_group_count(sg)));
+	return (NULL);
+}
+
+/* Callback for session_marked. */
+static char *
+format_cb_session_marked(struct format_tree *ft)
+{
+	if (ft->s == NULL)
 		return (NULL);
-	wp = cmd_mouse_pane(&ft->m, NULL, NULL);
+	if (server_check_marked() && marked_pane.s == ft->s)
+		return (xstrdup("1"));
+	return (xstrdup("0"));
+}
+
+/* Callback for window_bigger. */
+static char *
+format_cb_window_bigger(struct format_tree *ft)
+{
+	u_int	ox, oy, sx, sy;
+
+	if (ft->c == NULL || ft->wl == NULL)
+		return (NULL);
+	return (format_printf("%d",
+	    tty_window_offset(&ft->c->tty, &ox, &oy, &sx, &sy)));
+}
+
+/* Callback for window_marked_flag. */
+static char *
+format_cb_window_marked_flag(struct format_tree *ft)
+{
+	if (ft->wl == NULL)
+		return (NULL);
+	if (server_check_marked() && marked_pane.wl == ft->wl)
+		return (xstrdup("1"));
+	return (xstrdup("0"));
+}
+
+/* Callback for window_offset_x. */
+static char *
+format_cb_window_offset_x(struct format_tree *ft)
+{
+	u_int	ox, oy, sx, sy;
+
+	if (ft->c == NULL || ft->wl == NULL)
+		return (NULL);
+	if (!tty_window_offset(&ft->c->tty, &ox, &oy, &sx, &sy))
+		return (NULL);
+	return (format_printf("%u", ox));
+}
+
+/* Callback for window_offset_y. */
+static char *
+format_cb_window_offset_y(struct format_tree *ft)
+{
+	u_int	ox, oy, sx, sy;
+
+	if (ft->c == NULL || ft->wl == NULL)
+		return (NULL);
+	if (!tty_window_offset(&ft->c->tty, &ox, &oy, &sx, &sy))
+		return (NULL);
+	return (format_printf("%u", oy));
+}
+
+/* Callback for alternate_saved_x. */
+static char *
+format_cb_alternate_saved_x(struct format_tree *ft)
+{
+	if (ft->wp != NULL && ft->wp->base.saved_cx != UINT_MAX)
+		return (format_printf("%u", ft->wp->base.saved_cx));
+	return (NULL);
+}
+
+/* Callback for alternate_saved_y. */
+static char *
+format_cb_alternate_saved_y(struct format_tree *ft)
+{
+	if (ft->wp != NULL && ft->wp->base.saved_cy != UINT_MAX)
+		return (format_printf("%u", ft->wp->base.saved_cy));
+	return (NULL);
+}
+
+/* Callback for pane_dead. */
+static char *
+format_cb_pane_dead(struct format_tree *ft)
+{
+	struct window_pane	*wp = ft->wp;
+
 	if (wp == NULL)
 		return (NULL);
-	if (cmd_mouse_at(wp, &ft->m, &x, &y, 0) != 0)
+	if (wp->flags & PANE_EMPTY)
+		return (xstrdup("0"));
+	return (format_printf("%d", wp->fd == -1));
+}
+
+/* Callback for pane_dead_status. */
+static char *
+format_cb_pane_dead_status(struct format_tree *ft)
+{
+	struct window_pane	*wp = ft->wp;
+
+	if (wp != NULL &&
+	    (wp->flags & PANE_STATUSREADY) &&
+	    WIFEXITED(wp->status))
+		return (format_printf("%d", WEXITSTATUS(wp->status)));
+	return (NULL);
+}
+
+/* Callback for pane_index. */
+static char *
+format_cb_pane_index(struct format_tree *ft)
+{
+	u_int	idx;
+
+	if (ft->wp == NULL)
 		return (NULL);
+	if (window_pane_index(ft->wp, &idx) != 0)
+		fatalx("index not found");
+	return (format_printf("%u", idx));
+}
 
-	if (!TAILQ_EMPTY(&wp->modes)) {
-		if (TAILQ_FIRST(&wp->modes)->mode == &window_copy_mode ||
-		    TAILQ_FIRST(&wp->modes)->mode == &window_view_mode)
-			return (window_copy_get_line(wp, y));
+/* Callback for pane_marked. */
+static char *
+format_cb_pane_marked(struct format_tree *ft)
+{
+	if (ft->wp == NULL)
 		return (NULL);
-	}
-	gd = wp->base.grid;
-	return (format_grid_line(gd, gd->hsize + y));
+	if (server_check_marked() && marked_pane.wp == ft->wp)
+		return (xstrdup("1"));
+	return (xstrdup("0"));
+}
+
+/* Callback for pane_marked_set. */
+static char *
+format_cb_pane_marked_set(struct format_tree *ft)
+{
+	if (ft->wp == NULL)
+		return (NULL);
+	return (format_printf("%d", server_check_marked()));
+}
+
+/* Callback for pane_mode. */
+static char *
+format_cb_pane_mode(struct format_tree *ft)
+{
+	struct window_mode_entry	*wme;
+
+	if (ft->wp == NULL || (wme = TAILQ_FIRST(&ft->wp->modes)) == NULL)
+		return (NULL);
+	return (xstrdup(wme->mode->name));
+}
+
+/* Callback for pane_path. */
+static char *
+format_cb_pane_path(struct format_tree *ft)
+{
+	if (ft->wp != NULL && ft->wp->base.path != NULL)
+		return (xstrdup(ft->wp->base.path));
+	return (NULL);
+}
+
+/* Callback for pane_search_string. */
+static char *
+format_cb_pane_search_string(struct format_tree *ft)
+{
+	if (ft->wp != NULL && ft->wp->searchstr != NULL)
+		return (xstrdup(ft->wp->searchstr));
+	return (NULL);
+}
+
+/* Callback for pane_synchronized. */
+static char *
+format_cb_pane_synchronized(struct format_tree *ft)
+{
+	struct window_pane	*wp = ft->wp;
+
+	if (wp == NULL)
+		return (NULL);
+	return (format_printf("%d",
+	    !!options_get_number(wp->window->options, "synchronize-panes")));
+}
+
+/* Callback for buffer_created. */
+static char *
+format_cb_buffer_created(struct format_tree *ft)
+{
+	struct timeval	 tv;
+
+	if (ft->pb == NULL)
+		return (NULL);
+	timerclear(&tv);
+	tv.tv_sec = paste_buffer_created(ft->pb);
+	return (format_tv(&tv));
+}
+
+/* Callback for buffer_name. */
+static char *
+format_cb_buffer_name(struct format_tree *ft)
+{
+	if (ft->pb != NULL)
+		return (xstrdup(paste_buffer_name(ft->pb)));
+	return (NULL);
+}
+
+/* Callback for buffer_sample. */
+static char *
+format_cb_buffer_sample(struct format_tree *ft)
+{
+	if (ft->pb != NULL)
+		return (paste_make_sample(ft->pb));
+	return (NULL);
+}
+
+/* Callback for buffer_size. */
+static char *
+format_cb_buffer_size(struct format_tree *ft)
+{
+	size_t	size;
+
+	if (ft->pb == NULL)
+		return (NULL);
+	paste_buffer_data(ft->pb, &size);
+	return (format_printf("%zu", size));
+}
+
+/*
+ * Format table. These are looked up when a key is not in the tree, so only the
+ * values that are used are worked out. Must be sorted.
+ */
+static const struct format_table_entry format_table[] = {
+	{ "alternate_on", format_cb_alternate_on },
+	{ "alternate_saved_x", format_cb_alternate_saved_x },
+	{ "alternate_saved_y", format_cb_alternate_saved_y },
+	{ "buffer_created", format_cb_buffer_created },
+	{ "buffer_name", format_cb_buffer_name },
+	{ "buffer_sample", format_cb_buffer_sample },
+	{ "buffer_size", format_cb_buffer_size },
+	{ "client_activity", format_cb_client_activity },
+	{ "client_blocked", format_cb_client_blocked },
+	{ "client_blocked_time", format_cb_client_blocked_time },
+	{ "client_blocks", format_cb_client_blocks },
+	{ "client_cell_height", format_cb_client_cell_height },
+	{ "client_cell_width", format_cb_client_cell_width },
+	{ "client_control_mode", format_cb_client_control_mode },
+	{ "client_created", format_cb_client_created },
+	{ "client_discarded", format_cb_client_discarded },
+	{ "client_drain_rate", format_cb_client_drain_rate },
+	{ "client_flags", format_cb_client_flags },
+	{ "client_height", format_cb_client_height },
+	{ "client_key_table", format_cb_client_key_table },
+	{ "client_last_session", format_cb_client_last_session },
+	{ "client_name", format_cb_client_name },
+	{ "client_output_depth", format_cb_client_output_depth },
+	{ "client_pid", format_cb_client_pid },
+	{ "client_prefix", format_cb_client_prefix },
+	{ "client_readonly", format_cb_client_readonly },
+	{ "client_session", format_cb_client_session },
+	{ "client_termfeatures", format_cb_client_termfeatures },
+	{ "client_termname", format_cb_client_termname },
+	{ "client_termtype", format_cb_client_termtype },
+	{ "client_tty", format_cb_client_tty },
+	{ "client_utf8", format_cb_client_utf8 },
+	{ "client_width", format_cb_client_width },
+	{ "client_writes", format_cb_client_writes },
+	{ "client_written", format_cb_client_written },
+	{ "cursor_character", format_cb_cursor_character },
+	{ "cursor_flag", format_cb_cursor_flag },
+	{ "cursor_x", format_cb_cursor_x },
+	{ "cursor_y", format_cb_cursor_y },
+	{ "history_all_bytes", format_cb_history_all_bytes },
+	{ "history_bytes", format_cb_history_bytes },
+	{ "history_index_bytes", format_cb_history_index_bytes },
+	{ "history_limit", format_cb_history_limit },
+	{ "history_packed_bytes", format_cb_history_packed_bytes },
+	{ "history_packed_lines", format_cb_history_packed_lines },
+	{ "history_shared_lines", format_cb_history_shared_lines },
+	{ "history_size", format_cb_history_size },
+	{ "history_slab_blocks", format_cb_history_slab_blocks },
+	{ "history_slab_bytes", format_cb_history_slab_bytes },
+	{ "history_slab_used", format_cb_history_slab_used },
+	{ "host", format_cb_host },
+	{ "host_short", format_cb_host_short },
+	{ "insert_flag", format_cb_insert_flag },
+	{ "keypad_cursor_flag", format_cb_keypad_cursor_flag },
+	{ "keypad_flag", format_cb_keypad_flag },
+	{ "mouse_all_flag", format_cb_mouse_all_flag },
+	{ "mouse_any_flag", format_cb_mouse_any_flag },
+	{ "mouse_button_flag", format_cb_mouse_button_flag },
+	{ "mouse_sgr_flag", format_cb_mouse_sgr_flag },
+	{ "mouse_standard_flag", format_cb_mouse_standard_flag },
+	{ "mouse_utf8_flag", format_cb_mouse_utf8_flag },
+	{ "origin_flag", format_cb_origin_flag },
+	{ "pane_active", format_cb_pane_active },
+	{ "pane_at_bottom", format_cb_pane_at_bottom },
+	{ "pane_at_left", format_cb_pane_at_left },
+	{ "pane_at_right", format_cb_pane_at_right },
+	{ "pane_at_top", format_cb_pane_at_top },
+	{ "pane_bottom", format_cb_pane_bottom },
+	{ "pane_current_command", format_cb_pane_current_command },
+	{ "pane_current_path", format_cb_pane_current_path },
+	{ "pane_dead", format_cb_pane_dead },
+	{ "pane_dead_status", format_cb_pane_dead_status },
+	{ "pane_height", format_cb_pane_height },
+	{ "pane_id", format_cb_pane_id },
+	{ "pane_in_mode", format_cb_pane_in_mode },
+	{ "pane_index", format_cb_pane_index },
+	{ "pane_input_off", format_cb_pane_input_off },
+	{ "pane_last", format_cb_pane_last },
+	{ "pane_left", format_cb_pane_left },
+	{ "pane_marked", format_cb_pane_marked },
+	{ "pane_marked_set", format_cb_pane_marked_set },
+	{ "pane_mode", format_cb_pane_mode },
+	{ "pane_output_size", format_cb_pane_output_size },
+	{ "pane_path", format_cb_pane_path },
+	{ "pane_pid", format_cb_pane_pid },
+	{ "pane_pipe", format_cb_pane_pipe },
+	{ "pane_right", format_cb_pane_right },
+	{ "pane_search_string", format_cb_pane_search_string },
+	{ "pane_skipped", format_cb_pane_skipped },
+	{ "pane_start_command", format_cb_pane_start_command },
+	{ "pane_synchronized", format_cb_pane_synchronized },
+	{ "pane_tabs", format_cb_pane_tabs },
+	{ "pane_title", format_cb_pane_title },
+	{ "pane_top", format_cb_pane_top },
+	{ "pane_tty", format_cb_pane_tty },
+	{ "pane_width", format_cb_pane_width },
+	{ "pane_written", format_cb_pane_written },
+	{ "pid", format_cb_pid },
+	{ "scroll_region_lower", format_cb_scroll_region_lower },
+	{ "scroll_region_upper", format_cb_scroll_region_upper },
+	{ "session_activity", format_cb_session_activity },
+	{ "session_alerts", format_cb_session_alerts },
+	{ "session_attached", format_cb_session_attached },
+	{ "session_attached_list", format_cb_session_attached_list },
+	{ "session_created", format_cb_session_created },
+	{ "session_group", format_cb_session_group },
+	{ "session_group_attached", format_cb_session_group_attached },
+	{ "session_group_attached_list",
+	  format_cb_session_group_attached_list },
+	{ "session_group_list", format_cb_session_group_list },
+	{ "session_group_many_attached",
+	  format_cb_session_group_many_attached },
+	{ "session_group_size", format_cb_session_group_size },
+	{ "session_grouped", format_cb_session_grouped },
+	{ "session_id", format_cb_session_id },
+	{ "session_last_attached", format_cb_session_last_attached },
+	{ "session_many_attached", format_cb_session_many_attached },
+	{ "session_marked", format_cb_session_marked },
+	{ "session_name", format_cb_session_name },
+	{ "session_path", format_cb_session_path },
+	{ "session_stack", format_cb_session_stack },
+	{ "session_windows", format_cb_session_windows },
+	{ "socket_path", format_cb_socket_path },
+	{ "start_time", format_cb_start_time },
+	{ "version", format_cb_version },
+	{ "window_active", format_cb_window_active },
+	{ "window_active_clients", format_cb_window_active_clients },
+	{ "window_active_clients_list", format_cb_window_active_clients_list },
+	{ "window_active_sessions", format_cb_window_active_sessions },
+	{ "window_active_sessions_list",
+	  format_cb_window_active_sessions_list },
+	{ "window_activity", format_cb_window_activity },
+	{ "window_activity_flag", format_cb_window_activity_flag },
+	{ "window_bell_flag", format_cb_window_bell_flag },
+	{ "window_bigger", format_cb_window_bigger },
+	{ "window_cell_height", format_cb_window_cell_height },
+	{ "window_cell_width", format_cb_window_cell_width },
+	{ "window_end_flag", format_cb_window_end_flag },
+	{ "window_flags", format_cb_window_flags },
+	{ "window_height", format_cb_window_height },
+	{ "window_id", format_cb_window_id },
+	{ "window_index", format_cb_window_index },
+	{ "window_last_flag", format_cb_window_last_flag },
+	{ "window_layout", format_cb_window_layout },
+	{ "window_linked", format_cb_window_linked },
+	{ "window_linked_sessions", format_cb_window_linked_sessions },
+	{ "window_linked_sessions_list",
+	  format_cb_window_linked_sessions_list },
+	{ "window_marked_flag", format_cb_window_marked_flag },
+	{ "window_name", format_cb_window_name },
+	{ "window_offset_x", format_cb_window_offset_x },
+	{ "window_offset_y", format_cb_window_offset_y },
+	{ "window_panes", format_cb_window_panes },
+	{ "window_silence_flag", format_cb_window_silence_flag },
+	{ "window_stack_index", format_cb_window_stack_index },
+	{ "window_start_flag", format_cb_window_start_flag },
+	{ "window_visible_layout", format_cb_window_visible_layout },
+	{ "window_width", format_cb_window_width },
+	{ "window_zoomed_flag", format_cb_window_zoomed_flag },
+	{ "wrap_flag", format_cb_wrap_flag },
+};
+
+/* Compare format table entries. */
+static int
+format_table_compare(const void *key0, const void *entry0)
+{
+	const char				*key = key0;
+	const struct format_table_entry		*entry = entry0;
+
+	return (strcmp(key, entry->key));
+}
+
+/* Get a format callback from the table. */
+static const struct format_table_entry *
+format_table_get(const char *key)
+{
+	return (bsearch(key, format_table, nitems(format_table),
+	    sizeof *format_table, format_table_compare));
+}
+
+/* Does a format from the table depend on the client? */
+static int
+format_table_client(const char *key)
+{
+	if (strncmp(key, "client_", 7) == 0)
+		return (1);
+	if (strcmp(key, "window_bigger") == 0)
+		return (1);
+	return (strncmp(key, "window_offset_", 14) == 0);
 }
 
 /* Merge one format tree into another. */
@@ -1242,13 +3153,6 @@ format_create(struct client *c, struct cmdq_item *item, int tag, int flags)
 	ft->tag = tag;
 	ft->flags = flags;
 
-	format_add(ft, "version", "%s", getversion());
-	format_add_cb(ft, "host", format_cb_host);
-	format_add_cb(ft, "host_short", format_cb_host_short);
-	format_add_cb(ft, "pid", format_cb_pid);
-	format_add(ft, "socket_path", "%s", socket_path);
-	format_add_tv(ft, "start_time", &start_time);
-
 	for (wm = all_window_modes; *wm != NULL; wm++) {
 		if ((*wm)->default_format != NULL) {
 			xsnprintf(tmp, sizeof tmp, "%s_format", (*wm)->name);
@@ -1281,27 +3185,56 @@ format_free(struct format_tree *ft)
 	free(ft);
 }
 
-/* Walk each format. */
+/* Walk one format entry. */
+static void
+format_each1(struct format_tree *ft, struct format_entry *fe,
+    void (*cb)(const char *, const char *, void *), void *arg)
+{
+	char	s[64];
+
+	if (fe->time != 0) {
+		xsnprintf(s, sizeof s, "%lld", (long long)fe->time);
+		cb(fe->key, s, arg);
+	} else {
+		if (fe->value == NULL && fe->cb != NULL) {
+			fe->value = fe->cb(ft);
+			if (fe->value == NULL)
+				fe->value = xstrdup("");
+		}
+		cb(fe->key, fe->value, arg);
+	}
+}
+
+/* Walk each format, in order, including those from the table. */
 void
 format_each(struct format_tree *ft, void (*cb)(const char *, const char *,
     void *), void *arg)
 {
-	struct format_entry	*fe;
-	char			 s[64];
+	const struct format_table_entry	*fte;
+	struct format_entry		*fe;
+	u_int				 i;
+	int				 cmp;
+	char				*value;
 
-	RB_FOREACH(fe, format_entry_tree, &ft->tree) {
-		if (fe->time != 0) {
-			xsnprintf(s, sizeof s, "%lld", (long long)fe->time);
-			cb(fe->key, s, arg);
-		} else {
-			if (fe->value == NULL && fe->cb != NULL) {
-				fe->value = fe->cb(ft);
-				if (fe->value == NULL)
-					fe->value = xstrdup("");
-			}
-			cb(fe->key, fe->value, arg);
+	fe = RB_MIN(format_entry_tree, &ft->tree);
+	for (i = 0; i < nitems(format_table); i++) {
+		fte = &format_table[i];
+		cmp = -1;
+		while (fe != NULL && (cmp = strcmp(fe->key, fte->key)) < 0) {
+			format_each1(ft, fe, cb, arg);
+			fe = RB_NEXT(format_entry_tree, &ft->tree, fe);
+		}
+		if (fe != NULL && cmp == 0)
+			continue;
+
+		value = fte->cb(ft);
+		if (value != NULL) {
+			cb(fte->key, value, arg);
+			free(value);
 		}
 	}
+	for (; fe != NULL; fe = RB_NEXT(format_entry_tree, &ft->tree, fe))
+		format_each1(ft, fe, cb, arg);
 }
 
 /* Add a key-value pair. */
@@ -1455,17 +3388,18 @@ format_pretty_time(time_t t)
 
 /* Find a format entry. */
 static char *
-format_find(struct format_tree *ft, const char *key, int modifiers,
+format_find1(struct format_tree *ft, const char *key, int modifiers,
     const char *time_format)
 {
-	struct format_entry	*fe, fe_find;
-	struct environ_entry	*envent;
-	struct options_entry	*o;
-	int			 idx;
-	char			*found = NULL, *saved, s[512];
-	const char		*errstr;
-	time_t			 t = 0;
-	struct tm		 tm;
+	const struct format_table_entry	*fte;
+	struct format_entry		*fe, fe_find;
+	struct environ_entry		*envent;
+	struct options_entry		*o;
+	int				 idx;
+	char				*found = NULL, *saved, s[512];
+	const char			*errstr;
+	time_t				 t = 0;
+	struct tm			 tm;
 
 	o = options_parse_get(global_options, key, &idx, 0);
 	if (o == NULL && ft->wp != NULL)
@@ -1499,6 +3433,15 @@ format_find(struct format_tree *ft, const char *key, int modifiers,
 		goto found;
 	}
 
+	fte = format_table_get(key);
+	if (fte != NULL) {
+		if (format_table_client(key))
+			format_memo_client = 1;
+		found = fte->cb(ft);
+		if (found != NULL)
+			goto found;
+	}
+
 	if (~modifiers & FORMAT_TIMESTRING) {
 		envent = NULL;
 		if (ft->s != NULL)
@@ -1565,6 +3508,18 @@ found:
 	return (found);
 }
 
+/* Find a format entry and record it if recording. */
+static char *
+format_find(struct format_tree *ft, const char *key, int modifiers,
+    const char *time_format)
+{
+	char	*found;
+
+	found = format_find1(ft, key, modifiers, time_format);
+	format_add_dep(ft, FORMAT_DEP_FIND, key, modifiers, time_format, found);
+	return (found);
+}
+
 /* Remove escaped characters from string. */
 static char *
 format_strip(const char *s)
@@ -1685,12 +3640,11 @@ format_free_modifiers(struct format_modifier *list, u_int count)
 
 /* Build modifier list. */
 static struct format_modifier *
-format_build_modifiers(struct format_expand_state *es, const char **s,
-    u_int *count)
+format_build_modifiers(const char **s, u_int *count)
 {
 	const char		*cp = *s, *end;
 	struct format_modifier	*list = NULL;
-	char			 c, last[] = "X;:", **argv, *value;
+	char			 c, last[] = "X;:", **argv;
 	int			 argc;
 
 	/*
@@ -1753,9 +3707,7 @@ format_build_modifiers(struct format_expand_state *es, const char **s,
 				break;
 
 			argv = xcalloc(1, sizeof *argv);
-			value = xstrndup(cp + 1, end - (cp + 1));
-			argv[0] = format_expand1(es, value);
-			free(value);
+			argv[0] = xstrndup(cp + 1, end - (cp + 1));
 			argc = 1;
 
 			format_add_modifier(&list, count, &c, 1, argv, argc);
@@ -1777,9 +3729,7 @@ format_build_modifiers(struct format_expand_state *es, const char **s,
 			cp++;
 
 			argv = xreallocarray (argv, argc + 1, sizeof *argv);
-			value = xstrndup(cp, end - cp);
-			argv[argc++] = format_expand1(es, value);
-			free(value);
+			argv[argc++] = xstrndup(cp, end - cp);
 
 			cp = end;
 		} while (!format_is_end(cp[0]));
@@ -1794,6 +3744,33 @@ format_build_modifiers(struct format_expand_state *es, const char **s,
 	return (list);
 }
 
+/* Expand the arguments of a modifier list. */
+static struct format_modifier *
+format_expand_modifiers(struct format_expand_state *es,
+    const struct format_modifier *from, u_int count)
+{
+	struct format_modifier	*list;
+	u_int			 i;
+	int			 j;
+
+	if (count == 0)
+		return (NULL);
+	list = xcalloc(count, sizeof *list);
+	for (i = 0; i < count; i++) {
+		memcpy(list[i].modifier, from[i].modifier,
+		    sizeof list[i].modifier);
+		list[i].size = from[i].size;
+
+		list[i].argc = from[i].argc;
+		if (from[i].argv == NULL)
+			continue;
+		list[i].argv = xcalloc(from[i].argc, sizeof *list[i].argv);
+		for (j = 0; j < from[i].argc; j++)
+			list[i].argv[j] = format_expand1(es, from[i].argv[j]);
+	}
+	return (list);
+}
+
 /* Match against an fnmatch(3) pattern or regular expression. */
 static char *
 format_match(struct format_modifier *fm, const char *pattern, const char *text)
@@ -1870,13 +3847,15 @@ format_loop_sessions(struct format_expand_state *es, const char *fmt)
 	size_t				 valuelen;
 	struct session			*s;
 
+	format_add_loop_dep(ft, "S");
+
 	value = xcalloc(1, 1);
 	valuelen = 1;
 
 	RB_FOREACH(s, sessions, &sessions) {
 		format_log(es, "session loop: $%u", s->id);
 		nft = format_create(c, item, FORMAT_NONE, ft->flags);
-		format_defaults(next.ft, ft->c, s, NULL, NULL);
+		format_defaults(nft, ft->c, s, NULL, NULL);
 		format_copy_state(&next, es, 0);
 		next.ft = nft;
 		expanded = format_expand1(&next, fmt);
@@ -1906,6 +3885,7 @@ format_loop_windows(struct format_expand_state *es, const char *fmt)
 	struct winlink			*wl;
 	struct window			*w;
 
+	format_add_loop_dep(ft, "W");
 	if (ft->s == NULL) {
 		format_log(es, "window loop but no session");
 		return (NULL);
@@ -1959,6 +3939,7 @@ format_loop_panes(struct format_expand_state *es, const char *fmt)
 	size_t				 valuelen;
 	struct window_pane		*wp;
 
+	format_add_loop_dep(ft, "P");
 	if (ft->w == NULL) {
 		format_log(es, "pane loop but no window");
 		return (NULL);
@@ -2142,14 +4123,14 @@ fail:
 
 /* Replace a key. */
 static int
-format_replace(struct format_expand_state *es, const char *key, size_t keylen,
+format_replace(struct format_expand_state *es, const struct format_op *op,
     char **buf, size_t *len, size_t *off)
 {
 	struct format_tree		 *ft = es->ft;
 	struct window_pane		 *wp = ft->wp;
 	const char			 *errptr, *copy, *cp, *marker = NULL;
-	const char			 *time_format = NULL;
-	char				 *copy0, *condition, *found, *new;
+	const char			 *time_format = NULL, *copy0 = op->key;
+	char				 *condition, *found, *new;
 	char				 *value, *left, *right;
 	size_t				  valuelen;
 	int				  modifiers = 0, limit = 0, width = 0;
@@ -2159,11 +4140,10 @@ format_replace(struct format_expand_state *es, const char *key, size_t keylen,
 	u_int				  i, count, nsub = 0;
 	struct format_expand_state	  next;
 
-	/* Make a copy of the key. */
-	copy = copy0 = xstrndup(key, keylen);
-
-	/* Process modifier list. */
-	list = format_build_modifiers(es, &copy, &count);
+	/* Expand the modifier arguments and process the list. */
+	copy = op->copy;
+	count = op->count;
+	list = format_expand_modifiers(es, op->list, count);
 	for (i = 0; i < count; i++) {
 		fm = &list[i];
 		if (format_logging(ft)) {
@@ -2292,6 +4272,7 @@ format_replace(struct format_expand_state *es, const char *key, size_t keylen,
 			goto fail;
 	} else if (search != NULL) {
 		/* Search in pane. */
+		format_add_dep(ft, FORMAT_DEP_ALWAYS, "C", 0, NULL, NULL);
 		new = format_expand1(es, copy);
 		if (wp == NULL) {
 			format_log(es, "search '%s' but no pane", new);
@@ -2514,7 +4495,6 @@ done:
 
 	free(sub);
 	format_free_modifiers(list, count);
-	free(copy0);
 	return (0);
 
 fail:
@@ -2522,61 +4502,92 @@ fail:
 
 	free(sub);
 	format_free_modifiers(list, count);
-	free(copy0);
 	return (-1);
 }
 
-/* Expand keys in a template. */
-static char *
-format_expand1(struct format_expand_state *es, const char *fmt)
+/* Add text to a compiled format, joining it to the last operation if possible. */
+static void
+format_compile_text(struct format_compiled *fc, const char *text, size_t n)
 {
-	struct format_tree	*ft = es->ft;
-	char			*buf, *out, *name;
-	const char		*ptr, *s;
-	size_t			 off, len, n, outlen;
-	int     		 ch, brackets;
-	struct tm		*tm;
-	char			 expanded[8192];
-
-	if (fmt == NULL || *fmt == '\0')
-		return (xstrdup(""));
-
-	if (es->loop == FORMAT_LOOP_LIMIT)
-		return (xstrdup(""));
-	es->loop++;
-
-	format_log(es, "expanding format: %s", fmt);
+	struct format_op	*op;
+
+	fc->text = xrealloc(fc->text, fc->textlen + n);
+	memcpy(fc->text + fc->textlen, text, n);
+
+	op = (fc->nops == 0) ? NULL : &fc->ops[fc->nops - 1];
+	if (op == NULL || op->type != FORMAT_OP_TEXT) {
+		fc->ops = xreallocarray(fc->ops, fc->nops + 1, sizeof *fc->ops);
+		op = &fc->ops[fc->nops++];
+		memset(op, 0, sizeof *op);
+		op->type = FORMAT_OP_TEXT;
+		op->offset = fc->textlen;
+	}
+	op->size += n;
+	fc->textlen += n;
+}
 
-	if (es->flags & FORMAT_EXPAND_TIME) {
-		if (es->time == 0)
-			es->time = time(NULL);
-		tm = localtime(&es->time);
-		if (strftime(expanded, sizeof expanded, fmt, tm) == 0) {
-			format_log(es, "format is too long");
-			return (xstrdup(""));
+/* Add an operation to a compiled format. */
+static struct format_op *
+format_compile_op(struct format_compiled *fc, enum format_op_type type,
+    const char *key, size_t n)
+{
+	struct format_op	*op;
+	const char		*copy;
+
+	fc->ops = xreallocarray(fc->ops, fc->nops + 1, sizeof *fc->ops);
+	op = &fc->ops[fc->nops++];
+	memset(op, 0, sizeof *op);
+	op->type = type;
+
+	if (key != NULL) {
+		op->key = xstrndup(key, n);
+		if (type == FORMAT_OP_REPLACE) {
+			copy = op->key;
+			op->list = format_build_modifiers(&copy, &op->count);
+			op->copy = copy;
 		}
-		if (format_logging(ft) && strcmp(expanded, fmt) != 0)
-			format_log(es, "after time expanded: %s", expanded);
-		fmt = expanded;
 	}
+	return (op);
+}
 
-	len = 64;
-	buf = xmalloc(len);
-	off = 0;
+/*
+ * Split a template into text, jobs and keys to replace. This is done once for
+ * each template and the result cached, so expanding the same template again
+ * only needs to work out the values.
+ */
+static struct format_compiled *
+format_compile(const char *fmt)
+{
+	struct format_compiled	*fc, find;
+	const char		*ptr, *s;
+	size_t			 n;
+	int			 ch, brackets;
+	char			 c;
+
+	find.fmt = (char *)fmt;
+	fc = RB_FIND(format_compiled_tree, &format_compiled, &find);
+	if (fc != NULL)
+		return (fc);
+
+	fc = xcalloc(1, sizeof *fc);
+	fc->fmt = xstrdup(fmt);
+	RB_INSERT(format_compiled_tree, &format_compiled, fc);
+	format_compiled_count++;
 
 	while (*fmt != '\0') {
 		if (*fmt != '#') {
-			while (len - off < 2) {
-				buf = xreallocarray(buf, 2, len);
-				len *= 2;
-			}
-			buf[off++] = *fmt++;
+			n = strcspn(fmt, "#");
+			format_compile_text(fc, fmt, n);
+			fmt += n;
 			continue;
 		}
 		fmt++;
 
 		ch = (u_char)*fmt++;
 		switch (ch) {
+		case '\0':
+			format_compile_text(fc, "#", 1);
+			break;
 		case '(':
 			brackets = 1;
 			for (ptr = fmt; *ptr != '\0'; ptr++) {
@@ -2589,29 +4600,7 @@ format_expand1(struct format_expand_state *es, const char *fmt)
 				break;
 			n = ptr - fmt;
 
-			name = xstrndup(fmt, n);
-			format_log(es, "found #(): %s", name);
-
-			if ((ft->flags & FORMAT_NOJOBS) ||
-			    (es->flags & FORMAT_EXPAND_NOJOBS)) {
-				out = xstrdup("");
-				format_log(es, "#() is disabled");
-			} else {
-				out = format_job_get(es, name);
-				format_log(es, "#() result: %s", out);
-			}
-			free(name);
-
-			outlen = strlen(out);
-			while (len - off < outlen + 1) {
-				buf = xreallocarray(buf, 2, len);
-				len *= 2;
-			}
-			memcpy(buf + off, out, outlen);
-			off += outlen;
-
-			free(out);
-
+			format_compile_op(fc, FORMAT_OP_JOB, fmt, n);
 			fmt += n + 1;
 			continue;
 		case '{':
@@ -2620,9 +4609,7 @@ format_expand1(struct format_expand_state *es, const char *fmt)
 				break;
 			n = ptr - fmt;
 
-			format_log(es, "found #{}: %.*s", (int)n, fmt);
-			if (format_replace(es, fmt, n, &buf, &len, &off) != 0)
-				break;
+			format_compile_op(fc, FORMAT_OP_REPLACE, fmt, n);
 			fmt += n + 1;
 			continue;
 		case '#':
@@ -2637,25 +4624,15 @@ format_expand1(struct format_expand_state *es, const char *fmt)
 				n++;
 			}
 			if (*ptr == '[') {
-				format_log(es, "found #*%zu[", n);
-				while (len - off < n + 2) {
-					buf = xreallocarray(buf, 2, len);
-					len *= 2;
-				}
-				memcpy(buf + off, fmt - 2, n + 1);
-				off += n + 1;
+				format_compile_text(fc, fmt - 2, n + 1);
 				fmt = ptr + 1;
 				continue;
 			}
 			/* FALLTHROUGH */
 		case '}':
 		case ',':
-			format_log(es, "found #%c", ch);
-			while (len - off < 2) {
-				buf = xreallocarray(buf, 2, len);
-				len *= 2;
-			}
-			buf[off++] = ch;
+			c = ch;
+			format_compile_text(fc, &c, 1);
 			continue;
 		default:
 			s = NULL;
@@ -2664,24 +4641,263 @@ format_expand1(struct format_expand_state *es, const char *fmt)
 			else if (ch >= 'a' && ch <= 'z')
 				s = format_lower[ch - 'a'];
 			if (s == NULL) {
-				while (len - off < 3) {
-					buf = xreallocarray(buf, 2, len);
-					len *= 2;
-				}
-				buf[off++] = '#';
-				buf[off++] = ch;
+				format_compile_text(fc, fmt - 2, 2);
 				continue;
 			}
-			n = strlen(s);
-			format_log(es, "found #%c: %s", ch, s);
-			if (format_replace(es, s, n, &buf, &len, &off) != 0)
-				break;
+			format_compile_op(fc, FORMAT_OP_REPLACE, s, strlen(s));
 			continue;
 		}
 
+		/* Anything after a syntax error is ignored. */
 		break;
 	}
+	return (fc);
+}
+
+/* Free a compiled format. */
+static void
+format_free_compiled(struct format_compiled *fc)
+{
+	u_int	i;
+
+	for (i = 0; i < fc->nops; i++) {
+		free(fc->ops[i].key);
+		format_free_modifiers(fc->ops[i].list, fc->ops[i].count);
+	}
+	free(fc->ops);
+	free(fc->text);
+	free(fc->fmt);
+	free(fc);
+}
+
+/*
+ * Throw away the compiled formats if there are too many. Templates are
+ * compiled as they are used and not freed when an option changes, so this
+ * stops them building up. Must not be done while a format is being expanded.
+ */
+static void
+format_tidy_compiled(void)
+{
+	struct format_compiled	*fc, *fc1;
+
+	if (format_compiled_count < FORMAT_COMPILED_LIMIT)
+		return;
+	log_debug("%s: %u compiled formats", __func__, format_compiled_count);
+
+	RB_FOREACH_SAFE(fc, format_compiled_tree, &format_compiled, fc1) {
+		RB_REMOVE(format_compiled_tree, &format_compiled, fc);
+		format_free_compiled(fc);
+	}
+	format_compiled_count = 0;
+}
+
+/* Start keeping shared expanded formats. */
+void
+format_memo_start(void)
+{
+	format_memo_active = 1;
+}
+
+/* Stop keeping shared expanded formats and free them. */
+void
+format_memo_stop(void)
+{
+	struct format_memo	*fm, *fm1;
+
+	RB_FOREACH_SAFE(fm, format_memo_tree, &format_memos, fm1) {
+		RB_REMOVE(format_memo_tree, &format_memos, fm);
+		format_free_deps(&fm->deps);
+		free(fm->value);
+		free(fm->fmt);
+		free(fm);
+	}
+	format_memo_active = 0;
+}
+
+/* Fill in a memo key from the expand state. */
+static int
+format_memo_key(struct format_expand_state *es, const char *fmt,
+    struct format_memo *fm)
+{
+	struct format_tree	*ft = es->ft;
+
+	if (!format_memo_active || (~ft->flags & FORMAT_STATUS))
+		return (0);
+	if (ft->item != NULL || ft->pb != NULL)
+		return (0);
+
+	fm->fmt = (char *)fmt;
+	fm->flags = ft->flags;
+	fm->expand_flags = es->flags;
+	fm->loop = es->loop;
+	fm->s = ft->s;
+	fm->wl = ft->wl;
+	fm->w = ft->w;
+	fm->wp = ft->wp;
+	fm->recorded = (format_deps != NULL);
+	return (1);
+}
+
+/* Find a shared expanded format. */
+static char *
+format_memo_find(struct format_expand_state *es, const char *fmt)
+{
+	struct format_memo	 fm_find, *fm;
+
+	if (!format_memo_key(es, fmt, &fm_find))
+		return (NULL);
+	fm = RB_FIND(format_memo_tree, &format_memos, &fm_find);
+	if (fm == NULL)
+		return (NULL);
+	if (format_deps != NULL)
+		format_copy_deps(format_deps, &fm->deps, 0);
+	return (xstrdup(fm->value));
+}
+
+/*
+ * Keep an expanded format if it does not depend on the client, with the values
+ * recorded from the given one onwards.
+ */
+static void
+format_memo_add(struct format_expand_state *es, const char *fmt,
+    const char *value, u_int start)
+{
+	struct format_memo	 fm_find, *fm;
+
+	if (format_memo_client || !format_memo_key(es, fmt, &fm_find))
+		return;
+
+	fm = xmalloc(sizeof *fm);
+	memcpy(fm, &fm_find, sizeof *fm);
+	fm->fmt = xstrdup(fmt);
+	fm->value = xstrdup(value);
+	fm->deps.list = NULL;
+	fm->deps.count = 0;
+	if (format_deps != NULL)
+		format_copy_deps(&fm->deps, format_deps, start);
+	if (RB_INSERT(format_memo_tree, &format_memos, fm) != NULL) {
+		format_free_deps(&fm->deps);
+		free(fm->value);
+		free(fm->fmt);
+		free(fm);
+	}
+}
+
+/* Expand one operation of a compiled template onto the end of a buffer. */
+static int
+format_expand_op(struct format_expand_state *es, struct format_compiled *fc,
+    struct format_op *op, char **buf, size_t *len, size_t *off)
+{
+	struct format_tree	*ft = es->ft;
+	char			*out;
+	size_t			 outlen;
+
+	switch (op->type) {
+	case FORMAT_OP_TEXT:
+		while (*len - *off < op->size + 1) {
+			*buf = xreallocarray(*buf, 2, *len);
+			*len *= 2;
+		}
+		memcpy(*buf + *off, fc->text + op->offset, op->size);
+		*off += op->size;
+		return (0);
+	case FORMAT_OP_JOB:
+		format_log(es, "found #(): %s", op->key);
+		if ((ft->flags & FORMAT_NOJOBS) ||
+		    (es->flags & FORMAT_EXPAND_NOJOBS)) {
+			out = xstrdup("");
+			format_log(es, "#() is disabled");
+		} else {
+			out = format_job_get(es, op->key);
+			format_log(es, "#() result: %s", out);
+			format_memo_client = 1;
+		}
+
+		outlen = strlen(out);
+		while (*len - *off < outlen + 1) {
+			*buf = xreallocarray(*buf, 2, *len);
+			*len *= 2;
+		}
+		memcpy(*buf + *off, out, outlen);
+		*off += outlen;
+
+		free(out);
+		return (0);
+	case FORMAT_OP_REPLACE:
+		format_log(es, "found #{}: %s", op->key);
+		return (format_replace(es, op, buf, len, off));
+	}
+	return (-1);
+}
+
+/* Expand keys in a template. */
+static char *
+format_expand1(struct format_expand_state *es, const char *fmt)
+{
+	struct format_tree	*ft = es->ft;
+	struct format_compiled	*fc;
+	char			*buf;
+	size_t			 off, len;
+	u_int			 i, start;
+	int			 client;
+	struct tm		*tm;
+	char			 expanded[8192];
+
+	if (fmt == NULL || *fmt == '\0')
+		return (xstrdup(""));
+
+	if (es->loop == FORMAT_LOOP_LIMIT)
+		return (xstrdup(""));
+	es->loop++;
+
+	format_log(es, "expanding format: %s", fmt);
+
+	if (es->flags & FORMAT_EXPAND_TIME) {
+		if (es->time == 0)
+			es->time = time(NULL);
+		tm = localtime(&es->time);
+		if (strftime(expanded, sizeof expanded, fmt, tm) == 0) {
+			format_log(es, "format is too long");
+			format_add_dep(ft, FORMAT_DEP_ALWAYS, fmt, 0, NULL,
+			    NULL);
+			return (xstrdup(""));
+		}
+		if (format_logging(ft) && strcmp(expanded, fmt) != 0)
+			format_log(es, "after time expanded: %s", expanded);
+		if (strchr(fmt, '%') != NULL) {
+			format_add_dep(ft, FORMAT_DEP_TIME, fmt, 0, NULL,
+			    expanded);
+		}
+		fmt = expanded;
+	}
+
+	start = (format_deps == NULL ? 0 : format_deps->count);
+	if ((buf = format_memo_find(es, fmt)) != NULL) {
+		format_log(es, "shared result is: %s", buf);
+		es->loop--;
+		return (buf);
+	}
+	client = format_memo_client;
+	format_memo_client = 0;
+
+	if (format_compiled_depth == 0)
+		format_tidy_compiled();
+	fc = format_compile(fmt);
+	format_compiled_depth++;
+
+	len = 64;
+	buf = xmalloc(len);
+	off = 0;
+
+	for (i = 0; i < fc->nops; i++) {
+		if (format_expand_op(es, fc, &fc->ops[i], &buf, &len, &off) != 0)
+			break;
+	}
 	buf[off] = '\0';
+	format_compiled_depth--;
+
+	format_memo_add(es, fmt, buf, start);
+	format_memo_client |= client;
 
 	format_log(es, "result is: %s", buf);
 	es->loop--;
@@ -2701,6 +4917,230 @@ format_expand_time(struct format_tree *ft, const char *fmt)
 	return (format_expand1(&es, fmt));
 }
 
+/* Make a tree again from a recorded context. */
+static struct format_tree *
+format_context_tree(struct client *c, struct format_context *fx)
+{
+	struct session		*s = NULL;
+	struct winlink		*wl = NULL;
+	struct window_pane	*wp = NULL;
+	struct format_tree	*ft;
+
+	if (fx->defaults & FORMAT_DEFAULTS_SESSION) {
+		s = session_find_by_id(fx->s);
+		if (s == NULL)
+			return (NULL);
+	}
+	if (fx->defaults & FORMAT_DEFAULTS_WINLINK) {
+		if (s != NULL)
+			wl = winlink_find_by_index(&s->windows, fx->wl);
+		else if (c != NULL && c->session != NULL)
+			wl = winlink_find_by_index(&c->session->windows, fx->wl);
+		if (wl == NULL || wl->window->id != fx->w)
+			return (NULL);
+	}
+	if (fx->defaults & FORMAT_DEFAULTS_PANE) {
+		wp = window_pane_find_by_id(fx->wp);
+		if (wp == NULL)
+			return (NULL);
+	}
+
+	ft = format_create(c, NULL, fx->tag, fx->flags);
+	format_defaults(ft, c, s, wl, wp);
+	return (ft);
+}
+
+/* Check if the values used by a cached part of a format are the same. */
+static int
+format_deps_valid(struct client *c, struct format_deps *deps, time_t t)
+{
+	struct format_dep		*fd;
+	struct format_context		*fx = NULL;
+	struct format_tree		*ft = NULL;
+	struct format_expand_state	 es;
+	struct tm			*tm;
+	char				*value, expanded[8192];
+	u_int				 i;
+	int				 valid = 1;
+
+	for (i = 0; valid && i < deps->count; i++) {
+		fd = &deps->list[i];
+
+		if (fd->type == FORMAT_DEP_ALWAYS)
+			return (0);
+		if (fd->type == FORMAT_DEP_TIME) {
+			tm = localtime(&t);
+			if (strftime(expanded, sizeof expanded, fd->key, tm) == 0)
+				valid = 0;
+			else
+				valid = (strcmp(expanded, fd->value) == 0);
+			continue;
+		}
+
+		if (fx == NULL || memcmp(fx, &fd->context, sizeof *fx) != 0) {
+			if (ft != NULL)
+				format_free(ft);
+			fx = &fd->context;
+			if ((ft = format_context_tree(c, fx)) == NULL)
+				return (0);
+		}
+
+		switch (fd->type) {
+		case FORMAT_DEP_FIND:
+			value = format_find1(ft, fd->key, fd->modifiers,
+			    fd->time_format);
+			break;
+		case FORMAT_DEP_JOB:
+			memset(&es, 0, sizeof es);
+			es.ft = ft;
+			es.time = t;
+			es.flags = fd->modifiers;
+			value = format_job_get(&es, fd->key);
+			break;
+		case FORMAT_DEP_LOOP:
+			value = format_loop_list(ft, *fd->key);
+			break;
+		default:
+			value = NULL;
+			break;
+		}
+		valid = (format_dep_strcmp(value, fd->value) == 0);
+		free(value);
+	}
+	if (ft != NULL)
+		format_free(ft);
+	return (valid);
+}
+
+/* Free a cached expanded format. */
+void
+format_free_cache(struct format_cache *cache)
+{
+	struct format_cache_part	*part;
+	u_int				 i;
+
+	if (cache == NULL)
+		return;
+	for (i = 0; i < cache->nparts; i++) {
+		part = &cache->parts[i];
+		free(part->key);
+		free(part->value);
+		format_free_deps(&part->deps);
+	}
+	free(cache->parts);
+	free(cache);
+}
+
+/*
+ * Expand a template passing through strftime first, keeping each part (each
+ * #{}, #() and piece of text) with the values it used. The next time the same
+ * template is expanded with the cache, only the parts where one of those values
+ * is different are expanded again.
+ */
+char *
+format_expand_cached(struct format_tree *ft, const char *fmt,
+    struct format_cache **cachep)
+{
+	struct format_cache		*cache = *cachep, *new;
+	struct format_cache_part	*part, *old;
+	struct format_compiled		*fc;
+	struct format_op		*op;
+	struct format_expand_state	 es;
+	struct tm			*tm;
+	char				*buf, *value, expanded[8192];
+	size_t				 off, len, valuelen, vlen, voff;
+	u_int				 i;
+
+	if (fmt == NULL || *fmt == '\0')
+		return (xstrdup(""));
+
+	memset(&es, 0, sizeof es);
+	es.ft = ft;
+	es.flags = FORMAT_EXPAND_TIME;
+	es.time = time(NULL);
+	es.loop = 1;
+
+	tm = localtime(&es.time);
+	if (strftime(expanded, sizeof expanded, fmt, tm) == 0)
+		return (xstrdup(""));
+
+	if (format_compiled_depth == 0)
+		format_tidy_compiled();
+	fc = format_compile(expanded);
+	format_compiled_depth++;
+
+	new = xcalloc(1, sizeof *new);
+	if (fc->nops != 0)
+		new->parts = xcalloc(fc->nops, sizeof *new->parts);
+
+	len = 64;
+	buf = xmalloc(len);
+	off = 0;
+
+	for (i = 0; i < fc->nops; i++) {
+		op = &fc->ops[i];
+		part = &new->parts[new->nparts++];
+		part->type = op->type;
+		if (op->type == FORMAT_OP_TEXT)
+			part->key = xstrndup(fc->text + op->offset, op->size);
+		else
+			part->key = xstrdup(op->key);
+
+		old = NULL;
+		if (cache != NULL && i < cache->nparts) {
+			old = &cache->parts[i];
+			if (old->type != part->type ||
+			    strcmp(old->key, part->key) != 0)
+				old = NULL;
+		}
+
+		if (op->type != FORMAT_OP_TEXT &&
+		    old != NULL &&
+		    old->value != NULL &&
+		    (~ft->flags & FORMAT_FORCE) &&
+		    format_deps_valid(ft->client, &old->deps, es.time)) {
+			format_log(&es, "part %u unchanged: %s", i, part->key);
+			part->value = old->value;
+			old->value = NULL;
+			part->failed = old->failed;
+			memcpy(&part->deps, &old->deps, sizeof part->deps);
+			old->deps.list = NULL;
+			old->deps.count = 0;
+		} else {
+			vlen = 64;
+			value = xmalloc(vlen);
+			voff = 0;
+
+			format_deps = &part->deps;
+			if (format_expand_op(&es, fc, op, &value, &vlen,
+			    &voff) != 0)
+				part->failed = 1;
+			format_deps = NULL;
+
+			value[voff] = '\0';
+			part->value = value;
+		}
+		if (part->failed)
+			break;
+
+		valuelen = strlen(part->value);
+		while (len - off < valuelen + 1) {
+			buf = xreallocarray(buf, 2, len);
+			len *= 2;
+		}
+		memcpy(buf + off, part->value, valuelen);
+		off += valuelen;
+	}
+	buf[off] = '\0';
+	format_compiled_depth--;
+
+	format_free_cache(cache);
+	*cachep = new;
+
+	format_log(&es, "result is: %s", buf);
+	return (buf);
+}
+
 /* Expand keys in a template. */
 char *
 format_expand(struct format_tree *ft, const char *fmt)
@@ -2807,6 +5247,14 @@ format_defaults(struct format_tree *ft, struct client *c, struct session *s,
 	format_add(ft, "window_format", "%d", wl != NULL);
 	format_add(ft, "pane_format", "%d", wp != NULL);
 
+	ft->defaults = FORMAT_DEFAULTS_DONE;
+	if (s != NULL)
+		ft->defaults |= FORMAT_DEFAULTS_SESSION;
+	if (wl != NULL)
+		ft->defaults |= FORMAT_DEFAULTS_WINLINK;
+	if (wp != NULL)
+		ft->defaults |= FORMAT_DEFAULTS_PANE;
+
 	if (s == NULL && c != NULL)
 		s = c->session;
 	if (wl == NULL && s != NULL)
@@ -2832,106 +5280,16 @@ format_defaults(struct format_tree *ft, struct client *c, struct session *s,
 static void
 format_defaults_session(struct format_tree *ft, struct session *s)
 {
-	struct session_group	*sg;
-
 	ft->s = s;
-
-	format_add(ft, "session_name", "%s", s->name);
-	format_add(ft, "session_path", "%s", s->cwd);
-	format_add(ft, "session_windows", "%u", winlink_count(&s->windows));
-	format_add(ft, "session_id", "$%u", s->id);
-
-	sg = session_group_contains(s);
-	format_add(ft, "session_grouped", "%d", sg != NULL);
-	if (sg != NULL) {
-		format_add(ft, "session_group", "%s", sg->name);
-		format_add(ft, "session_group_size", "%u",
-		    session_group_count (sg));
-		format_add(ft, "session_group_attached", "%u",
-		    session_group_attached_count (sg));
-		format_add(ft, "session_group_many_attached", "%u",
-		    session_group_attached_count (sg) > 1);
-		format_add_cb(ft, "session_group_list",
-		    format_cb_session_group_list);
-		format_add_cb(ft, "session_group_attached_list",
-		    format_cb_session_group_attached_list);
-	}
-
-	format_add_tv(ft, "session_created", &s->creation_time);
-	format_add_tv(ft, "session_last_attached", &s->last_attached_time);
-	format_add_tv(ft, "session_activity", &s->activity_time);
-
-	format_add(ft, "session_attached", "%u", s->attached);
-	format_add(ft, "session_many_attached", "%d", s->attached > 1);
-	format_add_cb(ft, "session_attached_list",
-	    format_cb_session_attached_list);
-
-	format_add_cb(ft, "session_alerts", format_cb_session_alerts);
-	format_add_cb(ft, "session_stack", format_cb_session_stack);
-
-	if (server_check_marked() && marked_pane.s == s)
-	    format_add(ft, "session_marked", "1");
-	else
-	    format_add(ft, "session_marked", "0");
 }
 
 /* Set default format keys for a client. */
 static void
 format_defaults_client(struct format_tree *ft, struct client *c)
 {
-	struct session	*s;
-	const char	*name;
-	struct tty	*tty = &c->tty;
-
 	if (ft->s == NULL)
 		ft->s = c->session;
 	ft->c = c;
-
-	format_add(ft, "client_name", "%s", c->name);
-	format_add(ft, "client_pid", "%ld", (long) c->pid);
-	format_add(ft, "client_height", "%u", tty->sy);
-	format_add(ft, "client_width", "%u", tty->sx);
-	format_add(ft, "client_cell_width", "%u", tty->xpixel);
-	format_add(ft, "client_cell_height", "%u", tty->ypixel);
-	format_add(ft, "client_tty", "%s", c->ttyname);
-	format_add(ft, "client_control_mode", "%d",
-		!!(c->flags & CLIENT_CONTROL));
-
-	format_add(ft, "client_termname", "%s", c->term_name);
-	format_add(ft, "client_termfeatures", "%s",
-	    tty_get_features(c->term_features));
-	if (c->term_type != NULL)
-		format_add(ft, "client_termtype", "%s", c->term_type);
-
-	format_add_tv(ft, "client_created", &c->creation_time);
-	format_add_tv(ft, "client_activity", &c->activity_time);
-
-	format_add(ft, "client_written", "%zu", c->written);
-	format_add(ft, "client_discarded", "%zu", c->discarded);
-
-	name = server_client_get_key_table(c);
-	if (strcmp(c->keytable->name, name) == 0)
-		format_add(ft, "client_prefix", "%d", 0);
-	else
-		format_add(ft, "client_prefix", "%d", 1);
-	format_add(ft, "client_key_table", "%s", c->keytable->name);
-
-	if (c->flags & CLIENT_UTF8)
-		format_add(ft, "client_utf8", "%d", 1);
-	else
-		format_add(ft, "client_utf8", "%d", 0);
-	if (c->flags & CLIENT_READONLY)
-		format_add(ft, "client_readonly", "%d", 1);
-	else
-		format_add(ft, "client_readonly", "%d", 0);
-	format_add(ft, "client_flags", "%s", server_client_get_flags(c));
-
-	s = c->session;
-	if (s != NULL)
-		format_add(ft, "client_session", "%s", s->name);
-	s = c->last_session;
-	if (s != NULL && session_alive(s))
-		format_add(ft, "client_last_session", "%s", s->name);
 }
 
 /* Set default format keys for a window. */
@@ -2939,221 +5297,35 @@ void
 format_defaults_window(struct format_tree *ft, struct window *w)
 {
 	ft->w = w;
-
-	format_add_tv(ft, "window_activity", &w->activity_time);
-	format_add(ft, "window_id", "@%u", w->id);
-	format_add(ft, "window_name", "%s", w->name);
-	format_add(ft, "window_width", "%u", w->sx);
-	format_add(ft, "window_height", "%u", w->sy);
-	format_add(ft, "window_cell_width", "%u", w->xpixel);
-	format_add(ft, "window_cell_height", "%u", w->ypixel);
-	format_add_cb(ft, "window_layout", format_cb_window_layout);
-	format_add_cb(ft, "window_visible_layout",
-	    format_cb_window_visible_layout);
-	format_add(ft, "window_panes", "%u", window_count_panes(w));
-	format_add(ft, "window_zoomed_flag", "%d",
-	    !!(w->flags & WINDOW_ZOOMED));
 }
 
 /* Set default format keys for a winlink. */
 static void
 format_defaults_winlink(struct format_tree *ft, struct winlink *wl)
 {
-	struct client	*c = ft->c;
-	struct session	*s = wl->session;
-	struct window	*w = wl->window;
-	int		 flag;
-	u_int		 ox, oy, sx, sy;
-
 	if (ft->w == NULL)
-		format_defaults_window(ft, w);
+		format_defaults_window(ft, wl->window);
 	ft->wl = wl;
-
-	if (c != NULL) {
-		flag = tty_window_offset(&c->tty, &ox, &oy, &sx, &sy);
-		format_add(ft, "window_bigger", "%d", flag);
-		if (flag) {
-			format_add(ft, "window_offset_x", "%u", ox);
-			format_add(ft, "window_offset_y", "%u", oy);
-		}
-	}
-
-	format_add(ft, "window_index", "%d", wl->idx);
-	format_add_cb(ft, "window_stack_index", format_cb_window_stack_index);
-	format_add(ft, "window_flags", "%s", window_printable_flags(wl));
-	format_add(ft, "window_active", "%d", wl == s->curw);
-	format_add_cb(ft, "window_active_sessions",
-	    format_cb_window_active_sessions);
-	format_add_cb(ft, "window_active_sessions_list",
-	    format_cb_window_active_sessions_list);
-	format_add_cb(ft, "window_active_clients",
-	    format_cb_window_active_clients);
-	format_add_cb(ft, "window_active_clients_list",
-	    format_cb_window_active_clients_list);
-
-	format_add(ft, "window_start_flag", "%d",
-	    !!(wl == RB_MIN(winlinks, &s->windows)));
-	format_add(ft, "window_end_flag", "%d",
-	    !!(wl == RB_MAX(winlinks, &s->windows)));
-
-	if (server_check_marked() && marked_pane.wl == wl)
-	    format_add(ft, "window_marked_flag", "1");
-	else
-	    format_add(ft, "window_marked_flag", "0");
-
-	format_add(ft, "window_bell_flag", "%d",
-	    !!(wl->flags & WINLINK_BELL));
-	format_add(ft, "window_activity_flag", "%d",
-	    !!(wl->flags & WINLINK_ACTIVITY));
-	format_add(ft, "window_silence_flag", "%d",
-	    !!(wl->flags & WINLINK_SILENCE));
-	format_add(ft, "window_last_flag", "%d",
-	    !!(wl == TAILQ_FIRST(&s->lastw)));
-	format_add(ft, "window_linked", "%d", session_is_linked(s, wl->window));
-
-	format_add_cb(ft, "window_linked_sessions_list",
-	    format_cb_window_linked_sessions_list);
-	format_add(ft, "window_linked_sessions", "%u",
-	    wl->window->references);
 }
 
 /* Set default format keys for a window pane. */
 void
 format_defaults_pane(struct format_tree *ft, struct window_pane *wp)
 {
-	struct window			*w = wp->window;
-	struct grid			*gd = wp->base.grid;
-	int  				 status = wp->status;
-	u_int				 idx;
 	struct window_mode_entry	*wme;
 
 	if (ft->w == NULL)
-		format_defaults_window(ft, w);
+		format_defaults_window(ft, wp->window);
 	ft->wp = wp;
 
-	format_add(ft, "history_size", "%u", gd->hsize);
-	format_add(ft, "history_limit", "%u", gd->hlimit);
-	format_add_cb(ft, "history_bytes", format_cb_history_bytes);
-	format_add_cb(ft, "history_all_bytes", format_cb_history_all_bytes);
-
-	format_add(ft, "pane_written", "%zu", wp->written);
-	format_add(ft, "pane_skipped", "%zu", wp->skipped);
-
-	if (window_pane_index(wp, &idx) != 0)
-		fatalx("index not found");
-	format_add(ft, "pane_index", "%u", idx);
-
-	format_add(ft, "pane_width", "%u", wp->sx);
-	format_add(ft, "pane_height", "%u", wp->sy);
-	format_add(ft, "pane_title", "%s", wp->base.title);
-	if (wp->base.path != NULL)
-	    format_add(ft, "pane_path", "%s", wp->base.path);
-	format_add(ft, "pane_id", "%%%u", wp->id);
-	format_add(ft, "pane_active", "%d", wp == w->active);
-	format_add(ft, "pane_input_off", "%d", !!(wp->flags & PANE_INPUTOFF));
-	format_add(ft, "pane_pipe", "%d", wp->pipe_fd != -1);
-
-	if ((wp->flags & PANE_STATUSREADY) && WIFEXITED(status))
-		format_add(ft, "pane_dead_status", "%d", WEXITSTATUS(status));
-	if (~wp->flags & PANE_EMPTY)
-		format_add(ft, "pane_dead", "%d", wp->fd == -1);
-	else
-		format_add(ft, "pane_dead", "0");
-	format_add(ft, "pane_last", "%d", wp == w->last);
-
-	if (server_check_marked() && marked_pane.wp == wp)
-		format_add(ft, "pane_marked", "1");
-	else
-		format_add(ft, "pane_marked", "0");
-	format_add(ft, "pane_marked_set", "%d", server_check_marked());
-
-	format_add(ft, "pane_left", "%u", wp->xoff);
-	format_add(ft, "pane_top", "%u", wp->yoff);
-	format_add(ft, "pane_right", "%u", wp->xoff + wp->sx - 1);
-	format_add(ft, "pane_bottom", "%u", wp->yoff + wp->sy - 1);
-	format_add(ft, "pane_at_left", "%d", wp->xoff == 0);
-	format_add_cb(ft, "pane_at_top", format_cb_pane_at_top);
-	format_add(ft, "pane_at_right", "%d", wp->xoff + wp->sx == w->sx);
-	format_add_cb(ft, "pane_at_bottom", format_cb_pane_at_bottom);
-
 	wme = TAILQ_FIRST(&wp->modes);
-	if (wme != NULL) {
-		format_add(ft, "pane_mode", "%s", wme->mode->name);
-		if (wme->mode->formats != NULL)
-			wme->mode->formats(wme, ft);
-	}
-	format_add_cb(ft, "pane_in_mode", format_cb_pane_in_mode);
-
-	format_add(ft, "pane_synchronized", "%d",
-	    !!options_get_number(w->options, "synchronize-panes"));
-	if (wp->searchstr != NULL)
-		format_add(ft, "pane_search_string", "%s", wp->searchstr);
-
-	format_add(ft, "pane_tty", "%s", wp->tty);
-	format_add(ft, "pane_pid", "%ld", (long) wp->pid);
-	format_add_cb(ft, "pane_start_command", format_cb_start_command);
-	format_add_cb(ft, "pane_current_command", format_cb_current_command);
-	format_add_cb(ft, "pane_current_path", format_cb_current_path);
-
-	format_add(ft, "cursor_x", "%u", wp->base.cx);
-	format_add(ft, "cursor_y", "%u", wp->base.cy);
-	format_add_cb(ft, "cursor_character", format_cb_cursor_character);
-
-	format_add(ft, "scroll_region_upper", "%u", wp->base.rupper);
-	format_add(ft, "scroll_region_lower", "%u", wp->base.rlower);
-
-	format_add(ft, "alternate_on", "%d", wp->base.saved_grid != NULL);
-	if (wp->base.saved_cx != UINT_MAX)
-		format_add(ft, "alternate_saved_x", "%u", wp->base.saved_cx);
-	if (wp->base.saved_cy != UINT_MAX)
-		format_add(ft, "alternate_saved_y", "%u", wp->base.saved_cy);
-
-	format_add(ft, "cursor_flag", "%d",
-	    !!(wp->base.mode & MODE_CURSOR));
-	format_add(ft, "insert_flag", "%d",
-	    !!(wp->base.mode & MODE_INSERT));
-	format_add(ft, "keypad_cursor_flag", "%d",
-	    !!(wp->base.mode & MODE_KCURSOR));
-	format_add(ft, "keypad_flag", "%d",
-	    !!(wp->base.mode & MODE_KKEYPAD));
-	format_add(ft, "wrap_flag", "%d",
-	    !!(wp->base.mode & MODE_WRAP));
-	format_add(ft, "origin_flag", "%d",
-	    !!(wp->base.mode & MODE_ORIGIN));
-
-	format_add(ft, "mouse_any_flag", "%d",
-	    !!(wp->base.mode & ALL_MOUSE_MODES));
-	format_add(ft, "mouse_standard_flag", "%d",
-	    !!(wp->base.mode & MODE_MOUSE_STANDARD));
-	format_add(ft, "mouse_button_flag", "%d",
-	    !!(wp->base.mode & MODE_MOUSE_BUTTON));
-	format_add(ft, "mouse_all_flag", "%d",
-	    !!(wp->base.mode & MODE_MOUSE_ALL));
-	format_add(ft, "mouse_utf8_flag", "%d",
-	    !!(wp->base.mode & MODE_MOUSE_UTF8));
-	format_add(ft, "mouse_sgr_flag", "%d",
-	    !!(wp->base.mode & MODE_MOUSE_SGR));
-
-	format_add_cb(ft, "pane_tabs", format_cb_pane_tabs);
+	if (wme != NULL && wme->mode->formats != NULL)
+		wme->mode->formats(wme, ft);
 }
 
 /* Set default format keys for paste buffer. */
 void
 format_defaults_paste_buffer(struct format_tree *ft, struct paste_buffer *pb)
 {
-	struct timeval	 tv;
-	size_t		 size;
-	char		*s;
-
-	timerclear(&tv);
-	tv.tv_sec = paste_buffer_created(pb);
-	paste_buffer_data(pb, &size);
-
-	format_add(ft, "buffer_size", "%zu", size);
-	format_add(ft, "buffer_name", "%s", paste_buffer_name(pb));
-	format_add_tv(ft, "buffer_created", &tv);
-
-	s = paste_make_sample(pb);
-	format_add(ft, "buffer_sample", "%s", s);
-	free(s);
+	ft->pb = pb;
 }
@@ -0,0 +1,235 @@
+/*
+ * Copyright (c) 2026 shivanshu3
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF MIND, USE, DATA OR PROFITS, WHETHER
+ * IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING
+ * OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <sys/types.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "tmux.h"
+
+/*
+ * Benchmark for the input parser, screen writing and grid code. This uses the
+ * same setup as input-fuzzer.c (a window pane with no client attached) and
+ * replays each file given on the command line through input_parse_buffer, in
+ * pieces the size of a typical read from the pty. The files are recordings of
+ * terminal output, for example from script(1) or from the scripts in tools/:
+ *
+ *	$ sh tools/24-bit-color.sh >24-bit-color.out
+ *	$ fuzz/input-bench 24-bit-color.out tools/UTF-8-demo.txt
+ *
+ * For each file the rate in MB of input and in cells written per second is
+ * reported. With -c, each piece is also escaped as it would be for a control
+ * client's %output notification, and the rate of that is reported alongside,
+ * so the extra cost of a control client can be compared with the parsing done
+ * for every client.
+ */
+
+#define BENCH_READ_SIZE 4096
+
+struct event_base *libevent;
+
+static __dead void
+usage(void)
+{
+	fprintf(stderr, "usage: input-bench [-c] [-b size] [-n iterations] "
+	    "[-x width] [-y height] file ...\n");
+	exit(1);
+}
+
+static u_int
+bench_number(const char *s, u_int min, u_int max)
+{
+	const char	*errstr;
+	u_int		 n;
+
+	n = strtonum(s, min, max, &errstr);
+	if (errstr != NULL)
+		errx(1, "%s is %s", s, errstr);
+	return (n);
+}
+
+static u_char *
+bench_read(const char *path, size_t *size)
+{
+	FILE	*f;
+	u_char	*buf = NULL;
+	size_t	 used = 0, n;
+
+	if ((f = fopen(path, "rb")) == NULL)
+		err(1, "%s", path);
+	do {
+		buf = xrealloc(buf, used + BENCH_READ_SIZE);
+		n = fread(buf + used, 1, BENCH_READ_SIZE, f);
+		used += n;
+	} while (n != 0);
+	if (ferror(f))
+		err(1, "%s", path);
+	fclose(f);
+
+	*size = used;
+	return (buf);
+}
+
+static double
+bench_time(void)
+{
+	struct timespec	ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (ts.tv_sec + ts.tv_nsec / 1000000000.0);
+}
+
+static void
+bench_file(const char *path, u_int sx, u_int sy, u_int iterations,
+    size_t chunk, int control)
+{
+	struct bufferevent	*vpty[2];
+	struct evbuffer		*evb = NULL;
+	struct window		*w;
+	struct window_pane	*wp;
+	u_char			*buf;
+	size_t			 size, off, n, cells, escaped = 0;
+	u_int			 i;
+	double			 start, elapsed, control_elapsed;
+
+	buf = bench_read(path, &size);
+	if (size == 0) {
+		printf("%s: empty\n", path);
+		free(buf);
+		return;
+	}
+
+	w = window_create(sx, sy, 0, 0);
+	wp = window_add_pane(w, NULL, 0, 0);
+	bufferevent_pair_new(libevent, BEV_OPT_CLOSE_ON_FREE, vpty);
+	wp->ictx = input_init(wp, vpty[0]);
+	window_add_ref(w, __func__);
+	if (control && (evb = evbuffer_new()) == NULL)
+		errx(1, "evbuffer_new failed");
+
+	elapsed = control_elapsed = 0;
+	for (i = 0; i < iterations; i++) {
+		start = bench_time();
+		for (off = 0; off < size; off += n) {
+			n = size - off;
+			if (n > chunk)
+				n = chunk;
+			input_parse_buffer(wp, buf + off, n);
+		}
+		elapsed += bench_time() - start;
+
+		if (control) {
+			start = bench_time();
+			for (off = 0; off < size; off += n) {
+				n = size - off;
+				if (n > chunk)
+					n = chunk;
+				control_escape(evb, buf + off, n);
+				escaped += EVBUFFER_LENGTH(evb);
+				evbuffer_drain(evb, EVBUFFER_LENGTH(evb));
+			}
+			control_elapsed += bench_time() - start;
+		}
+
+		/* Discard any replies to the pane. */
+		while (cmdq_next(NULL) != 0)
+			;
+		if (event_base_loop(libevent, EVLOOP_NONBLOCK) == -1)
+			errx(1, "event_base_loop failed");
+		evbuffer_drain(bufferevent_get_input(vpty[1]),
+		    EVBUFFER_LENGTH(bufferevent_get_input(vpty[1])));
+	}
+	cells = wp->written + wp->skipped;
+
+	printf("%s: %zu bytes x %u in %.3f s: %.2f MB/s, %.2f Mcells/s\n",
+	    path, size, iterations, elapsed,
+	    (double)size * iterations / elapsed / 1000000,
+	    (double)cells / elapsed / 1000000);
+	if (control) {
+		printf("%s: control escaped to %zu bytes x %u in %.3f s: "
+		    "%.2f MB/s, %.1f%% of parsing\n", path, escaped / iterations,
+		    iterations, control_elapsed,
+		    (double)size * iterations / control_elapsed / 1000000,
+		    control_elapsed * 100 / elapsed);
+		evbuffer_free(evb);
+	}
+
+	window_remove_ref(w, __func__);
+	bufferevent_free(vpty[0]);
+	bufferevent_free(vpty[1]);
+	free(buf);
+}
+
+int
+main(int argc, char **argv)
+{
+	const struct options_table_entry	*oe;
+	u_int					 sx = 80, sy = 25;
+	u_int					 iterations = 10;
+	size_t					 chunk = BENCH_READ_SIZE;
+	int					 opt, control = 0;
+
+	while ((opt = getopt(argc, argv, "b:cn:x:y:")) != -1) {
+		switch (opt) {
+		case 'b':
+			chunk = bench_number(optarg, 1, INT_MAX);
+			break;
+		case 'c':
+			control = 1;
+			break;
+		case 'n':
+			iterations = bench_number(optarg, 1, INT_MAX);
+			break;
+		case 'x':
+			sx = bench_number(optarg, 1, WINDOW_MAXIMUM);
+			break;
+		case 'y':
+			sy = bench_number(optarg, 1, WINDOW_MAXIMUM);
+			break;
+		default:
+			usage();
+		}
+	}
+	argc -= optind;
+	argv += optind;
+	if (argc == 0)
+		usage();
+
+	global_environ = environ_create();
+	global_options = options_create(NULL);
+	global_s_options = options_create(NULL);
+	global_w_options = options_create(NULL);
+	for (oe = options_table; oe->name != NULL; oe++) {
+		if (oe->scope & OPTIONS_TABLE_SERVER)
+			options_default(global_options, oe);
+		if (oe->scope & OPTIONS_TABLE_SESSION)
+			options_default(global_s_options, oe);
+		if (oe->scope & OPTIONS_TABLE_WINDOW)
+			options_default(global_w_options, oe);
+	}
+	libevent = osdep_event_init();
+
+	options_set_number(global_w_options, "monitor-bell", 0);
+	options_set_number(global_w_options, "allow-rename", 1);
+
+	for (; argc > 0; argc--, argv++)
+		bench_file(*argv, sx, sy, iterations, chunk, control);
+	return (0);
+}
@@ -0,0 +1,367 @@
+/* $OpenBSD$ */
+
+/*
+ * Copyright (c) 2026 shivanshu3
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF MIND, USE, DATA OR PROFITS, WHETHER
+ * IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING
+ * OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <sys/types.h>
+
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+#include <regex.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tmux.h"
+
+/*
+ * Search the lines of a grid with a regular expression using several threads.
+ * The lines are split into blocks which each thread takes in turn, so the
+ * threads finish together and a search for the first or last matching line can
+ * stop once every block before or after a match is searched.
+ *
+ * The threads are a pool created the first time they are needed and kept
+ * until the server exits; each search is handed to them and the main thread
+ * searches as well, then waits for them to finish. The grid must not change
+ * while they are running, and nothing else in the server uses threads, so the
+ * main thread does nothing else until then. The pool is idle whenever the
+ * server forks. Each thread keeps its own compiled copy of the pattern since
+ * some regexec implementations lock the compiled pattern while in use.
+ */
+
+/* Lines in each block. */
+#define GRID_SEARCH_BLOCK 256
+
+/* Most threads to use. */
+#define GRID_SEARCH_MAX_THREADS 256
+
+/* A search. */
+struct grid_search {
+	struct grid	*gd;
+	const char	*pattern;
+	int		 cflags;
+	int		 mode;
+	u_int		 threads;
+
+	u_int		 start;
+	u_int		 end;
+	u_int		 nblocks;
+
+	u_int		 next;		/* next block */
+	int		 found;
+	u_int		 line;		/* first or last matching line */
+	u_int		 count;
+};
+
+/* State kept by each thread between searches. Thread 0 is the main thread. */
+struct grid_search_worker {
+	u_int				 idx;
+#ifdef HAVE_PTHREAD
+	pthread_t			 thread;
+	u_int				 generation;
+#endif
+
+	char				*pattern;
+	int				 cflags;
+	regex_t				 reg;
+
+	struct grid_search_buffer	 sb;
+};
+static struct grid_search_worker grid_search_workers[GRID_SEARCH_MAX_THREADS];
+
+#ifdef HAVE_PTHREAD
+/* Thread pool. */
+static pthread_mutex_t	 grid_search_lock_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t	 grid_search_start_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t	 grid_search_done_cond = PTHREAD_COND_INITIALIZER;
+static u_int		 grid_search_nthreads = 1;
+static struct grid_search *grid_search_current;
+static u_int		 grid_search_generation;
+static u_int		 grid_search_running;
+#endif
+
+static void
+grid_search_lock(void)
+{
+#ifdef HAVE_PTHREAD
+	pthread_mutex_lock(&grid_search_lock_mutex);
+#endif
+}
+
+static void
+grid_search_unlock(void)
+{
+#ifdef HAVE_PTHREAD
+	pthread_mutex_unlock(&grid_search_lock_mutex);
+#endif
+}
+
+/* Compile the pattern for a thread if it is not the same as last time. */
+static int
+grid_search_compile(struct grid_search_worker *gsw, struct grid_search *gs)
+{
+	if (gsw->pattern != NULL) {
+		if (gsw->cflags == gs->cflags &&
+		    strcmp(gsw->pattern, gs->pattern) == 0)
+			return (0);
+		regfree(&gsw->reg);
+		free(gsw->pattern);
+		gsw->pattern = NULL;
+	}
+	if (regcomp(&gsw->reg, gs->pattern, gs->cflags) != 0)
+		return (-1);
+	gsw->pattern = xstrdup(gs->pattern);
+	gsw->cflags = gs->cflags;
+	return (0);
+}
+
+/*
+ * Count the matches starting on a line, the same as the matches found by
+ * window_copy_search_lr_regex. If count is zero, stop after the first.
+ */
+static u_int
+grid_search_line(struct grid_search *gs, struct grid_search_worker *gsw,
+    u_int py, int count)
+{
+	struct grid_search_buffer	*sb = &gsw->sb;
+	regmatch_t			 regmatch;
+	size_t				 limit, off = 0;
+	u_int				 n = 0;
+
+	limit = grid_search_text(gs->gd, py, sb);
+	while (off < limit) {
+		if (regexec(&gsw->reg, sb->text + off, 1, &regmatch,
+		    off == 0 ? 0 : REG_NOTBOL) != 0)
+			break;
+		if (regmatch.rm_so == regmatch.rm_eo)
+			break;
+		if (off + regmatch.rm_so >= limit)
+			break;
+		n++;
+		if (!count)
+			break;
+		off += regmatch.rm_eo;
+	}
+	return (n);
+}
+
+/* Get the next block to search, or -1 if there are none left. */
+static int
+grid_search_next(struct grid_search *gs, u_int *first, u_int *last)
+{
+	u_int	block;
+
+	grid_search_lock();
+	if (gs->next == gs->nblocks) {
+		grid_search_unlock();
+		return (-1);
+	}
+	block = gs->next++;
+	if (gs->mode == GRID_SEARCH_LAST)
+		block = gs->nblocks - 1 - block;
+	*first = gs->start + block * GRID_SEARCH_BLOCK;
+	*last = *first + GRID_SEARCH_BLOCK;
+	if (*last > gs->end)
+		*last = gs->end;
+
+	/* Blocks are taken in order so if this is after a match, all are. */
+	if (gs->found) {
+		if ((gs->mode == GRID_SEARCH_FIRST && *first > gs->line) ||
+		    (gs->mode == GRID_SEARCH_LAST && *last <= gs->line)) {
+			gs->next = gs->nblocks;
+			grid_search_unlock();
+			return (-1);
+		}
+	}
+	grid_search_unlock();
+	return (0);
+}
+
+/* Record a matching line. */
+static void
+grid_search_found(struct grid_search *gs, u_int py)
+{
+	grid_search_lock();
+	if (!gs->found ||
+	    (gs->mode == GRID_SEARCH_FIRST && py < gs->line) ||
+	    (gs->mode == GRID_SEARCH_LAST && py > gs->line)) {
+		gs->found = 1;
+		gs->line = py;
+	}
+	grid_search_unlock();
+}
+
+/* Search blocks until there are none left. */
+static void
+grid_search_blocks(struct grid_search *gs, struct grid_search_worker *gsw)
+{
+	u_int	first, last, py, n = 0;
+
+	if (grid_search_compile(gsw, gs) != 0)
+		return;
+
+	while (grid_search_next(gs, &first, &last) == 0) {
+		switch (gs->mode) {
+		case GRID_SEARCH_FIRST:
+			for (py = first; py < last; py++) {
+				if (grid_search_line(gs, gsw, py, 0)) {
+					grid_search_found(gs, py);
+					break;
+				}
+			}
+			break;
+		case GRID_SEARCH_LAST:
+			for (py = last; py > first; py--) {
+				if (grid_search_line(gs, gsw, py - 1, 0)) {
+					grid_search_found(gs, py - 1);
+					break;
+				}
+			}
+			break;
+		case GRID_SEARCH_COUNT:
+			for (py = first; py < last; py++)
+				n += grid_search_line(gs, gsw, py, 1);
+			break;
+		}
+	}
+
+	grid_search_lock();
+	gs->count += n;
+	grid_search_unlock();
+}
+
+#ifdef HAVE_PTHREAD
+/* Thread in the pool: wait for each search and take part if it is wanted. */
+static void *
+grid_search_thread(void *arg)
+{
+	struct grid_search_worker	*gsw = arg;
+	struct grid_search		*gs;
+
+	pthread_mutex_lock(&grid_search_lock_mutex);
+	for (;;) {
+		while (grid_search_generation == gsw->generation) {
+			pthread_cond_wait(&grid_search_start_cond,
+			    &grid_search_lock_mutex);
+		}
+		gsw->generation = grid_search_generation;
+		gs = grid_search_current;
+		if (gs == NULL || gsw->idx >= gs->threads)
+			continue;
+
+		pthread_mutex_unlock(&grid_search_lock_mutex);
+		grid_search_blocks(gs, gsw);
+		pthread_mutex_lock(&grid_search_lock_mutex);
+
+		if (--grid_search_running == 0)
+			pthread_cond_signal(&grid_search_done_cond);
+	}
+	return (NULL);
+}
+
+/* Add threads to the pool until it has the given number, including this one. */
+static u_int
+grid_search_start_threads(u_int threads)
+{
+	struct grid_search_worker	*gsw;
+	sigset_t			 set, oldset;
+
+	if (threads <= grid_search_nthreads)
+		return (threads);
+
+	/* Signals are left to the main thread. */
+	sigfillset(&set);
+	pthread_sigmask(SIG_BLOCK, &set, &oldset);
+	while (grid_search_nthreads < threads) {
+		gsw = &grid_search_workers[grid_search_nthreads];
+		gsw->idx = grid_search_nthreads;
+		gsw->generation = grid_search_generation;
+		if (pthread_create(&gsw->thread, NULL, grid_search_thread,
+		    gsw) != 0)
+			break;
+		grid_search_nthreads++;
+	}
+	pthread_sigmask(SIG_SETMASK, &oldset, NULL);
+	log_debug("%s: %u threads", __func__, grid_search_nthreads);
+
+	if (threads > grid_search_nthreads)
+		return (grid_search_nthreads);
+	return (threads);
+}
+#endif
+
+/*
+ * Search lines start to end - 1 with up to the given number of threads. Return
+ * the number of matches for GRID_SEARCH_COUNT, otherwise 1 and set line to the
+ * first or last line with a match if one is found.
+ */
+u_int
+grid_search_regex(struct grid *gd, const char *pattern, int cflags,
+    u_int start, u_int end, int mode, u_int threads, u_int *line)
+{
+	struct grid_search	gs;
+
+	if (start >= end)
+		return (0);
+
+	memset(&gs, 0, sizeof gs);
+	gs.gd = gd;
+	gs.pattern = pattern;
+	gs.cflags = cflags;
+	gs.mode = mode;
+	gs.start = start;
+	gs.end = end;
+	gs.nblocks = (end - start + GRID_SEARCH_BLOCK - 1) / GRID_SEARCH_BLOCK;
+
+	if (threads > GRID_SEARCH_MAX_THREADS)
+		threads = GRID_SEARCH_MAX_THREADS;
+	if (threads > gs.nblocks)
+		threads = gs.nblocks;
+
+#ifdef HAVE_PTHREAD
+	if (threads > 1) {
+		gs.threads = grid_search_start_threads(threads);
+
+		pthread_mutex_lock(&grid_search_lock_mutex);
+		grid_search_current = &gs;
+		grid_search_running = gs.threads - 1;
+		grid_search_generation++;
+		pthread_cond_broadcast(&grid_search_start_cond);
+		pthread_mutex_unlock(&grid_search_lock_mutex);
+
+		grid_search_blocks(&gs, &grid_search_workers[0]);
+
+		pthread_mutex_lock(&grid_search_lock_mutex);
+		while (grid_search_running != 0) {
+			pthread_cond_wait(&grid_search_done_cond,
+			    &grid_search_lock_mutex);
+		}
+		grid_search_current = NULL;
+		pthread_mutex_unlock(&grid_search_lock_mutex);
+	} else
+		grid_search_blocks(&gs, &grid_search_workers[0]);
+#else
+	grid_search_blocks(&gs, &grid_search_workers[0]);
+#endif
+
+	if (mode == GRID_SEARCH_COUNT)
+		return (gs.count);
+	if (!gs.found)
+		return (0);
+	*line = gs.line;
+	return (1);
+}
@@ -18,6 +18,7 @@
 
 #include <sys/types.h>
 
+#include <ctype.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -33,7 +34,256 @@
  * (hsize - 1); from hsize to hsize + (sy - 1) is the viewable data. All
  * functions in this file work on absolute coordinates, grid-view.c has
  * functions which work on the screen data.
+ *
+ * If hcompress is set, history lines more than that many lines from the bottom
+ * of the history are packed: the cell data is compressed into a record in a
+ * shared block and the line is unpacked again when it is next needed. Only the
+ * line flags and sizes may be used without unpacking.
+ *
+ * Cell and extended cell data is allocated from a slab belonging to the grid:
+ * blocks are rounded up to one of a set of size classes and carved from larger
+ * arenas, and freed blocks are kept on a list in their arena to be reused. An
+ * arena is freed when none of its blocks are in use, unless it is the only
+ * arena of its class with free blocks. Growing a line within its size class
+ * does not need to move it.
+ *
+ * The chunks of lines may be shared with another grid using the same slab
+ * (grid_share_lines, used to take a copy of a pane's history for copy mode).
+ * A shared chunk is copied before any of its lines are changed or unpacked,
+ * so each grid only copies the lines it goes on to modify. Functions which
+ * only read a line use grid_read_line, which does not copy the chunk.
+ *
+ * If GRID_INDEX is set, each chunk may also have a search index, built when
+ * the last line of the chunk is moved into the history or when the chunk is
+ * first searched. The index is a set of bits, one for each sequence of three
+ * bytes of text in the chunk; if any sequence in the search text has its bit
+ * clear, the text cannot be in the chunk and its lines need not be searched.
+ * The index is discarded when any line in the chunk is changed.
+ *
+ * The text of lines which are searched or converted to strings is kept in the
+ * chunk (struct grid_text) until the line is changed, so it need not be built
+ * from the cells again. The total size of this text is limited and the text
+ * for the least recently used chunks is freed when the limit is reached.
+ */
+
+/* Slab size classes. Larger blocks are allocated directly. */
+static const size_t grid_slab_sizes[] = {
+	32, 48, 64, 96, 128, 192, 256, 384, 512, 768, 1024, 1536, 2048, 3072,
+	4096, 6144, 8192
+};
+#define GRID_SLAB_CLASSES nitems(grid_slab_sizes)
+
+/* Number of blocks in each arena. */
+#define GRID_SLAB_ARENA_BLOCKS 16
+
+/* Slab free block. */
+struct grid_slab_block {
+	struct grid_slab_block	*next;
+};
+
+/* Slab arena. */
+struct grid_slab_arena {
+	u_char			*data;
+	size_t			 size;
+	int			 idx;
+
+	u_int			 used;
+	u_int			 carved;
+	struct grid_slab_block	*free;
+
+	RB_ENTRY(grid_slab_arena) entry;
+	TAILQ_ENTRY(grid_slab_arena) class_entry;
+};
+RB_HEAD(grid_slab_arenas, grid_slab_arena);
+
+/* Slab size class. Contains arenas with free blocks. */
+TAILQ_HEAD(grid_slab_class, grid_slab_arena);
+
+/* Slab. */
+struct grid_slab {
+	u_int			 references;
+
+	struct grid_slab_class	 classes[GRID_SLAB_CLASSES];
+	struct grid_slab_arenas	 arenas;
+
+	size_t			 arena_bytes;
+	size_t			 used_bytes;
+	size_t			 large_bytes;
+	u_int			 blocks;
+};
+
+/* Packed line data. */
+struct grid_pack {
+	struct grid_pack_block	*block;
+	u_int			 size;
+	u_char			 data[];
+};
+
+/* Block of packed lines. */
+struct grid_pack_block {
+	u_int			 references;
+	int			 open;
+	size_t			 size;
+	size_t			 used;
+	u_char			 data[];
+};
+#define GRID_PACK_BLOCK_SIZE 65536
+
+/* Number of lines unpacked before history is checked again for packing. */
+#define GRID_PACK_UNPACKED_LIMIT 1000
+
+/*
+ * Lines are stored in chunks of a fixed number of lines. The chunks are kept
+ * in a ring so lines can be added at the bottom and removed from the top
+ * without moving the others.
+ */
+#define GRID_CHUNK_LINES 256
+
+/*
+ * Search index for a chunk. Sequences of three bytes which include a space are
+ * left out, so lines need not be padded to the width of the grid.
  */
+#define GRID_INDEX_BITS 65536
+struct grid_index {
+	u_int			 sx;
+	u_char			 bits[GRID_INDEX_BITS / 8];
+};
+
+/* Maximum total size of the text kept for lines. */
+#define GRID_TEXT_LIMIT (16 * 1024 * 1024)
+
+/* Chunk of lines. */
+struct grid_chunk {
+	u_int			 references;
+	struct grid_index	*index;
+
+	struct grid_text	**text;
+	size_t			  text_bytes;
+	TAILQ_ENTRY(grid_chunk)	  text_entry;
+
+	struct grid_line	 lines[GRID_CHUNK_LINES];
+};
+
+/* Chunks with text, least recently used first. */
+static TAILQ_HEAD(grid_text_chunks, grid_chunk) grid_text_chunks =
+    TAILQ_HEAD_INITIALIZER(grid_text_chunks);
+static size_t grid_text_bytes;
+
+static int	grid_check_y(struct grid *, const char *, u_int);
+static void	grid_unshare_chunk(struct grid *, u_int);
+static void	grid_free_text(struct grid_chunk *, u_int);
+static void	grid_free_chunk_text(struct grid_chunk *);
+
+/* Find the chunk holding a line and the line's offset in it. */
+static u_int
+grid_find_chunk(struct grid *gd, u_int py, u_int *offset)
+{
+	u_int	at = gd->chunkline + py;
+
+	*offset = at % GRID_CHUNK_LINES;
+	return ((gd->chunkfirst + at / GRID_CHUNK_LINES) & (gd->chunkslots - 1));
+}
+
+/* Check if a line is in a shared chunk. */
+static int
+grid_line_shared(struct grid *gd, u_int py)
+{
+	u_int	offset;
+
+	return (gd->chunks[grid_find_chunk(gd, py, &offset)]->references != 1);
+}
+
+/* Get line from chunks for reading, without unpacking it. */
+static const struct grid_line *
+grid_read_line(struct grid *gd, u_int py)
+{
+	u_int	chunk, offset;
+
+	chunk = grid_find_chunk(gd, py, &offset);
+	return (&gd->chunks[chunk]->lines[offset]);
+}
+
+/* Get the lines in the chunk holding a line. */
+static void
+grid_chunk_range(struct grid *gd, u_int py, u_int *first, u_int *last)
+{
+	u_int	offset;
+
+	grid_find_chunk(gd, py, &offset);
+	if (offset > py)
+		*first = 0;
+	else
+		*first = py - offset;
+	*last = py + (GRID_CHUNK_LINES - 1 - offset);
+	if (*last > gd->hsize + gd->sy - 1)
+		*last = gd->hsize + gd->sy - 1;
+}
+
+/*
+ * Get line from chunks, without unpacking it, for a change which does not
+ * alter the text of the line (such as packing it), so the index is kept.
+ */
+static struct grid_line *
+grid_chunk_line(struct grid *gd, u_int py)
+{
+	u_int	chunk, offset;
+
+	chunk = grid_find_chunk(gd, py, &offset);
+	if (gd->chunks[chunk]->references != 1)
+		grid_unshare_chunk(gd, chunk);
+	return (&gd->chunks[chunk]->lines[offset]);
+}
+
+/* Get line from chunks, without unpacking it. */
+static struct grid_line *
+grid_raw_line(struct grid *gd, u_int py)
+{
+	struct grid_chunk	*gc;
+	u_int			 chunk, offset;
+
+	chunk = grid_find_chunk(gd, py, &offset);
+	if (gd->chunks[chunk]->references != 1)
+		grid_unshare_chunk(gd, chunk);
+	gc = gd->chunks[chunk];
+	if (gc->index != NULL) {
+		free(gc->index);
+		gc->index = NULL;
+	}
+	if (gc->text != NULL && gc->text[offset] != NULL)
+		grid_free_text(gc, offset);
+	return (&gc->lines[offset]);
+}
+
+/* Release a chunk, freeing it if it is no longer used. */
+static void
+grid_release_chunk(struct grid_chunk *gc)
+{
+	if (--gc->references == 0) {
+		grid_free_chunk_text(gc);
+		free(gc->index);
+		free(gc);
+	}
+}
+
+/* Copy lines within the grid, the lines may overlap. */
+static void
+grid_copy_raw_lines(struct grid *gd, u_int dy, u_int py, u_int ny)
+{
+	struct grid_line	*gl;
+	u_int			 yy;
+
+	if (dy < py) {
+		for (yy = 0; yy < ny; yy++) {
+			gl = grid_raw_line(gd, dy + yy);
+			memcpy(gl, grid_raw_line(gd, py + yy), sizeof *gl);
+		}
+	} else if (dy > py) {
+		for (yy = ny; yy > 0; yy--) {
+			gl = grid_raw_line(gd, dy + yy - 1);
+			memcpy(gl, grid_raw_line(gd, py + yy - 1), sizeof *gl);
+		}
+	}
+}
 
 /* Default grid cell data. */
 const struct grid_cell grid_default_cell = {
@@ -56,6 +306,180 @@ static const struct grid_cell_entry grid_cleared_entry = {
 	GRID_FLAG_CLEARED, { .data = { 0, 8, 8, ' ' } }
 };
 
+/* Compare slab arenas. An arena matches any address inside it. */
+static int
+grid_slab_cmp(struct grid_slab_arena *gsa1, struct grid_slab_arena *gsa2)
+{
+	if (gsa1->data + gsa1->size <= gsa2->data)
+		return (-1);
+	if (gsa1->data >= gsa2->data + gsa2->size)
+		return (1);
+	return (0);
+}
+RB_GENERATE_STATIC(grid_slab_arenas, grid_slab_arena, entry, grid_slab_cmp);
+
+/* Create a slab. */
+static struct grid_slab *
+grid_slab_create(void)
+{
+	struct grid_slab	*gs;
+	u_int			 i;
+
+	gs = xcalloc(1, sizeof *gs);
+	gs->references = 1;
+	for (i = 0; i < GRID_SLAB_CLASSES; i++)
+		TAILQ_INIT(&gs->classes[i]);
+	RB_INIT(&gs->arenas);
+	return (gs);
+}
+
+/* Free a slab arena. */
+static void
+grid_slab_free_arena(struct grid_slab *gs, struct grid_slab_arena *gsa)
+{
+	RB_REMOVE(grid_slab_arenas, &gs->arenas, gsa);
+	if (gsa->used != GRID_SLAB_ARENA_BLOCKS)
+		TAILQ_REMOVE(&gs->classes[gsa->idx], gsa, class_entry);
+	gs->arena_bytes -= gsa->size;
+	free(gsa->data);
+	free(gsa);
+}
+
+/* Release a slab, freeing it if no longer used. */
+static void
+grid_slab_release(struct grid_slab *gs)
+{
+	struct grid_slab_arena	*gsa, *gsa1;
+
+	if (--gs->references != 0)
+		return;
+	RB_FOREACH_SAFE(gsa, grid_slab_arenas, &gs->arenas, gsa1)
+		grid_slab_free_arena(gs, gsa);
+	free(gs);
+}
+
+/* Find slab class for a size, or -1 if too big. */
+static int
+grid_slab_class(size_t size)
+{
+	u_int	i;
+
+	for (i = 0; i < GRID_SLAB_CLASSES; i++) {
+		if (size <= grid_slab_sizes[i])
+			return (i);
+	}
+	return (-1);
+}
+
+/* Allocate a block from a slab. */
+static void *
+grid_slab_alloc(struct grid_slab *gs, size_t size)
+{
+	struct grid_slab_class	*gsc;
+	struct grid_slab_arena	*gsa;
+	struct grid_slab_block	*gsb;
+	int			 idx;
+	void			*p;
+
+	if (size == 0)
+		return (NULL);
+	if ((idx = grid_slab_class(size)) == -1) {
+		gs->large_bytes += size;
+		return (xmalloc(size));
+	}
+	gsc = &gs->classes[idx];
+	size = grid_slab_sizes[idx];
+
+	if ((gsa = TAILQ_FIRST(gsc)) == NULL) {
+		gsa = xcalloc(1, sizeof *gsa);
+		gsa->size = size * GRID_SLAB_ARENA_BLOCKS;
+		gsa->data = xmalloc(gsa->size);
+		gsa->idx = idx;
+		RB_INSERT(grid_slab_arenas, &gs->arenas, gsa);
+		TAILQ_INSERT_HEAD(gsc, gsa, class_entry);
+		gs->arena_bytes += gsa->size;
+	}
+	if ((gsb = gsa->free) != NULL) {
+		gsa->free = gsb->next;
+		p = gsb;
+	} else
+		p = gsa->data + (gsa->carved++) * size;
+	if (++gsa->used == GRID_SLAB_ARENA_BLOCKS)
+		TAILQ_REMOVE(gsc, gsa, class_entry);
+
+	gs->used_bytes += size;
+	gs->blocks++;
+	return (p);
+}
+
+/* Return a block to a slab. */
+static void
+grid_slab_free(struct grid_slab *gs, void *p, size_t size)
+{
+	struct grid_slab_class	*gsc;
+	struct grid_slab_arena	*gsa, find;
+	struct grid_slab_block	*gsb = p;
+	int			 idx;
+
+	if (p == NULL || size == 0)
+		return;
+	if ((idx = grid_slab_class(size)) == -1) {
+		gs->large_bytes -= size;
+		free(p);
+		return;
+	}
+	gsc = &gs->classes[idx];
+
+	find.data = p;
+	find.size = 1;
+	gsa = RB_FIND(grid_slab_arenas, &gs->arenas, &find);
+	if (gsa == NULL || gsa->idx != idx)
+		fatalx("block not in slab");
+
+	gs->used_bytes -= grid_slab_sizes[idx];
+	gs->blocks--;
+
+	if (gsa->used-- == GRID_SLAB_ARENA_BLOCKS)
+		TAILQ_INSERT_HEAD(gsc, gsa, class_entry);
+	if (gsa->used == 0 &&
+	    (TAILQ_FIRST(gsc) != gsa || TAILQ_NEXT(gsa, class_entry) != NULL)) {
+		grid_slab_free_arena(gs, gsa);
+		return;
+	}
+	gsb->next = gsa->free;
+	gsa->free = gsb;
+}
+
+/* Change the size of a block, moving it only if the size class changes. */
+static void *
+grid_slab_realloc(struct grid_slab *gs, void *p, size_t oldsize,
+    size_t newsize)
+{
+	int	oldidx, newidx;
+	void	*new;
+
+	if (p == NULL || oldsize == 0)
+		return (grid_slab_alloc(gs, newsize));
+	if (newsize == 0) {
+		grid_slab_free(gs, p, oldsize);
+		return (NULL);
+	}
+
+	oldidx = grid_slab_class(oldsize);
+	newidx = grid_slab_class(newsize);
+	if (oldidx != -1 && oldidx == newidx)
+		return (p);
+	if (oldidx == -1 && newidx == -1) {
+		gs->large_bytes += newsize - oldsize;
+		return (xrealloc(p, newsize));
+	}
+
+	new = grid_slab_alloc(gs, newsize);
+	memcpy(new, p, oldsize < newsize ? oldsize : newsize);
+	grid_slab_free(gs, p, oldsize);
+	return (new);
+}
+
 /* Store cell in entry. */
 static void
 grid_store_cell(struct grid_cell_entry *gce, const struct grid_cell *gc,
@@ -95,12 +519,13 @@ grid_need_extended_cell(const struct grid_cell_entry *gce,
 
 /* Get an extended cell. */
 static void
-grid_get_extended_cell(struct grid_line *gl, struct grid_cell_entry *gce,
-    int flags)
+grid_get_extended_cell(struct grid *gd, struct grid_line *gl,
+    struct grid_cell_entry *gce, int flags)
 {
 	u_int at = gl->extdsize + 1;
 
-	gl->extddata = xreallocarray(gl->extddata, at, sizeof *gl->extddata);
+	gl->extddata = grid_slab_realloc(gd->slab, gl->extddata,
+	    gl->extdsize * sizeof *gl->extddata, at * sizeof *gl->extddata);
 	gl->extdsize = at;
 
 	gce->offset = at - 1;
@@ -109,15 +534,15 @@ grid_get_extended_cell(struct grid_line *gl, struct grid_cell_entry *gce,
 
 /* Set cell as extended. */
 static struct grid_extd_entry *
-grid_extended_cell(struct grid_line *gl, struct grid_cell_entry *gce,
-    const struct grid_cell *gc)
+grid_extended_cell(struct grid *gd, struct grid_line *gl,
+    struct grid_cell_entry *gce, const struct grid_cell *gc)
 {
 	struct grid_extd_entry	*gee;
 	int			 flags = (gc->flags & ~GRID_FLAG_CLEARED);
 	utf8_char		 uc;
 
 	if (~gce->flags & GRID_FLAG_EXTENDED)
-		grid_get_extended_cell(gl, gce, flags);
+		grid_get_extended_cell(gd, gl, gce, flags);
 	else if (gce->offset >= gl->extdsize)
 		fatalx("offset too big");
 	gl->flags |= GRID_LINE_EXTENDED;
@@ -136,7 +561,7 @@ grid_extended_cell(struct grid_line *gl, struct grid_cell_entry *gce,
 
 /* Free up unused extended cells. */
 static void
-grid_compact_line(struct grid_line *gl)
+grid_compact_line(struct grid *gd, struct grid_line *gl)
 {
 	int			 new_extdsize = 0;
 	struct grid_extd_entry	*new_extddata;
@@ -144,7 +569,7 @@ grid_compact_line(struct grid_line *gl)
 	struct grid_extd_entry	*gee;
 	u_int			 px, idx;
 
-	if (gl->extdsize == 0)
+	if (gl->extdsize == 0 || (gl->flags & GRID_LINE_PACKED))
 		return;
 
 	for (px = 0; px < gl->cellsize; px++) {
@@ -154,12 +579,14 @@ grid_compact_line(struct grid_line *gl)
 	}
 
 	if (new_extdsize == 0) {
-		free(gl->extddata);
+		grid_slab_free(gd->slab, gl->extddata,
+		    gl->extdsize * sizeof *gl->extddata);
 		gl->extddata = NULL;
 		gl->extdsize = 0;
 		return;
 	}
-	new_extddata = xreallocarray(NULL, new_extdsize, sizeof *gl->extddata);
+	new_extddata = grid_slab_alloc(gd->slab,
+	    new_extdsize * sizeof *gl->extddata);
 
 	idx = 0;
 	for (px = 0; px < gl->cellsize; px++) {
@@ -171,38 +598,896 @@ grid_compact_line(struct grid_line *gl)
 		}
 	}
 
-	free(gl->extddata);
+	grid_slab_free(gd->slab, gl->extddata,
+	    gl->extdsize * sizeof *gl->extddata);
 	gl->extddata = new_extddata;
 	gl->extdsize = new_extdsize;
 }
 
+/* Write a number in as few bytes as possible. */
+static u_char *
+grid_pack_number(u_char *cp, u_int n)
+{
+	while (n >= 0x80) {
+		*cp++ = (n & 0x7f)|0x80;
+		n >>= 7;
+	}
+	*cp++ = n;
+	return (cp);
+}
+
+/* Read a number written by grid_pack_number. */
+static const u_char *
+grid_unpack_number(const u_char *cp, u_int *n)
+{
+	u_int	shift = 0;
+
+	*n = 0;
+	do {
+		*n |= (u_int)(*cp & 0x7f) << shift;
+		shift += 7;
+	} while (*cp++ & 0x80);
+	return (cp);
+}
+
+/* Close a pack block, freeing it if it is no longer used. */
+static void
+grid_pack_close_block(struct grid_pack_block *gpb)
+{
+	gpb->open = 0;
+	if (gpb->references == 0)
+		free(gpb);
+}
+
+/* Allocate space for packed data in the grid's current block. */
+static struct grid_pack *
+grid_pack_alloc(struct grid *gd, u_int size)
+{
+	struct grid_pack_block	*gpb = gd->pack_block;
+	struct grid_pack	*gp;
+	size_t			 need, bsize;
+
+	need = sizeof *gp + size;
+	need = (need + 7) & ~(size_t)7;
+
+	if (gpb == NULL || gpb->used + need > gpb->size) {
+		if (gpb != NULL)
+			grid_pack_close_block(gpb);
+		bsize = GRID_PACK_BLOCK_SIZE;
+		if (need > bsize)
+			bsize = need;
+		gpb = xmalloc(sizeof *gpb + bsize);
+		gpb->references = 0;
+		gpb->open = 1;
+		gpb->size = bsize;
+		gpb->used = 0;
+		gd->pack_block = gpb;
+	}
+
+	gp = (struct grid_pack *)(gpb->data + gpb->used);
+	gpb->used += need;
+	gpb->references++;
+
+	gp->block = gpb;
+	gp->size = size;
+	return (gp);
+}
+
+/* Release packed data. */
+static void
+grid_pack_free(struct grid_pack *gp)
+{
+	struct grid_pack_block	*gpb = gp->block;
+
+	if (--gpb->references == 0 && !gpb->open)
+		free(gpb);
+}
+
+/*
+ * Pack a line. Cells are stored as runs with the same flags and attributes,
+ * followed by either one character (if they are all the same) or each
+ * character in turn, or the extended cell offsets. The extended cells are
+ * copied unchanged after the runs.
+ */
+static void
+grid_pack_line(struct grid *gd, struct grid_line *gl)
+{
+	static u_char		*buf;
+	static size_t		 bufsize;
+	struct grid_cell_entry	*gce, *first;
+	struct grid_pack	*gp;
+	u_char			*cp;
+	size_t			 size, original;
+	u_int			 px, n, i;
+	int			 same;
+
+	if ((gl->flags & (GRID_LINE_PACKED|GRID_LINE_DEAD)) || gl->cellsize == 0)
+		return;
+	grid_compact_line(gd, gl);
+
+	original = gl->cellsize * sizeof *gl->celldata;
+	original += gl->extdsize * sizeof *gl->extddata;
+	size = gl->cellsize * (sizeof *gl->celldata + 8) + original;
+	if (size > bufsize) {
+		buf = xrealloc(buf, size);
+		bufsize = size;
+	}
+
+	cp = buf;
+	for (px = 0; px < gl->cellsize; px += n) {
+		first = &gl->celldata[px];
+		for (n = 1; px + n < gl->cellsize; n++) {
+			gce = &gl->celldata[px + n];
+			if (gce->flags != first->flags)
+				break;
+			if (first->flags & GRID_FLAG_EXTENDED)
+				continue;
+			if (gce->data.attr != first->data.attr ||
+			    gce->data.fg != first->data.fg ||
+			    gce->data.bg != first->data.bg)
+				break;
+		}
+		cp = grid_pack_number(cp, n);
+		*cp++ = first->flags;
+
+		if (first->flags & GRID_FLAG_EXTENDED) {
+			for (i = 0; i < n; i++) {
+				memcpy(cp, &first[i].offset, sizeof first->offset);
+				cp += sizeof first->offset;
+			}
+			continue;
+		}
+		*cp++ = first->data.attr;
+		*cp++ = first->data.fg;
+		*cp++ = first->data.bg;
+
+		same = 1;
+		for (i = 1; i < n; i++) {
+			if (first[i].data.data != first->data.data) {
+				same = 0;
+				break;
+			}
+		}
+		*cp++ = same;
+		if (same)
+			*cp++ = first->data.data;
+		else {
+			for (i = 0; i < n; i++)
+				*cp++ = first[i].data.data;
+		}
+	}
+	if (gl->extdsize != 0) {
+		memcpy(cp, gl->extddata, gl->extdsize * sizeof *gl->extddata);
+		cp += gl->extdsize * sizeof *gl->extddata;
+	}
+
+	size = cp - buf;
+	if (size + sizeof *gp >= original)
+		return;
+
+	gp = grid_pack_alloc(gd, size);
+	memcpy(gp->data, buf, size);
+
+	grid_slab_free(gd->slab, gl->celldata,
+	    gl->cellsize * sizeof *gl->celldata);
+	grid_slab_free(gd->slab, gl->extddata,
+	    gl->extdsize * sizeof *gl->extddata);
+	gl->extddata = NULL;
+	gl->packed = gp;
+	gl->flags |= GRID_LINE_PACKED;
+}
+
+/*
+ * Unpack the cells of a packed line into celldata, which must have room for
+ * them all. Returns the packed extended cells.
+ */
+static const u_char *
+grid_unpack_cells(const struct grid_line *gl, struct grid_cell_entry *celldata)
+{
+	struct grid_cell_entry	*gce;
+	const u_char		*cp = gl->packed->data;
+	u_int			 px, n, i;
+	u_char			 flags, attr, fg, bg;
+
+	for (px = 0; px < gl->cellsize; px += n) {
+		cp = grid_unpack_number(cp, &n);
+		flags = *cp++;
+
+		gce = &celldata[px];
+		if (flags & GRID_FLAG_EXTENDED) {
+			for (i = 0; i < n; i++) {
+				gce[i].flags = flags;
+				memcpy(&gce[i].offset, cp, sizeof gce->offset);
+				cp += sizeof gce->offset;
+			}
+			continue;
+		}
+		attr = *cp++;
+		fg = *cp++;
+		bg = *cp++;
+		for (i = 0; i < n; i++) {
+			gce[i].flags = flags;
+			gce[i].data.attr = attr;
+			gce[i].data.fg = fg;
+			gce[i].data.bg = bg;
+		}
+		if (*cp++) {
+			for (i = 0; i < n; i++)
+				gce[i].data.data = *cp;
+			cp++;
+		} else {
+			for (i = 0; i < n; i++)
+				gce[i].data.data = *cp++;
+		}
+	}
+	return (cp);
+}
+
+/* Unpack a line. */
+static void
+grid_unpack_line(struct grid *gd, struct grid_line *gl)
+{
+	struct grid_pack	*gp = gl->packed;
+	struct grid_cell_entry	*celldata;
+	const u_char		*cp;
+
+	if (~gl->flags & GRID_LINE_PACKED)
+		return;
+
+	celldata = grid_slab_alloc(gd->slab, gl->cellsize * sizeof *celldata);
+	cp = grid_unpack_cells(gl, celldata);
+	if (gl->extdsize != 0) {
+		gl->extddata = grid_slab_alloc(gd->slab,
+		    gl->extdsize * sizeof *gl->extddata);
+		memcpy(gl->extddata, cp, gl->extdsize * sizeof *gl->extddata);
+	}
+
+	grid_pack_free(gp);
+	gl->celldata = celldata;
+	gl->flags &= ~GRID_LINE_PACKED;
+	gd->unpacked++;
+}
+
+/*
+ * Get the cells of a line to be read without unpacking it. Packed lines are
+ * unpacked into buffers which are reused by the next call.
+ */
+static void
+grid_line_cells(const struct grid_line *gl,
+    const struct grid_cell_entry **cells, const struct grid_extd_entry **extd)
+{
+	static struct grid_cell_entry	*celldata;
+	static u_int			 cellsize;
+	static struct grid_extd_entry	*extddata;
+	static u_int			 extdsize;
+	const u_char			*cp;
+
+	if (~gl->flags & GRID_LINE_PACKED) {
+		*cells = gl->celldata;
+		*extd = gl->extddata;
+		return;
+	}
+
+	if (gl->cellsize > cellsize) {
+		celldata = xreallocarray(celldata, gl->cellsize,
+		    sizeof *celldata);
+		cellsize = gl->cellsize;
+	}
+	if (gl->extdsize > extdsize) {
+		extddata = xreallocarray(extddata, gl->extdsize,
+		    sizeof *extddata);
+		extdsize = gl->extdsize;
+	}
+	cp = grid_unpack_cells(gl, celldata);
+	if (gl->extdsize != 0)
+		memcpy(extddata, cp, gl->extdsize * sizeof *extddata);
+	*cells = celldata;
+	*extd = extddata;
+}
+
+/*
+ * Check if a cell is padding. Extended cells keep their flags in the extended
+ * entry.
+ */
+static int
+grid_cell_is_padding(const struct grid_line *gl,
+    const struct grid_cell_entry *gce, const struct grid_extd_entry *extd)
+{
+	if (~gce->flags & GRID_FLAG_EXTENDED)
+		return (gce->flags & GRID_FLAG_PADDING);
+	if (gce->offset >= gl->extdsize)
+		return (0);
+	return (extd[gce->offset].flags & GRID_FLAG_PADDING);
+}
+
+/* Pack any history lines which are now old enough. */
+static void
+grid_pack_history(struct grid *gd)
+{
+	u_int	limit;
+
+	if (gd->hcompress == 0 || gd->hsize <= gd->hcompress)
+		return;
+	limit = gd->hsize - gd->hcompress;
+
+	/*
+	 * If a lot of lines have been unpacked since the history was last
+	 * checked, start again from the top.
+	 */
+	if (gd->unpacked > GRID_PACK_UNPACKED_LIMIT) {
+		gd->hpacked = 0;
+		gd->unpacked = 0;
+	}
+	for (; gd->hpacked < limit; gd->hpacked++)
+		grid_pack_line(gd, grid_chunk_line(gd, gd->hpacked));
+}
+
+/* Fold a byte of text for the index. */
+static u_char
+grid_index_fold(u_char c)
+{
+	if (c < 0x80)
+		return (tolower(c));
+	return (c);
+}
+
+/* Get the index bit for a sequence of three bytes. */
+static u_int
+grid_index_bit(u_int key)
+{
+	return (((key * 2654435761U) & 0xffffffffU) >> 16);
+}
+
+/* Add a byte of text to an index. */
+static void
+grid_index_add(struct grid_index *gi, u_char c, u_int *key, u_int *n)
+{
+	u_int	bit;
+
+	if (c == ' ') {
+		*n = 0;
+		return;
+	}
+	*key = ((*key << 8) | grid_index_fold(c)) & 0xffffff;
+	if (++*n >= 3) {
+		bit = grid_index_bit(*key);
+		gi->bits[bit / 8] |= (1 << (bit % 8));
+	}
+}
+
+/* Add the text of a line to an index. */
+static void
+grid_index_line(struct grid_index *gi, const struct grid_line *gl, u_int sx,
+    u_int *key, u_int *n)
+{
+	const struct grid_cell_entry	*gce, *cells;
+	const struct grid_extd_entry	*extd;
+	struct utf8_data		 ud;
+	u_int				 px, nx, i;
+
+	grid_line_cells(gl, &cells, &extd);
+
+	nx = gl->cellsize;
+	if (nx > sx)
+		nx = sx;
+	for (px = 0; px < nx; px++) {
+		gce = &cells[px];
+		if (grid_cell_is_padding(gl, gce, extd))
+			continue;
+		if (~gce->flags & GRID_FLAG_EXTENDED) {
+			grid_index_add(gi, gce->data.data, key, n);
+			continue;
+		}
+		if (gce->offset >= gl->extdsize) {
+			*n = 0;
+			continue;
+		}
+		utf8_to_data(extd[gce->offset].data, &ud);
+		for (i = 0; i < ud.size; i++)
+			grid_index_add(gi, ud.data[i], key, n);
+	}
+
+	/* The rest of the line is spaces. */
+	if (nx < sx)
+		*n = 0;
+}
+
+/* Build the index for the chunk holding a line. */
+static struct grid_index *
+grid_index_chunk(struct grid *gd, u_int py)
+{
+	struct grid_chunk	*gc;
+	struct grid_index	*gi;
+	const struct grid_line	*gl;
+	u_int			 offset, first, last, yy, key = 0, n = 0;
+
+	gc = gd->chunks[grid_find_chunk(gd, py, &offset)];
+	if (gc->index == NULL)
+		gc->index = xmalloc(sizeof *gc->index);
+	gi = gc->index;
+	gi->sx = gd->sx;
+	memset(gi->bits, 0, sizeof gi->bits);
+
+	grid_chunk_range(gd, py, &first, &last);
+	for (yy = first; yy <= last; yy++) {
+		gl = grid_read_line(gd, yy);
+		grid_index_line(gi, gl, gd->sx, &key, &n);
+		if (~gl->flags & GRID_LINE_WRAPPED)
+			n = 0;
+	}
+	return (gi);
+}
+
+/* Build the index for a chunk when its last line is moved into history. */
+static void
+grid_index_history(struct grid *gd)
+{
+	u_int	offset;
+
+	if (~gd->flags & GRID_INDEX)
+		return;
+	grid_find_chunk(gd, gd->hsize - 1, &offset);
+	if (offset == GRID_CHUNK_LINES - 1)
+		grid_index_chunk(gd, gd->hsize - 1);
+}
+
+/*
+ * Check if text could start on any line in the chunk holding py, using the
+ * index if there is one. The lines in the chunk are returned in first and
+ * last. Returns 0 if the text is not in those lines, otherwise 1.
+ */
+int
+grid_index_check(struct grid *gd, u_int py, const char *text, u_int *first,
+    u_int *last)
+{
+	struct grid_index	*gi;
+	const u_char		*cp;
+	u_int			 offset, key = 0, n = 0, bit;
+
+	grid_chunk_range(gd, py, first, last);
+	if ((~gd->flags & GRID_INDEX) || strlen(text) < 3)
+		return (1);
+
+	/* A match may go on into the next chunk if the last line is wrapped. */
+	if (*last != gd->hsize + gd->sy - 1 &&
+	    (grid_read_line(gd, *last)->flags & GRID_LINE_WRAPPED))
+		return (1);
+
+	gi = gd->chunks[grid_find_chunk(gd, py, &offset)]->index;
+	if (gi == NULL || gi->sx != gd->sx)
+		gi = grid_index_chunk(gd, py);
+
+	for (cp = text; *cp != '\0'; cp++) {
+		if (*cp == ' ') {
+			n = 0;
+			continue;
+		}
+		key = ((key << 8) | grid_index_fold(*cp)) & 0xffffff;
+		if (++n < 3)
+			continue;
+		bit = grid_index_bit(key);
+		if (~gi->bits[bit / 8] & (1 << (bit % 8)))
+			return (0);
+	}
+	return (1);
+}
+
+/* Get the number of bytes used by the text of a line. */
+static size_t
+grid_text_bytes_used(const struct grid_text *gt)
+{
+	size_t	size = sizeof *gt + gt->size + 1;
+
+	if (gt->offsets != NULL)
+		size += (gt->ncells + 1) * sizeof *gt->offsets;
+	return (size);
+}
+
+/* Free the text of a line. */
+static void
+grid_free_text(struct grid_chunk *gc, u_int offset)
+{
+	struct grid_text	*gt = gc->text[offset];
+	size_t			 size = grid_text_bytes_used(gt);
+
+	gc->text_bytes -= size;
+	grid_text_bytes -= size;
+	free(gt);
+	gc->text[offset] = NULL;
+}
+
+/* Free the text of all lines in a chunk. */
+static void
+grid_free_chunk_text(struct grid_chunk *gc)
+{
+	u_int	i;
+
+	if (gc->text == NULL)
+		return;
+	for (i = 0; i < GRID_CHUNK_LINES; i++)
+		free(gc->text[i]);
+	free(gc->text);
+	gc->text = NULL;
+
+	grid_text_bytes -= gc->text_bytes;
+	gc->text_bytes = 0;
+	TAILQ_REMOVE(&grid_text_chunks, gc, text_entry);
+}
+
+/*
+ * Build the text of a line. Offsets are only needed if any cell is not one
+ * byte.
+ */
+static struct grid_text *
+grid_make_text(const struct grid_line *gl)
+{
+	static char			*buf;
+	static size_t			 bufsize;
+	static u_int			*offsets;
+	static u_int			 noffsets;
+	const struct grid_cell_entry	*gce, *cells;
+	const struct grid_extd_entry	*extd;
+	struct grid_text		*gt;
+	struct utf8_data		 ud;
+	size_t				 size = 0, need;
+	u_int				 px;
+	int				 simple = 1;
+
+	grid_line_cells(gl, &cells, &extd);
+	if (gl->cellsize + 1 > noffsets) {
+		noffsets = gl->cellsize + 1;
+		offsets = xreallocarray(offsets, noffsets, sizeof *offsets);
+	}
+
+	for (px = 0; px < gl->cellsize; px++) {
+		offsets[px] = size;
+		gce = &cells[px];
+		if (grid_cell_is_padding(gl, gce, extd)) {
+			simple = 0;
+			continue;
+		}
+		if (~gce->flags & GRID_FLAG_EXTENDED)
+			utf8_set(&ud, gce->data.data);
+		else if (gce->offset >= gl->extdsize)
+			utf8_set(&ud, ' ');
+		else
+			utf8_to_data(extd[gce->offset].data, &ud);
+		if (ud.size != 1)
+			simple = 0;
+
+		if (size + ud.size > bufsize) {
+			bufsize = size + ud.size + 256;
+			buf = xrealloc(buf, bufsize);
+		}
+		memcpy(buf + size, ud.data, ud.size);
+		size += ud.size;
+	}
+	offsets[gl->cellsize] = size;
+
+	need = sizeof *gt + size + 1;
+	if (!simple)
+		need += (gl->cellsize + 1) * sizeof *gt->offsets;
+	gt = xmalloc(need);
+	gt->ncells = gl->cellsize;
+	gt->size = size;
+	if (simple) {
+		gt->offsets = NULL;
+		gt->text = (char *)(gt + 1);
+	} else {
+		gt->offsets = (u_int *)(gt + 1);
+		memcpy(gt->offsets, offsets,
+		    (gl->cellsize + 1) * sizeof *gt->offsets);
+		gt->text = (char *)(gt->offsets + gl->cellsize + 1);
+	}
+	memcpy(gt->text, buf, size);
+	gt->text[size] = '\0';
+	return (gt);
+}
+
+/*
+ * Get the text of a line, without any cells after the end of the line. This
+ * is valid until the line is changed or the text of another line is fetched.
+ */
+const struct grid_text *
+grid_get_text(struct grid *gd, u_int py)
+{
+	struct grid_chunk	*gc, *loop;
+	struct grid_text	*gt;
+	size_t			 size;
+	u_int			 offset;
+
+	if (grid_check_y(gd, __func__, py) != 0)
+		return (NULL);
+	gc = gd->chunks[grid_find_chunk(gd, py, &offset)];
+
+	if (gc->text == NULL) {
+		gc->text = xcalloc(GRID_CHUNK_LINES, sizeof *gc->text);
+		TAILQ_INSERT_TAIL(&grid_text_chunks, gc, text_entry);
+	} else if (gc != TAILQ_LAST(&grid_text_chunks, grid_text_chunks)) {
+		TAILQ_REMOVE(&grid_text_chunks, gc, text_entry);
+		TAILQ_INSERT_TAIL(&grid_text_chunks, gc, text_entry);
+	}
+	if ((gt = gc->text[offset]) != NULL)
+		return (gt);
+
+	gt = gc->text[offset] = grid_make_text(grid_read_line(gd, py));
+	size = grid_text_bytes_used(gt);
+	gc->text_bytes += size;
+	grid_text_bytes += size;
+
+	while (grid_text_bytes > GRID_TEXT_LIMIT) {
+		loop = TAILQ_FIRST(&grid_text_chunks);
+		if (loop == gc)
+			break;
+		grid_free_chunk_text(loop);
+	}
+	return (gt);
+}
+
+/* Append to a search buffer. */
+static void
+grid_search_append(struct grid_search_buffer *sb, const void *data,
+    size_t size)
+{
+	if (sb->len + size + 1 > sb->size) {
+		sb->size = sb->len + size + 1024;
+		sb->text = xrealloc(sb->text, sb->size);
+	}
+	memcpy(sb->text + sb->len, data, size);
+	sb->len += size;
+}
+
+/* Append the text of cells [0, sx) of a line to a search buffer. */
+static void
+grid_search_line_text(const struct grid_line *gl, u_int sx,
+    struct grid_search_buffer *sb)
+{
+	const struct grid_cell_entry	*gce, *cells = gl->celldata;
+	const u_char			*extd = (const u_char *)gl->extddata;
+	struct grid_extd_entry		 gee;
+	struct utf8_data		 ud;
+	u_int				 px, nx;
+
+	if (gl->flags & GRID_LINE_PACKED) {
+		if (gl->cellsize > sb->ncells) {
+			sb->cells = xreallocarray(sb->cells, gl->cellsize,
+			    sizeof *sb->cells);
+			sb->ncells = gl->cellsize;
+		}
+		extd = grid_unpack_cells(gl, sb->cells);
+		cells = sb->cells;
+	}
+
+	nx = gl->cellsize;
+	if (nx > sx)
+		nx = sx;
+	for (px = 0; px < nx; px++) {
+		gce = &cells[px];
+		if (~gce->flags & GRID_FLAG_EXTENDED) {
+			if (gce->flags & GRID_FLAG_PADDING)
+				continue;
+			utf8_set(&ud, gce->data.data);
+		} else if (gce->offset >= gl->extdsize)
+			utf8_set(&ud, ' ');
+		else {
+			memcpy(&gee, extd + gce->offset * sizeof gee, sizeof gee);
+			if (gee.flags & GRID_FLAG_PADDING)
+				continue;
+			utf8_to_data(gee.data, &ud);
+		}
+		grid_search_append(sb, ud.data, ud.size);
+	}
+	for (; px < sx; px++)
+		grid_search_append(sb, " ", 1);
+}
+
+/*
+ * Get the text of a line and any lines it wraps onto into a search buffer, as
+ * window_copy_stringify would, and return the size of the text of the first
+ * line. This neither changes the grid nor uses any static buffers, so it may
+ * be called from several threads at once while the grid is not being changed.
+ */
+size_t
+grid_search_text(struct grid *gd, u_int py, struct grid_search_buffer *sb)
+{
+	u_int	endline = gd->hsize + gd->sy - 1;
+	size_t	limit;
+
+	sb->len = 0;
+	grid_search_line_text(grid_read_line(gd, py), gd->sx, sb);
+	limit = sb->len;
+	while (py < endline && (grid_read_line(gd, py)->flags &
+	    GRID_LINE_WRAPPED)) {
+		py++;
+		grid_search_line_text(grid_read_line(gd, py), gd->sx, sb);
+	}
+	grid_search_append(sb, "", 0);
+	sb->text[sb->len] = '\0';
+	return (limit);
+}
+
+/* Get offset of a cell in the text of a line. */
+size_t
+grid_text_offset(const struct grid_text *gt, u_int px)
+{
+	if (px >= gt->ncells)
+		return (gt->size);
+	if (gt->offsets == NULL)
+		return (px);
+	return (gt->offsets[px]);
+}
+
+/*
+ * Get the cell holding a byte in the text of a line, or the number of cells
+ * if it is after the end.
+ */
+u_int
+grid_text_cell(const struct grid_text *gt, size_t offset)
+{
+	u_int	lo, hi, mid;
+
+	if (offset >= gt->size)
+		return (gt->ncells);
+	if (gt->offsets == NULL)
+		return (offset);
+
+	/* Find the first cell which ends after the byte. */
+	lo = 0;
+	hi = gt->ncells - 1;
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (gt->offsets[mid + 1] > offset)
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
+	return (lo);
+}
+
+/*
+ * Copy a shared chunk so its lines may be changed. Packed lines share the
+ * packed data, which is never changed; other lines are copied.
+ */
+static void
+grid_unshare_chunk(struct grid *gd, u_int chunk)
+{
+	struct grid_chunk	*old = gd->chunks[chunk], *new;
+	struct grid_line	*gl;
+	const struct grid_line	*from;
+	u_int			 i;
+
+	new = xmalloc(sizeof *new);
+	new->references = 1;
+	memcpy(new->lines, old->lines, sizeof new->lines);
+	if (old->index == NULL)
+		new->index = NULL;
+	else {
+		new->index = xmalloc(sizeof *new->index);
+		memcpy(new->index, old->index, sizeof *new->index);
+	}
+	new->text = NULL;
+	new->text_bytes = 0;
+
+	for (i = 0; i < GRID_CHUNK_LINES; i++) {
+		gl = &new->lines[i];
+		from = &old->lines[i];
+		if (gl->flags & GRID_LINE_PACKED) {
+			gl->packed->block->references++;
+			continue;
+		}
+		if (from->celldata != NULL) {
+			gl->celldata = grid_slab_alloc(gd->slab,
+			    from->cellsize * sizeof *gl->celldata);
+			if (gl->celldata != NULL) {
+				memcpy(gl->celldata, from->celldata,
+				    from->cellsize * sizeof *gl->celldata);
+			}
+		}
+		if (from->extddata != NULL) {
+			gl->extddata = grid_slab_alloc(gd->slab,
+			    from->extdsize * sizeof *gl->extddata);
+			if (gl->extddata != NULL) {
+				memcpy(gl->extddata, from->extddata,
+				    from->extdsize * sizeof *gl->extddata);
+			}
+		}
+	}
+
+	grid_release_chunk(old);
+	gd->chunks[chunk] = new;
+}
+
 /* Get line data. */
 struct grid_line *
 grid_get_line(struct grid *gd, u_int line)
 {
-	return (&gd->linedata[line]);
+	struct grid_line	*gl = grid_raw_line(gd, line);
+
+	if (gl->flags & GRID_LINE_PACKED)
+		grid_unpack_line(gd, gl);
+	return (gl);
 }
 
-/* Adjust number of lines. */
+/*
+ * Adjust number of lines. Any lines no longer needed must already have been
+ * freed.
+ */
 void
 grid_adjust_lines(struct grid *gd, u_int lines)
 {
-	gd->linedata = xreallocarray(gd->linedata, lines, sizeof *gd->linedata);
+	struct grid_chunk	**chunks;
+	u_int			  need, slots, i;
+
+	if (lines == 0)
+		need = 0;
+	else {
+		need = (gd->chunkline + lines + GRID_CHUNK_LINES - 1) /
+		    GRID_CHUNK_LINES;
+	}
+	if (need > gd->chunkslots) {
+		slots = gd->chunkslots;
+		if (slots == 0)
+			slots = 4;
+		while (slots < need)
+			slots *= 2;
+		chunks = xcalloc(slots, sizeof *chunks);
+		for (i = 0; i < gd->nchunks; i++) {
+			chunks[i] = gd->chunks[(gd->chunkfirst + i) &
+			    (gd->chunkslots - 1)];
+		}
+		free(gd->chunks);
+		gd->chunks = chunks;
+		gd->chunkslots = slots;
+		gd->chunkfirst = 0;
+	}
+
+	while (gd->nchunks < need) {
+		i = (gd->chunkfirst + gd->nchunks) & (gd->chunkslots - 1);
+		gd->chunks[i] = xcalloc(1, sizeof **gd->chunks);
+		gd->chunks[i]->references = 1;
+		gd->nchunks++;
+	}
+	while (gd->nchunks > need) {
+		i = (gd->chunkfirst + gd->nchunks - 1) & (gd->chunkslots - 1);
+		grid_release_chunk(gd->chunks[i]);
+		gd->chunks[i] = NULL;
+		gd->nchunks--;
+	}
+	if (gd->nchunks == 0)
+		gd->chunkline = 0;
+}
+
+/* Remove lines from the top. They must already have been freed. */
+static void
+grid_drop_lines(struct grid *gd, u_int ny)
+{
+	u_int	i;
+
+	gd->chunkline += ny;
+	while (gd->chunkline >= GRID_CHUNK_LINES) {
+		i = gd->chunkfirst;
+		grid_release_chunk(gd->chunks[i]);
+		gd->chunks[i] = NULL;
+		gd->chunkfirst = (i + 1) & (gd->chunkslots - 1);
+		gd->nchunks--;
+		gd->chunkline -= GRID_CHUNK_LINES;
+	}
 }
 
 /* Copy default into a cell. */
 static void
 grid_clear_cell(struct grid *gd, u_int px, u_int py, u_int bg)
 {
-	struct grid_line	*gl = &gd->linedata[py];
+	struct grid_line	*gl = grid_raw_line(gd, py);
 	struct grid_cell_entry	*gce = &gl->celldata[px];
 	struct grid_extd_entry	*gee;
 
 	memcpy(gce, &grid_cleared_entry, sizeof *gce);
 	if (bg != 8) {
 		if (bg & COLOUR_FLAG_RGB) {
-			grid_get_extended_cell(gl, gce, gce->flags);
-			gee = grid_extended_cell(gl, gce, &grid_cleared_cell);
+			grid_get_extended_cell(gd, gl, gce, gce->flags);
+			gee = grid_extended_cell(gd, gl, gce,
+			    &grid_cleared_cell);
 			gee->bg = bg;
 		} else {
 			if (bg & COLOUR_FLAG_256)
@@ -251,10 +1536,19 @@ grid_cells_equal(const struct grid_cell *gc1, const struct grid_cell *gc2)
 static void
 grid_free_line(struct grid *gd, u_int py)
 {
-	free(gd->linedata[py].celldata);
-	gd->linedata[py].celldata = NULL;
-	free(gd->linedata[py].extddata);
-	gd->linedata[py].extddata = NULL;
+	struct grid_line	*gl = grid_raw_line(gd, py);
+
+	if (gl->flags & GRID_LINE_PACKED) {
+		grid_pack_free(gl->packed);
+		gl->flags &= ~GRID_LINE_PACKED;
+	} else {
+		grid_slab_free(gd->slab, gl->celldata,
+		    gl->cellsize * sizeof *gl->celldata);
+		grid_slab_free(gd->slab, gl->extddata,
+		    gl->extdsize * sizeof *gl->extddata);
+	}
+	gl->celldata = NULL;
+	gl->extddata = NULL;
 }
 
 /* Free several lines. */
@@ -289,10 +1583,19 @@ grid_create(u_int sx, u_int sy, u_int hlimit)
 	gd->hsize = 0;
 	gd->hlimit = hlimit;
 
-	if (gd->sy != 0)
-		gd->linedata = xcalloc(gd->sy, sizeof *gd->linedata);
-	else
-		gd->linedata = NULL;
+	gd->hcompress = 0;
+	gd->hpacked = 0;
+	gd->unpacked = 0;
+	gd->pack_block = NULL;
+
+	gd->slab = grid_slab_create();
+
+	gd->chunks = NULL;
+	gd->chunkslots = 0;
+	gd->chunkfirst = 0;
+	gd->nchunks = 0;
+	gd->chunkline = 0;
+	grid_adjust_lines(gd, gd->sy);
 
 	return (gd);
 }
@@ -301,10 +1604,20 @@ grid_create(u_int sx, u_int sy, u_int hlimit)
 void
 grid_destroy(struct grid *gd)
 {
-	grid_free_lines(gd, 0, gd->hsize + gd->sy);
+	u_int	yy;
+
+	/* Lines in shared chunks are left to the other grid to free. */
+	for (yy = 0; yy < gd->hsize + gd->sy; yy++) {
+		if (!grid_line_shared(gd, yy))
+			grid_free_line(gd, yy);
+	}
+	if (gd->pack_block != NULL)
+		grid_pack_close_block(gd->pack_block);
 
-	free(gd->linedata);
+	grid_adjust_lines(gd, 0);
+	free(gd->chunks);
 
+	grid_slab_release(gd->slab);
 	free(gd);
 }
 
@@ -312,7 +1625,7 @@ grid_destroy(struct grid *gd)
 int
 grid_compare(struct grid *ga, struct grid *gb)
 {
-	struct grid_line	*gla, *glb;
+	const struct grid_line	*gla, *glb;
 	struct grid_cell	 gca, gcb;
 	u_int			 xx, yy;
 
@@ -320,8 +1633,8 @@ grid_compare(struct grid *ga, struct grid *gb)
 		return (1);
 
 	for (yy = 0; yy < ga->sy; yy++) {
-		gla = &ga->linedata[yy];
-		glb = &gb->linedata[yy];
+		gla = grid_read_line(ga, yy);
+		glb = grid_read_line(gb, yy);
 		if (gla->cellsize != glb->cellsize)
 			return (1);
 		for (xx = 0; xx < gla->cellsize; xx++) {
@@ -339,9 +1652,27 @@ grid_compare(struct grid *ga, struct grid *gb)
 static void
 grid_trim_history(struct grid *gd, u_int ny)
 {
-	grid_free_lines(gd, 0, ny);
-	memmove(&gd->linedata[0], &gd->linedata[ny],
-	    (gd->hsize + gd->sy - ny) * (sizeof *gd->linedata));
+	u_int	yy, chunk, offset;
+
+	/*
+	 * Shared chunks which are dropped entirely are left to the other grid
+	 * to free rather than copied only to be freed.
+	 */
+	for (yy = 0; yy < ny; yy++) {
+		chunk = grid_find_chunk(gd, yy, &offset);
+		if (gd->chunks[chunk]->references != 1 &&
+		    yy + GRID_CHUNK_LINES - offset <= ny) {
+			yy += GRID_CHUNK_LINES - offset - 1;
+			continue;
+		}
+		grid_free_line(gd, yy);
+	}
+	grid_drop_lines(gd, ny);
+
+	if (gd->hpacked > ny)
+		gd->hpacked -= ny;
+	else
+		gd->hpacked = 0;
 }
 
 /*
@@ -384,6 +1715,8 @@ grid_remove_history(struct grid *gd, u_int ny)
 	for (yy = 0; yy < ny; yy++)
 		grid_free_line(gd, gd->hsize + gd->sy - 1 - yy);
 	gd->hsize -= ny;
+	if (gd->hpacked > gd->hsize)
+		gd->hpacked = gd->hsize;
 }
 
 /*
@@ -396,13 +1729,15 @@ grid_scroll_history(struct grid *gd, u_int bg)
 	u_int	yy;
 
 	yy = gd->hsize + gd->sy;
-	gd->linedata = xreallocarray(gd->linedata, yy + 1,
-	    sizeof *gd->linedata);
+	grid_adjust_lines(gd, yy + 1);
 	grid_empty_line(gd, yy, bg);
 
 	gd->hscrolled++;
-	grid_compact_line(&gd->linedata[gd->hsize]);
+	grid_compact_line(gd, grid_chunk_line(gd, gd->hsize));
 	gd->hsize++;
+
+	grid_index_history(gd);
+	grid_pack_history(gd);
 }
 
 /* Clear the history. */
@@ -414,41 +1749,39 @@ grid_clear_history(struct grid *gd)
 	gd->hscrolled = 0;
 	gd->hsize = 0;
 
-	gd->linedata = xreallocarray(gd->linedata, gd->sy,
-	    sizeof *gd->linedata);
+	grid_adjust_lines(gd, gd->sy);
 }
 
 /* Scroll a region up, moving the top line into the history. */
 void
 grid_scroll_history_region(struct grid *gd, u_int upper, u_int lower, u_int bg)
 {
-	struct grid_line	*gl_history, *gl_upper;
-	u_int			 yy;
+	u_int	yy;
 
 	/* Create a space for a new line. */
 	yy = gd->hsize + gd->sy;
-	gd->linedata = xreallocarray(gd->linedata, yy + 1,
-	    sizeof *gd->linedata);
+	grid_adjust_lines(gd, yy + 1);
 
 	/* Move the entire screen down to free a space for this line. */
-	gl_history = &gd->linedata[gd->hsize];
-	memmove(gl_history + 1, gl_history, gd->sy * sizeof *gl_history);
+	grid_copy_raw_lines(gd, gd->hsize + 1, gd->hsize, gd->sy);
 
 	/* Adjust the region and find its start and end. */
 	upper++;
-	gl_upper = &gd->linedata[upper];
 	lower++;
 
 	/* Move the line into the history. */
-	memcpy(gl_history, gl_upper, sizeof *gl_history);
+	grid_copy_raw_lines(gd, gd->hsize, upper, 1);
 
 	/* Then move the region up and clear the bottom line. */
-	memmove(gl_upper, gl_upper + 1, (lower - upper) * sizeof *gl_upper);
+	grid_copy_raw_lines(gd, upper, upper + 1, lower - upper);
 	grid_empty_line(gd, lower, bg);
 
 	/* Move the history offset down over the line. */
 	gd->hscrolled++;
 	gd->hsize++;
+
+	grid_index_history(gd);
+	grid_pack_history(gd);
 }
 
 /* Expand line to fit to cell. */
@@ -458,7 +1791,7 @@ grid_expand_line(struct grid *gd, u_int py, u_int sx, u_int bg)
 	struct grid_line	*gl;
 	u_int			 xx;
 
-	gl = &gd->linedata[py];
+	gl = grid_get_line(gd, py);
 	if (sx <= gl->cellsize)
 		return;
 
@@ -469,7 +1802,8 @@ grid_expand_line(struct grid *gd, u_int py, u_int sx, u_int bg)
 	else if (gd->sx > sx)
 		sx = gd->sx;
 
-	gl->celldata = xreallocarray(gl->celldata, sx, sizeof *gl->celldata);
+	gl->celldata = grid_slab_realloc(gd->slab, gl->celldata,
+	    gl->cellsize * sizeof *gl->celldata, sx * sizeof *gl->celldata);
 	for (xx = gl->cellsize; xx < sx; xx++)
 		grid_clear_cell(gd, xx, py, bg);
 	gl->cellsize = sx;
@@ -479,23 +1813,40 @@ grid_expand_line(struct grid *gd, u_int py, u_int sx, u_int bg)
 void
 grid_empty_line(struct grid *gd, u_int py, u_int bg)
 {
-	memset(&gd->linedata[py], 0, sizeof gd->linedata[py]);
+	struct grid_line	*gl = grid_raw_line(gd, py);
+
+	memset(gl, 0, sizeof *gl);
 	if (!COLOUR_DEFAULT(bg))
 		grid_expand_line(gd, py, gd->sx, bg);
 }
 
+/* Unpack a line to be read, keeping the index. */
+static const struct grid_line *
+grid_unpack_read_line(struct grid *gd, u_int py)
+{
+	struct grid_line	*gl = grid_chunk_line(gd, py);
+
+	grid_unpack_line(gd, gl);
+	return (gl);
+}
+
 /* Peek at grid line. */
 const struct grid_line *
 grid_peek_line(struct grid *gd, u_int py)
 {
+	const struct grid_line	*gl;
+
 	if (grid_check_y(gd, __func__, py) != 0)
 		return (NULL);
-	return (&gd->linedata[py]);
+	gl = grid_read_line(gd, py);
+	if (gl->flags & GRID_LINE_PACKED)
+		return (grid_unpack_read_line(gd, py));
+	return (gl);
 }
 
 /* Get cell from line. */
 static void
-grid_get_cell1(struct grid_line *gl, u_int px, struct grid_cell *gc)
+grid_get_cell1(const struct grid_line *gl, u_int px, struct grid_cell *gc)
 {
 	struct grid_cell_entry	*gce = &gl->celldata[px];
 	struct grid_extd_entry	*gee;
@@ -531,11 +1882,20 @@ grid_get_cell1(struct grid_line *gl, u_int px, struct grid_cell *gc)
 void
 grid_get_cell(struct grid *gd, u_int px, u_int py, struct grid_cell *gc)
 {
-	if (grid_check_y(gd, __func__, py) != 0 ||
-	    px >= gd->linedata[py].cellsize)
+	const struct grid_line	*gl;
+
+	if (grid_check_y(gd, __func__, py) != 0) {
 		memcpy(gc, &grid_default_cell, sizeof *gc);
-	else
-		grid_get_cell1(&gd->linedata[py], px, gc);
+		return;
+	}
+	gl = grid_read_line(gd, py);
+	if (px >= gl->cellsize)
+		memcpy(gc, &grid_default_cell, sizeof *gc);
+	else {
+		if (gl->flags & GRID_LINE_PACKED)
+			gl = grid_unpack_read_line(gd, py);
+		grid_get_cell1(gl, px, gc);
+	}
 }
 
 /* Set cell at position. */
@@ -550,13 +1910,13 @@ grid_set_cell(struct grid *gd, u_int px, u_int py, const struct grid_cell *gc)
 
 	grid_expand_line(gd, py, px + 1, 8);
 
-	gl = &gd->linedata[py];
+	gl = grid_raw_line(gd, py);
 	if (px + 1 > gl->cellused)
 		gl->cellused = px + 1;
 
 	gce = &gl->celldata[px];
 	if (grid_need_extended_cell(gce, gc))
-		grid_extended_cell(gl, gce, gc);
+		grid_extended_cell(gd, gl, gce, gc);
 	else
 		grid_store_cell(gce, gc, gc->data.data[0]);
 }
@@ -574,26 +1934,38 @@ grid_set_cells(struct grid *gd, u_int px, u_int py, const struct grid_cell *gc,
     const char *s, size_t slen)
 {
 	struct grid_line	*gl;
-	struct grid_cell_entry	*gce;
+	struct grid_cell_entry	*gce, entry;
 	struct grid_extd_entry	*gee;
 	u_int			 i;
+	int			 extended;
 
 	if (grid_check_y(gd, __func__, py) != 0)
 		return;
 
 	grid_expand_line(gd, py, px + slen, 8);
 
-	gl = &gd->linedata[py];
+	gl = grid_raw_line(gd, py);
 	if (px + slen > gl->cellused)
 		gl->cellused = px + slen;
 
+	/*
+	 * Unless the cell is to be extended, all the entries are the same
+	 * apart from the character, so build the entry once.
+	 */
+	memset(&entry, 0, sizeof entry);
+	extended = grid_need_extended_cell(&entry, gc);
+	if (!extended)
+		grid_store_cell(&entry, gc, ' ');
+
 	for (i = 0; i < slen; i++) {
 		gce = &gl->celldata[px + i];
-		if (grid_need_extended_cell(gce, gc)) {
-			gee = grid_extended_cell(gl, gce, gc);
+		if (extended || (gce->flags & GRID_FLAG_EXTENDED)) {
+			gee = grid_extended_cell(gd, gl, gce, gc);
 			gee->data = utf8_build_one(s[i]);
-		} else
-			grid_store_cell(gce, gc, s[i]);
+		} else {
+			memcpy(gce, &entry, sizeof *gce);
+			gce->data.data = s[i];
+		}
 	}
 }
 
@@ -618,7 +1990,7 @@ grid_clear(struct grid *gd, u_int px, u_int py, u_int nx, u_int ny, u_int bg)
 		return;
 
 	for (yy = py; yy < py + ny; yy++) {
-		gl = &gd->linedata[yy];
+		gl = grid_raw_line(gd, yy);
 
 		sx = gd->sx;
 		if (sx > gl->cellsize)
@@ -656,7 +2028,7 @@ grid_clear_lines(struct grid *gd, u_int py, u_int ny, u_int bg)
 		grid_empty_line(gd, yy, bg);
 	}
 	if (py != 0)
-		gd->linedata[py - 1].flags &= ~GRID_LINE_WRAPPED;
+		grid_raw_line(gd, py - 1)->flags &= ~GRID_LINE_WRAPPED;
 }
 
 /* Move a group of lines. */
@@ -684,10 +2056,9 @@ grid_move_lines(struct grid *gd, u_int dy, u_int py, u_int ny, u_int bg)
 		grid_free_line(gd, yy);
 	}
 	if (dy != 0)
-		gd->linedata[dy - 1].flags &= ~GRID_LINE_WRAPPED;
+		grid_raw_line(gd, dy - 1)->flags &= ~GRID_LINE_WRAPPED;
 
-	memmove(&gd->linedata[dy], &gd->linedata[py],
-	    ny * (sizeof *gd->linedata));
+	grid_copy_raw_lines(gd, dy, py, ny);
 
 	/*
 	 * Wipe any lines that have been moved (without freeing them - they are
@@ -698,7 +2069,7 @@ grid_move_lines(struct grid *gd, u_int dy, u_int py, u_int ny, u_int bg)
 			grid_empty_line(gd, yy, bg);
 	}
 	if (py != 0 && (py < dy || py >= dy + ny))
-		gd->linedata[py - 1].flags &= ~GRID_LINE_WRAPPED;
+		grid_raw_line(gd, py - 1)->flags &= ~GRID_LINE_WRAPPED;
 }
 
 
@@ -715,7 +2086,7 @@ grid_move_cells(struct grid *gd, u_int dx, u_int px, u_int py, u_int nx,
 
 	if (grid_check_y(gd, __func__, py) != 0)
 		return;
-	gl = &gd->linedata[py];
+	gl = grid_raw_line(gd, py);
 
 	grid_expand_line(gd, py, px + nx, 8);
 	grid_expand_line(gd, py, dx + nx, 8);
@@ -953,6 +2324,42 @@ grid_string_cells_code(const struct grid_cell *lastgc,
 	}
 }
 
+/* Convert cells into a string from the text of the line. */
+static char *
+grid_string_text(struct grid *gd, u_int px, u_int py, u_int nx, int escape_c0,
+    int trim)
+{
+	const struct grid_text	*gt;
+	const char		*cp, *end;
+	char			*buf;
+	size_t			 off = 0;
+	u_int			 last;
+
+	gt = grid_get_text(gd, py);
+	if (gt == NULL || px >= gt->ncells)
+		return (xstrdup(""));
+	last = px + nx;
+	if (last > gt->ncells)
+		last = gt->ncells;
+	cp = gt->text + grid_text_offset(gt, px);
+	end = gt->text + grid_text_offset(gt, last);
+
+	buf = xmalloc(2 * (end - cp) + 1);
+	for (; cp != end; cp++) {
+		if (escape_c0 && *cp == '\\')
+			buf[off++] = '\\';
+		buf[off++] = *cp;
+	}
+
+	if (trim) {
+		while (off > 0 && buf[off - 1] == ' ')
+			off--;
+	}
+	buf[off] = '\0';
+
+	return (buf);
+}
+
 /* Convert cells into a string. */
 char *
 grid_string_cells(struct grid *gd, u_int px, u_int py, u_int nx,
@@ -970,6 +2377,8 @@ grid_string_cells(struct grid *gd, u_int px, u_int py, u_int nx,
 		memcpy(&lastgc1, &grid_default_cell, sizeof lastgc1);
 		*lastgc = &lastgc1;
 	}
+	if (!with_codes)
+		return (grid_string_text(gd, px, py, nx, escape_c0, trim));
 
 	len = 128;
 	buf = xmalloc(len);
@@ -983,13 +2392,10 @@ grid_string_cells(struct grid *gd, u_int px, u_int py, u_int nx,
 		if (gc.flags & GRID_FLAG_PADDING)
 			continue;
 
-		if (with_codes) {
-			grid_string_cells_code(*lastgc, &gc, code, sizeof code,
-			    escape_c0);
-			codelen = strlen(code);
-			memcpy(*lastgc, &gc, sizeof **lastgc);
-		} else
-			codelen = 0;
+		grid_string_cells_code(*lastgc, &gc, code, sizeof code,
+		    escape_c0);
+		codelen = strlen(code);
+		memcpy(*lastgc, &gc, sizeof **lastgc);
 
 		data = gc.data.data;
 		size = gc.data.size;
@@ -1020,6 +2426,59 @@ grid_string_cells(struct grid *gd, u_int px, u_int py, u_int nx,
 	return (buf);
 }
 
+/*
+ * Make the first ny lines of an empty grid share the chunks of another rather
+ * than copying them. The two grids then also share the slab.
+ */
+void
+grid_share_lines(struct grid *dst, struct grid *src, u_int ny)
+{
+	const struct grid_line	*gl;
+	u_int			 n, slots, i, yy, end;
+
+	if (ny > src->hsize + src->sy)
+		ny = src->hsize + src->sy;
+	if (ny == 0)
+		return;
+
+	grid_free_lines(dst, 0, dst->hsize + dst->sy);
+	grid_adjust_lines(dst, 0);
+	free(dst->chunks);
+
+	grid_slab_release(dst->slab);
+	dst->slab = src->slab;
+	dst->slab->references++;
+
+	n = (src->chunkline + ny + GRID_CHUNK_LINES - 1) / GRID_CHUNK_LINES;
+	slots = 4;
+	while (slots < n)
+		slots *= 2;
+	dst->chunks = xcalloc(slots, sizeof *dst->chunks);
+	for (i = 0; i < n; i++) {
+		dst->chunks[i] = src->chunks[(src->chunkfirst + i) &
+		    (src->chunkslots - 1)];
+		dst->chunks[i]->references++;
+	}
+	dst->chunkslots = slots;
+	dst->chunkfirst = 0;
+	dst->nchunks = n;
+	dst->chunkline = src->chunkline;
+	dst->flags |= (src->flags & GRID_INDEX);
+
+	/*
+	 * Any lines after ny in the last chunk belong to the source grid only,
+	 * so free them from this one.
+	 */
+	end = n * GRID_CHUNK_LINES - dst->chunkline;
+	for (yy = ny; yy < end; yy++) {
+		gl = grid_read_line(dst, yy);
+		if ((gl->flags & GRID_LINE_PACKED) ||
+		    gl->celldata != NULL ||
+		    gl->extddata != NULL)
+			grid_free_line(dst, yy);
+	}
+}
+
 /*
  * Duplicate a set of lines between two grids. Both source and destination
  * should be big enough.
@@ -1038,24 +2497,27 @@ grid_duplicate_lines(struct grid *dst, u_int dy, struct grid *src, u_int sy,
 	grid_free_lines(dst, dy, ny);
 
 	for (yy = 0; yy < ny; yy++) {
-		srcl = &src->linedata[sy];
-		dstl = &dst->linedata[dy];
+		srcl = grid_raw_line(src, sy);
+		dstl = grid_raw_line(dst, dy);
 
 		memcpy(dstl, srcl, sizeof *dstl);
-		if (srcl->cellsize != 0) {
-			dstl->celldata = xreallocarray(NULL,
-			    srcl->cellsize, sizeof *dstl->celldata);
-			memcpy(dstl->celldata, srcl->celldata,
+		if (srcl->flags & GRID_LINE_PACKED) {
+			dstl->packed = grid_pack_alloc(dst, srcl->packed->size);
+			memcpy(dstl->packed->data, srcl->packed->data,
+			    srcl->packed->size);
+		} else {
+			dstl->celldata = grid_slab_alloc(dst->slab,
 			    srcl->cellsize * sizeof *dstl->celldata);
-		} else
-			dstl->celldata = NULL;
-
-		if (srcl->extdsize != 0) {
-			dstl->extdsize = srcl->extdsize;
-			dstl->extddata = xreallocarray(NULL, dstl->extdsize,
-			    sizeof *dstl->extddata);
-			memcpy(dstl->extddata, srcl->extddata, dstl->extdsize *
-			    sizeof *dstl->extddata);
+			if (dstl->celldata != NULL) {
+				memcpy(dstl->celldata, srcl->celldata,
+				    srcl->cellsize * sizeof *dstl->celldata);
+			}
+			dstl->extddata = grid_slab_alloc(dst->slab,
+			    srcl->extdsize * sizeof *dstl->extddata);
+			if (dstl->extddata != NULL) {
+				memcpy(dstl->extddata, srcl->extddata,
+				    srcl->extdsize * sizeof *dstl->extddata);
+			}
 		}
 
 		sy++;
@@ -1076,13 +2538,16 @@ static struct grid_line *
 grid_reflow_add(struct grid *gd, u_int n)
 {
 	struct grid_line	*gl;
-	u_int			 sy = gd->sy + n;
+	u_int			 sy = gd->sy + n, yy;
 
-	gd->linedata = xreallocarray(gd->linedata, sy, sizeof *gd->linedata);
-	gl = &gd->linedata[gd->sy];
-	memset(gl, 0, n * (sizeof *gl));
+	grid_adjust_lines(gd, sy);
+	for (yy = gd->sy; yy < sy; yy++) {
+		gl = grid_raw_line(gd, yy);
+		memset(gl, 0, sizeof *gl);
+	}
+	yy = gd->sy;
 	gd->sy = sy;
-	return (gl);
+	return (grid_raw_line(gd, yy));
 }
 
 /* Move a line across. */
@@ -1113,10 +2578,10 @@ grid_reflow_join(struct grid *target, struct grid *gd, u_int sx, u_int yy,
 	 */
 	if (!already) {
 		to = target->sy;
-		gl = grid_reflow_move(target, &gd->linedata[yy]);
+		gl = grid_reflow_move(target, grid_raw_line(gd, yy));
 	} else {
 		to = target->sy - 1;
-		gl = &target->linedata[to];
+		gl = grid_raw_line(target, to);
 	}
 	at = gl->cellused;
 
@@ -1134,9 +2599,9 @@ grid_reflow_join(struct grid *target, struct grid *gd, u_int sx, u_int yy,
 		line = yy + 1 + lines;
 
 		/* If the next line is empty, skip it. */
-		if (~gd->linedata[line].flags & GRID_LINE_WRAPPED)
+		if (~grid_raw_line(gd, line)->flags & GRID_LINE_WRAPPED)
 			wrapped = 0;
-		if (gd->linedata[line].cellused == 0) {
+		if (grid_raw_line(gd, line)->cellused == 0) {
 			if (!wrapped)
 				break;
 			lines++;
@@ -1148,7 +2613,7 @@ grid_reflow_join(struct grid *target, struct grid *gd, u_int sx, u_int yy,
 		 * separately because we need to leave "from" set to the last
 		 * line if this line is full.
 		 */
-		grid_get_cell1(&gd->linedata[line], 0, &gc);
+		grid_get_cell1(grid_get_line(gd, line), 0, &gc);
 		if (width + gc.data.width > sx)
 			break;
 		width += gc.data.width;
@@ -1156,7 +2621,7 @@ grid_reflow_join(struct grid *target, struct grid *gd, u_int sx, u_int yy,
 		at++;
 
 		/* Join as much more as possible onto the current line. */
-		from = &gd->linedata[line];
+		from = grid_raw_line(gd, line);
 		for (want = 1; want < from->cellused; want++) {
 			grid_get_cell1(from, want, &gc);
 			if (width + gc.data.width > sx)
@@ -1186,6 +2651,9 @@ grid_reflow_join(struct grid *target, struct grid *gd, u_int sx, u_int yy,
 	left = from->cellused - want;
 	if (left != 0) {
 		grid_move_cells(gd, 0, want, yy + lines, left, 8);
+		from->celldata = grid_slab_realloc(gd->slab, from->celldata,
+		    from->cellsize * sizeof *from->celldata,
+		    left * sizeof *from->celldata);
 		from->cellsize = from->cellused = left;
 		lines--;
 	} else if (!wrapped)
@@ -1193,9 +2661,8 @@ grid_reflow_join(struct grid *target, struct grid *gd, u_int sx, u_int yy,
 
 	/* Remove the lines that were completely consumed. */
 	for (i = yy + 1; i < yy + 1 + lines; i++) {
-		free(gd->linedata[i].celldata);
-		free(gd->linedata[i].extddata);
-		grid_reflow_dead(&gd->linedata[i]);
+		grid_free_line(gd, i);
+		grid_reflow_dead(grid_raw_line(gd, i));
 	}
 
 	/* Adjust scroll position. */
@@ -1210,7 +2677,7 @@ static void
 grid_reflow_split(struct grid *target, struct grid *gd, u_int sx, u_int yy,
     u_int at)
 {
-	struct grid_line	*gl = &gd->linedata[yy], *first;
+	struct grid_line	*gl = grid_get_line(gd, yy), *first;
 	struct grid_cell	 gc;
 	u_int			 line, lines, width, i, xx;
 	u_int			 used = gl->cellused;
@@ -1242,7 +2709,7 @@ grid_reflow_split(struct grid *target, struct grid *gd, u_int sx, u_int yy,
 	for (i = at; i < used; i++) {
 		grid_get_cell1(gl, i, &gc);
 		if (width + gc.data.width > sx) {
-			target->linedata[line].flags |= GRID_LINE_WRAPPED;
+			grid_raw_line(target, line)->flags |= GRID_LINE_WRAPPED;
 
 			line++;
 			width = 0;
@@ -1253,9 +2720,11 @@ grid_reflow_split(struct grid *target, struct grid *gd, u_int sx, u_int yy,
 		xx++;
 	}
 	if (flags & GRID_LINE_WRAPPED)
-		target->linedata[line].flags |= GRID_LINE_WRAPPED;
+		grid_raw_line(target, line)->flags |= GRID_LINE_WRAPPED;
 
 	/* Move the remainder of the original line. */
+	gl->celldata = grid_slab_realloc(gd->slab, gl->celldata,
+	    gl->cellsize * sizeof *gl->celldata, at * sizeof *gl->celldata);
 	gl->cellsize = gl->cellused = at;
 	gl->flags |= GRID_LINE_WRAPPED;
 	memcpy(first, gl, sizeof *first);
@@ -1287,12 +2756,15 @@ grid_reflow(struct grid *gd, u_int sx)
 	 * line data and may not be fully valid.
 	 */
 	target = grid_create(gd->sx, 0, 0);
+	grid_slab_release(target->slab);
+	target->slab = gd->slab;
+	target->slab->references++;
 
 	/*
 	 * Loop over each source line.
 	 */
 	for (yy = 0; yy < gd->hsize + gd->sy; yy++) {
-		gl = &gd->linedata[yy];
+		gl = grid_raw_line(gd, yy);
 		if (gl->flags & GRID_LINE_DEAD)
 			continue;
 
@@ -1309,6 +2781,7 @@ grid_reflow(struct grid *gd, u_int sx)
 			else
 				at = width;
 		} else {
+			grid_unpack_line(gd, gl);
 			for (i = 0; i < gl->cellused; i++) {
 				grid_get_cell1(gl, i, &gc);
 				if (at == 0 && width + gc.data.width > sx)
@@ -1353,8 +2826,16 @@ grid_reflow(struct grid *gd, u_int sx)
 	gd->hsize = target->sy - gd->sy;
 	if (gd->hscrolled > gd->hsize)
 		gd->hscrolled = gd->hsize;
-	free(gd->linedata);
-	gd->linedata = target->linedata;
+	gd->hpacked = 0;
+
+	grid_adjust_lines(gd, 0);
+	free(gd->chunks);
+	gd->chunks = target->chunks;
+	gd->chunkslots = target->chunkslots;
+	gd->chunkfirst = target->chunkfirst;
+	gd->nchunks = target->nchunks;
+	gd->chunkline = target->chunkline;
+	grid_slab_release(target->slab);
 	free(target);
 }
 
@@ -1365,14 +2846,14 @@ grid_wrap_position(struct grid *gd, u_int px, u_int py, u_int *wx, u_int *wy)
 	u_int	ax = 0, ay = 0, yy;
 
 	for (yy = 0; yy < py; yy++) {
-		if (gd->linedata[yy].flags & GRID_LINE_WRAPPED)
-			ax += gd->linedata[yy].cellused;
+		if (grid_raw_line(gd, yy)->flags & GRID_LINE_WRAPPED)
+			ax += grid_raw_line(gd, yy)->cellused;
 		else {
 			ax = 0;
 			ay++;
 		}
 	}
-	if (px >= gd->linedata[yy].cellused)
+	if (px >= grid_raw_line(gd, yy)->cellused)
 		ax = UINT_MAX;
 	else
 		ax += px;
@@ -1389,7 +2870,7 @@ grid_unwrap_position(struct grid *gd, u_int *px, u_int *py, u_int wx, u_int wy)
 	for (yy = 0; yy < gd->hsize + gd->sy - 1; yy++) {
 		if (ay == wy)
 			break;
-		if (~gd->linedata[yy].flags & GRID_LINE_WRAPPED)
+		if (~grid_raw_line(gd, yy)->flags & GRID_LINE_WRAPPED)
 			ay++;
 	}
 
@@ -1398,14 +2879,14 @@ grid_unwrap_position(struct grid *gd, u_int *px, u_int *py, u_int wx, u_int wy)
 	 * until we find the end or the line now containing wx.
 	 */
 	if (wx == UINT_MAX) {
-		while (gd->linedata[yy].flags & GRID_LINE_WRAPPED)
+		while (grid_raw_line(gd, yy)->flags & GRID_LINE_WRAPPED)
 			yy++;
-		wx = gd->linedata[yy].cellused;
+		wx = grid_raw_line(gd, yy)->cellused;
 	} else {
-		while (gd->linedata[yy].flags & GRID_LINE_WRAPPED) {
-			if (wx < gd->linedata[yy].cellused)
+		while (grid_raw_line(gd, yy)->flags & GRID_LINE_WRAPPED) {
+			if (wx < grid_raw_line(gd, yy)->cellused)
 				break;
-			wx -= gd->linedata[yy].cellused;
+			wx -= grid_raw_line(gd, yy)->cellused;
 			yy++;
 		}
 	}
@@ -1420,7 +2901,7 @@ grid_line_length(struct grid *gd, u_int py)
 	struct grid_cell	gc;
 	u_int			px;
 
-	px = grid_get_line(gd, py)->cellsize;
+	px = grid_read_line(gd, py)->cellsize;
 	if (px > gd->sx)
 		px = gd->sx;
 	while (px > 0) {
@@ -1433,3 +2914,42 @@ grid_line_length(struct grid *gd, u_int py)
 	}
 	return (px);
 }
+
+/* Get memory usage of grid. */
+void
+grid_get_usage(struct grid *gd, struct grid_usage *gu)
+{
+	const struct grid_line	*gl;
+	struct grid_chunk	*gc;
+	u_int			 yy, i;
+
+	memset(gu, 0, sizeof *gu);
+	gu->slab_bytes = gd->slab->arena_bytes + gd->slab->large_bytes;
+	gu->slab_used = gd->slab->used_bytes + gd->slab->large_bytes;
+	gu->slab_blocks = gd->slab->blocks;
+
+	gu->nlines = gd->hsize + gd->sy;
+	gu->bytes = gu->nlines * sizeof *gl;
+
+	for (yy = 0; yy < gu->nlines; yy++) {
+		gl = grid_read_line(gd, yy);
+		if (grid_line_shared(gd, yy))
+			gu->nshared++;
+		gu->ncells += gl->cellsize;
+		gu->nextended += gl->extdsize;
+		if (gl->flags & GRID_LINE_PACKED) {
+			gu->npacked++;
+			gu->packed_bytes += gl->packed->size;
+			gu->bytes += gl->packed->size;
+		} else {
+			gu->bytes += gl->cellsize * sizeof *gl->celldata;
+			gu->bytes += gl->extdsize * sizeof *gl->extddata;
+		}
+	}
+
+	for (i = 0; i < gd->nchunks; i++) {
+		gc = gd->chunks[(gd->chunkfirst + i) & (gd->chunkslots - 1)];
+		if (gc->index != NULL)
+			gu->index_bytes += sizeof *gc->index;
+	}
+}
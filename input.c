@@ -26,6 +26,10 @@
 #include <string.h>
 #include <time.h>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 #include "tmux.h"
 
 /*
@@ -152,6 +156,8 @@ static void	input_exit_rename(struct input_ctx *);
 
 /* Input state handlers. */
 static int	input_print(struct input_ctx *);
+static size_t	input_printable(const u_char *, size_t);
+static void	input_print_run(struct input_ctx *, const u_char *, size_t);
 static int	input_intermediate(struct input_ctx *);
 static int	input_parameter(struct input_ctx *);
 static int	input_input(struct input_ctx *);
@@ -886,12 +892,25 @@ input_parse(struct input_ctx *ictx, u_char *buf, size_t len)
 	struct screen_write_ctx		*sctx = &ictx->ctx;
 	const struct input_state	*state = NULL;
 	const struct input_transition	*itr = NULL;
-	size_t				 off = 0;
+	size_t				 off = 0, n;
 
 	/* Parse the input. */
 	while (off < len) {
 		ictx->ch = buf[off++];
 
+		/*
+		 * In the ground state, print runs of printable characters
+		 * together rather than looking up the transition for each.
+		 */
+		if (ictx->state == &input_state_ground &&
+		    ictx->ch >= 0x20 &&
+		    ictx->ch <= 0x7e) {
+			n = input_printable(buf + off, len - off);
+			input_print_run(ictx, buf + off - 1, n + 1);
+			off += n;
+			continue;
+		}
+
 		/* Find the transition. */
 		if (ictx->state != state ||
 		    itr == NULL ||
@@ -1136,6 +1155,56 @@ input_print(struct input_ctx *ictx)
 	return (0);
 }
 
+/* Find how many bytes at the start of the buffer are printable. */
+static size_t
+input_printable(const u_char *buf, size_t len)
+{
+	size_t	 off = 0;
+#ifdef __SSE2__
+	__m128i	 lo = _mm_set1_epi8(0x1f), hi = _mm_set1_epi8(0x7f), v;
+	u_int	 mask;
+
+	/*
+	 * Compared as signed, a byte is printable if it is greater than 0x1f
+	 * and less than 0x7f (bytes with the top bit set are negative).
+	 */
+	while (len - off >= sizeof v) {
+		v = _mm_loadu_si128((const __m128i *)(buf + off));
+		mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpgt_epi8(v, lo),
+		    _mm_cmplt_epi8(v, hi)));
+		if (mask != 0xffff)
+			return (off + __builtin_ctz(~mask));
+		off += sizeof v;
+	}
+#endif
+	while (off < len && buf[off] >= 0x20 && buf[off] <= 0x7e)
+		off++;
+	return (off);
+}
+
+/* Output a run of printable characters to the screen. */
+static void
+input_print_run(struct input_ctx *ictx, const u_char *buf, size_t len)
+{
+	struct screen_write_ctx	*sctx = &ictx->ctx;
+	int			 set;
+
+	ictx->utf8started = 0; /* can't be valid UTF-8 */
+
+	set = ictx->cell.set == 0 ? ictx->cell.g0set : ictx->cell.g1set;
+	if (set == 1)
+		ictx->cell.cell.attr |= GRID_ATTR_CHARSET;
+	else
+		ictx->cell.cell.attr &= ~GRID_ATTR_CHARSET;
+
+	screen_write_cells(sctx, &ictx->cell.cell, buf, len);
+	ictx->ch = buf[len - 1];
+	utf8_set(&ictx->cell.cell.data, ictx->ch);
+	ictx->last = ictx->ch;
+
+	ictx->cell.cell.attr &= ~GRID_ATTR_CHARSET;
+}
+
 /* Collect intermediate string. */
 static int
 input_intermediate(struct input_ctx *ictx)
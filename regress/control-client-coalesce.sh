@@ -0,0 +1,65 @@
+#!/bin/sh
+
+PATH=/bin:/usr/bin
+TERM=screen
+
+[ -z "$TEST_TMUX" ] && TEST_TMUX=$(readlink -f ../tmux)
+TMUX="$TEST_TMUX -Ltest"
+$TMUX kill-server 2>/dev/null
+
+IN=$(mktemp -u)
+OUT=$(mktemp)
+PLAIN=$(mktemp)
+trap "rm -f $IN $OUT $PLAIN" 0 1 15
+mkfifo $IN || exit 1
+
+$TMUX -f/dev/null new -d 'cat >/dev/null' || exit 1
+TTY=$($TMUX display -p '#{pane_tty}')
+
+# Attach a control client with the given arguments, write lines to the pane
+# slowly and leave the number of %output lines in N.
+run() {
+	$TMUX -C a "$@" <$IN >$OUT &
+	exec 3>$IN
+	sleep 1
+	[ -n "$CMD" ] && { echo "$CMD" >&3; sleep 1; }
+	i=0
+	while [ $i -lt 100 ]; do
+		echo "line $i" >$TTY
+		sleep 0.01
+		i=$((i + 1))
+	done
+	sleep 1
+	exec 3>&-
+	wait
+	N=$(grep -c '^%output %0 ' $OUT)
+}
+
+# The output without the %output prefixes, joined together.
+output() {
+	sed -n 's/^%output %0 //p' $OUT|tr -d '\n'
+}
+
+# Check the same output was seen and in fewer or more lines than without
+# coalescing.
+check() {
+	[ "$(output)" = "$(cat $PLAIN)" ] || { $TMUX kill-server; exit 1; }
+	if [ "$1" = fewer ]; then
+		[ $N -lt $((PLAIN_N / 2)) ] || { $TMUX kill-server; exit 1; }
+	else
+		[ $N -gt $((PLAIN_N / 2)) ] || { $TMUX kill-server; exit 1; }
+	fi
+}
+
+run
+PLAIN_N=$N
+output >$PLAIN
+[ $PLAIN_N -ge 50 ] || { $TMUX kill-server; exit 1; }
+
+run -f coalesce; check fewer
+run -f coalesce=100; check fewer
+run -f coalesce=100:64; check fewer
+CMD='refresh-client -f !coalesce' run -f coalesce=100; check more
+
+$TMUX kill-server 2>/dev/null
+exit 0
@@ -0,0 +1,28 @@
+#!/bin/sh
+
+PATH=/bin:/usr/bin
+TERM=screen
+
+[ -z "$TEST_TMUX" ] && TEST_TMUX=$(readlink -f ../tmux)
+TMUX="$TEST_TMUX -Ltest"
+$TMUX kill-server 2>/dev/null
+
+TMP=$(mktemp)
+OUT=$(mktemp)
+trap "rm -f $TMP $OUT" 0 1 15
+
+$TMUX -f/dev/null new -d || exit 1
+sleep 1
+cat <<EOF2|$TMUX -C a >$TMP
+refresh-client -f binary-frames
+display -p hello
+EOF2
+sleep 1
+$TMUX kill-server 2>/dev/null
+
+grep -aq '^%begin' $TMP || exit 1
+grep -aq "$(printf '\005')hello" $TMP || exit 1
+printf '\000\000\000\005%%exit' >$OUT
+tail -c9 $TMP|cmp -s $OUT - || exit 1
+
+exit 0
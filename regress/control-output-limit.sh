@@ -0,0 +1,48 @@
+#!/bin/sh
+
+PATH=/bin:/usr/bin
+TERM=screen
+
+[ -z "$TEST_TMUX" ] && TEST_TMUX=$(readlink -f ../tmux)
+TMUX="$TEST_TMUX -Ltest"
+$TMUX kill-server 2>/dev/null
+
+IN=$(mktemp -u)
+STALL=$(mktemp -u)
+FAST=$(mktemp)
+SLOW=$(mktemp)
+trap "rm -f $IN $STALL $FAST $SLOW" 0 1 15
+mkfifo $IN $STALL || exit 1
+
+# Let the stalled client go and stop the server.
+finish() {
+	cat <&4 >$SLOW &
+	sleep 1
+	$TMUX kill-server 2>/dev/null
+	exec 3>&- 4<&-
+	wait
+}
+
+$TMUX -f/dev/null new -d 'cat' || exit 1
+$TMUX set -g control-output-limit 65536 || exit 1
+
+# One client which takes output and one which never reads it.
+$TMUX -C a <$IN >$FAST &
+$TMUX -C a <$IN >$STALL &
+exec 3>$IN 4<$STALL
+sleep 1
+
+TTY=$($TMUX display -p '#{pane_tty}')
+yes 0123456789abcdef|head -c4000000 >$TTY
+echo end-of-output >$TTY
+sleep 2
+
+# The output kept for the stalled client must be bounded.
+SIZE=$($TMUX display -p '#{pane_output_size}')
+[ "$SIZE" -lt 1000000 ] || { finish; exit 1; }
+grep -aq 'end-of-output' $FAST || { finish; exit 1; }
+
+finish
+grep -aq '^%output-dropped %0 ' $SLOW || exit 1
+
+exit 0
@@ -0,0 +1,40 @@
+#!/bin/sh
+
+# compressed history should capture the same as uncompressed history
+
+PATH=/bin:/usr/bin
+TERM=screen
+
+[ -z "$TEST_TMUX" ] && TEST_TMUX=$(readlink -f ../tmux)
+TMUX="$TEST_TMUX -Ltest"
+$TMUX kill-server 2>/dev/null
+
+TMP1=$(mktemp)
+TMP2=$(mktemp)
+trap "rm -f $TMP1 $TMP2" 0 1 15
+
+CMD="
+	printf '\033[31mred\033[m \033[38;2;1;2;3mrgb\033[m \303\251\n'
+	seq 1 2000
+	printf '\033[44m blue \033[K\033[m\n'
+	sleep 10"
+
+$TMUX -f/dev/null new -d -x80 -y24 \; set -g history-compress-after 10 || \
+	exit 1
+$TMUX neww -d "$CMD" \; set -g history-compress-after 0 \; neww -d "$CMD"
+sleep 1
+
+[ "$($TMUX display -pt:1 '#{history_packed_lines}')" -gt 1000 ] || exit 1
+[ "$($TMUX display -pt:2 '#{history_packed_lines}')" -eq 0 ] || exit 1
+
+$TMUX capturep -peS- -t:1 >$TMP1
+$TMUX capturep -peS- -t:2 >$TMP2
+cmp $TMP1 $TMP2 || exit 1
+
+$TMUX resizew -t:1 -x40 \; resizew -t:2 -x40
+$TMUX capturep -peS- -t:1 >$TMP1
+$TMUX capturep -peS- -t:2 >$TMP2
+cmp $TMP1 $TMP2 || exit 1
+
+$TMUX kill-server 2>/dev/null
+exit 0
@@ -0,0 +1,24 @@
+#!/bin/sh
+
+PATH=/bin:/usr/bin
+TERM=screen
+
+[ -z "$TEST_TMUX" ] && TEST_TMUX=$(readlink -f ../tmux)
+TMUX="$TEST_TMUX -Ltest"
+$TMUX kill-server 2>/dev/null
+
+OUT=$(mktemp)
+trap "rm -f $OUT" 0 1 15
+
+$TMUX -f/dev/null new -d 'sleep 1; echo hello' || exit 1
+$TMUX set -g remain-on-exit on || exit 1
+$TMUX pipe-pane -O "cat >$OUT" || exit 1
+sleep 3
+
+# The server must survive the pane exiting with the pipe open.
+$TMUX has || exit 1
+[ "$($TMUX display -p '#{pane_dead} #{pane_pipe}')" = "1 1" ] || exit 1
+grep -q '^hello' $OUT || exit 1
+$TMUX kill-server 2>/dev/null
+
+exit 0
@@ -25,7 +25,7 @@
 
 static void	screen_redraw_draw_borders(struct screen_redraw_ctx *);
 static void	screen_redraw_draw_panes(struct screen_redraw_ctx *);
-static void	screen_redraw_draw_status(struct screen_redraw_ctx *);
+static void	screen_redraw_draw_status(struct screen_redraw_ctx *, int);
 static void	screen_redraw_draw_pane(struct screen_redraw_ctx *,
 		    struct window_pane *);
 static void	screen_redraw_set_context(struct client *,
@@ -318,6 +318,64 @@ screen_redraw_type_of_cell(struct client *c, u_int px, u_int py,
 	return (CELL_OUTSIDE);
 }
 
+/* Work out the type of every cell in the window if the layout has changed. */
+static void
+screen_redraw_update_borders(struct client *c, int pane_status)
+{
+	struct window		*w = c->session->curw->window;
+	struct window_pane	*wp, *zoomed = NULL;
+	u_int			 px, py, sx = w->sx + 1, sy = w->sy + 1;
+	u_char			*cell;
+
+	if (w->flags & WINDOW_ZOOMED)
+		zoomed = w->active;
+	if (w->border_cells != NULL &&
+	    (~w->flags & WINDOW_BORDERSCHANGED) &&
+	    w->border_sx == w->sx &&
+	    w->border_sy == w->sy &&
+	    w->border_status == pane_status &&
+	    w->border_zoomed == zoomed)
+		return;
+	log_debug("%s: @%u %ux%u", __func__, w->id, w->sx, w->sy);
+
+	free(w->border_cells);
+	w->border_cells = xreallocarray(NULL, sx, sy);
+	w->border_sx = w->sx;
+	w->border_sy = w->sy;
+	w->border_status = pane_status;
+	w->border_zoomed = zoomed;
+	w->flags &= ~WINDOW_BORDERSCHANGED;
+
+	for (py = 0; py < sy; py++) {
+		for (px = 0; px < sx; px++) {
+			cell = &w->border_cells[py * sx + px];
+			if (px == w->sx || py == w->sy) { /* window border */
+				*cell = screen_redraw_type_of_cell(c, px, py,
+				    pane_status);
+				continue;
+			}
+			*cell = CELL_OUTSIDE;
+			TAILQ_FOREACH(wp, &w->panes, entry) {
+				if (!window_pane_visible(wp))
+					continue;
+				switch (screen_redraw_pane_border(wp, px, py,
+				    pane_status)) {
+				case SCREEN_REDRAW_INSIDE:
+					*cell = CELL_INSIDE;
+					break;
+				case SCREEN_REDRAW_BORDER:
+					*cell = screen_redraw_type_of_cell(c, px,
+					    py, pane_status);
+					break;
+				case SCREEN_REDRAW_OUTSIDE:
+					continue;
+				}
+				break;
+			}
+		}
+	}
+}
+
 /* Check if cell inside a pane. */
 static int
 screen_redraw_check_cell(struct client *c, u_int px, u_int py, int pane_status,
@@ -325,15 +383,18 @@ screen_redraw_check_cell(struct client *c, u_int px, u_int py, int pane_status,
 {
 	struct window		*w = c->session->curw->window;
 	struct window_pane	*wp, *active;
-	int			 border;
+	int			 type;
 	u_int			 right, line;
 
 	*wpp = NULL;
 
 	if (px > w->sx || py > w->sy)
 		return (CELL_OUTSIDE);
+	type = w->border_cells[py * (w->sx + 1) + px];
 	if (px == w->sx || py == w->sy) /* window border */
-		return (screen_redraw_type_of_cell(c, px, py, pane_status));
+		return (type);
+	if (type == CELL_INSIDE)
+		return (CELL_INSIDE);
 
 	if (pane_status != PANE_STATUS_OFF) {
 		active = wp = server_client_get_pane(c);
@@ -357,22 +418,19 @@ screen_redraw_check_cell(struct client *c, u_int px, u_int py, int pane_status,
 		} while (wp != active);
 	}
 
+	/*
+	 * Find the pane the border belongs to, starting with the active pane.
+	 * If there is none, this is the last visible pane.
+	 */
 	active = wp = server_client_get_pane(c);
 	do {
 		if (!window_pane_visible(wp))
 			goto next2;
 		*wpp = wp;
 
-		/*
-		 * If definitely inside, return. If not on border, skip.
-		 * Otherwise work out the cell.
-		 */
-		border = screen_redraw_pane_border(wp, px, py, pane_status);
-		if (border == SCREEN_REDRAW_INSIDE)
-			return (CELL_INSIDE);
-		if (border == SCREEN_REDRAW_OUTSIDE)
-			goto next2;
-		return (screen_redraw_type_of_cell(c, px, py, pane_status));
+		if (screen_redraw_pane_border(wp, px, py, pane_status) ==
+		    SCREEN_REDRAW_BORDER)
+			break;
 
 	next2:
 		wp = TAILQ_NEXT(wp, entry);
@@ -380,7 +438,7 @@ screen_redraw_check_cell(struct client *c, u_int px, u_int py, int pane_status,
 			wp = TAILQ_FIRST(&w->panes);
 	} while (wp != active);
 
-	return (CELL_OUTSIDE);
+	return (type);
 }
 
 /* Check if the border of a particular pane. */
@@ -432,13 +490,17 @@ screen_redraw_make_pane_status(struct client *c, struct window_pane *wp,
 
 	screen_write_start(&ctx, &wp->status_screen);
 
+	screen_redraw_update_borders(c, pane_status);
 	for (i = 0; i < width; i++) {
 		px = wp->xoff + 2 + i;
 		if (rctx->pane_status == PANE_STATUS_TOP)
 			py = wp->yoff - 1;
 		else
 			py = wp->yoff + wp->sy;
-		cell_type = screen_redraw_type_of_cell(c, px, py, pane_status);
+		if (px > w->sx || py > w->sy)
+			cell_type = CELL_OUTSIDE;
+		else
+			cell_type = w->border_cells[py * (w->sx + 1) + px];
 		screen_redraw_border_set(wp, pane_lines, cell_type, &gc);
 		screen_write_cell(&ctx, &gc);
 	}
@@ -617,7 +679,7 @@ screen_redraw_screen(struct client *c)
 	if (ctx.statuslines != 0 &&
 	    (flags & (CLIENT_REDRAWSTATUS|CLIENT_REDRAWSTATUSALWAYS))) {
 		log_debug("%s: redrawing status", c->name);
-		screen_redraw_draw_status(&ctx);
+		screen_redraw_draw_status(&ctx, flags);
 	}
 	if (c->overlay_draw != NULL && (flags & CLIENT_REDRAWOVERLAY)) {
 		log_debug("%s: redrawing overlay", c->name);
@@ -726,6 +788,7 @@ screen_redraw_draw_borders(struct screen_redraw_ctx *ctx)
 
 	TAILQ_FOREACH(wp, &w->panes, entry)
 		wp->border_gc_set = 0;
+	screen_redraw_update_borders(c, ctx->pane_status);
 
 	for (j = 0; j < c->tty.sy - ctx->statuslines; j++) {
 		for (i = 0; i < c->tty.sx; i++)
@@ -749,25 +812,42 @@ screen_redraw_draw_panes(struct screen_redraw_ctx *ctx)
 	}
 }
 
-/* Draw the status line. */
+/*
+ * Draw the status line. If only the status line has changed, only the columns
+ * which are different from last time are drawn.
+ */
 static void
-screen_redraw_draw_status(struct screen_redraw_ctx *ctx)
+screen_redraw_draw_status(struct screen_redraw_ctx *ctx, int flags)
 {
-	struct client	*c = ctx->c;
-	struct window	*w = c->session->curw->window;
-	struct tty	*tty = &c->tty;
-	struct screen	*s = c->status.active;
-	u_int		 i, y;
+	struct client			*c = ctx->c;
+	struct window			*w = c->session->curw->window;
+	struct tty			*tty = &c->tty;
+	struct screen			*s = c->status.active;
+	struct status_line_entry	*sle;
+	u_int				 i, y, x, nx;
+	int				 changed;
 
 	log_debug("%s: %s @%u", __func__, c->name, w->id);
 
+	changed = (s == &c->status.screen &&
+	    (~flags & (CLIENT_REDRAWWINDOW|CLIENT_REDRAWSTATUSALWAYS)));
+
 	if (ctx->statustop)
 		y = 0;
 	else
 		y = c->tty.sy - ctx->statuslines;
 	for (i = 0; i < ctx->statuslines; i++) {
-		tty_draw_line(tty, s, 0, i, UINT_MAX, 0, y + i,
-		    &grid_default_cell, NULL);
+		x = 0;
+		nx = UINT_MAX;
+		if (changed && i < nitems(c->status.entries)) {
+			sle = &c->status.entries[i];
+			if (sle->changednx == 0)
+				continue;
+			x = sle->changedx;
+			nx = sle->changednx;
+		}
+		tty_draw_line(tty, s, x, i, nx, x, y + i, &grid_default_cell,
+		    NULL);
 	}
 }
 
@@ -1679,6 +1679,78 @@ screen_write_collect_add(struct screen_write_ctx *ctx,
 	ctx->s->write_list[s->cy].data[s->cx + ci->used++] = gc->data.data[0];
 }
 
+/*
+ * Write a run of single width ASCII characters with the same attributes,
+ * collecting them in as few items as possible (one for each line).
+ */
+void
+screen_write_cells(struct screen_write_ctx *ctx, const struct grid_cell *gc,
+    const char *data, size_t size)
+{
+	struct screen				*s = ctx->s;
+	struct screen_write_collect_item	*ci;
+	struct screen_write_collect_line	*cl;
+	struct grid_cell			 tmp_gc;
+	u_int					 sx = screen_size_x(s);
+	size_t					 n;
+	int					 collect;
+
+	collect = 1;
+	if (gc->attr & GRID_ATTR_CHARSET)
+		collect = 0;
+	else if (~s->mode & MODE_WRAP)
+		collect = 0;
+	else if (s->mode & MODE_INSERT)
+		collect = 0;
+	else if (s->sel != NULL)
+		collect = 0;
+	if (!collect) {
+		memcpy(&tmp_gc, gc, sizeof tmp_gc);
+		for (n = 0; n < size; n++) {
+			utf8_set(&tmp_gc.data, data[n]);
+			screen_write_collect_add(ctx, &tmp_gc);
+		}
+		return;
+	}
+
+	ci = ctx->item;
+	if (ci->used != 0 &&
+	    (!grid_cells_look_equal(&ci->gc, gc) || ci->gc.us != gc->us))
+		screen_write_collect_end(ctx);
+
+	while (size != 0) {
+		if (s->cx > sx - 1 || ctx->item->used > sx - 1 - s->cx)
+			screen_write_collect_end(ctx);
+		ci = ctx->item; /* may have changed */
+
+		if (s->cx > sx - 1) {
+			log_debug("%s: wrapped at %u,%u", __func__, s->cx,
+			    s->cy);
+			ci->wrapped = 1;
+			screen_write_linefeed(ctx, 1, 8);
+			screen_write_set_cursor(ctx, 0, -1);
+		}
+
+		if (ci->used == 0) {
+			memcpy(&ci->gc, gc, sizeof ci->gc);
+			utf8_set(&ci->gc.data, *data);
+		}
+		cl = &s->write_list[s->cy];
+		if (cl->data == NULL)
+			cl->data = xmalloc(sx);
+
+		n = sx - s->cx - ci->used;
+		if (n > size)
+			n = size;
+		memcpy(cl->data + s->cx + ci->used, data, n);
+		ci->used += n;
+		ctx->cells += n;
+
+		data += n;
+		size -= n;
+	}
+}
+
 /* Write cell data. */
 void
 screen_write_cell(struct screen_write_ctx *ctx, const struct grid_cell *gc)
@@ -30,6 +30,9 @@
 
 #include "tmux.h"
 
+/* Milliseconds control output is held for with a bare coalesce flag. */
+#define CLIENT_COALESCE_AGE 50
+
 static void	server_client_free(int, short, void *);
 static void	server_client_check_pane_focus(struct window_pane *);
 static void	server_client_check_pane_resize(struct window_pane *);
@@ -1350,7 +1353,11 @@ server_client_loop(void)
 	RB_FOREACH(w, windows, &windows)
 		server_client_check_window_resize(w);
 
-	/* Check clients. */
+	/*
+	 * Check clients. Formats expanded while redrawing are shared between
+	 * clients until all have been checked.
+	 */
+	format_memo_start();
 	TAILQ_FOREACH(c, &clients, entry) {
 		server_client_check_exit(c);
 		if (c->session != NULL) {
@@ -1359,6 +1366,10 @@ server_client_loop(void)
 			server_client_reset_state(c);
 		}
 	}
+	format_memo_stop();
+
+	/* Control client output is only shared until the next loop. */
+	control_free_output();
 
 	/*
 	 * Any windows will have been redrawn as part of clients, so clear
@@ -1497,12 +1508,13 @@ server_client_check_pane_buffer(struct window_pane *wp)
 	struct window_pane_offset	*wpo;
 	int				 off = 1, flag;
 	u_int				 attached_clients = 0;
-	size_t				 new_size;
+	size_t				 new_size, limit;
 
 	/*
 	 * Work out the minimum used size. This is the most that can be removed
 	 * from the buffer.
 	 */
+	limit = options_get_number(global_options, "control-output-limit");
 	minimum = wp->offset.used;
 	if (wp->pipe_fd != -1 && wp->pipe_offset.used < minimum)
 		minimum = wp->pipe_offset.used;
@@ -1524,6 +1536,19 @@ server_client_check_pane_buffer(struct window_pane *wp)
 			off = 0;
 
 		window_pane_get_new_data(wp, wpo, &new_size);
+		if (limit != 0 && new_size > limit) {
+			/*
+			 * This client is too far behind, so the pane is either
+			 * paused for it or the output is dropped.
+			 */
+			control_overflow_pane(c, wp, new_size);
+			wpo = control_pane_offset(c, wp, &flag);
+			if (wpo == NULL) {
+				off = 0;
+				continue;
+			}
+			window_pane_get_new_data(wp, wpo, &new_size);
+		}
 		log_debug("%s: %s has %zu bytes used and %zu left for %%%u",
 		    __func__, c->name, wpo->used - wp->base_offset, new_size,
 		    wp->id);
@@ -2404,6 +2429,22 @@ server_client_control_flags(struct client *c, const char *next)
 		return (CLIENT_CONTROL_NOOUTPUT);
 	if (strcmp(next, "wait-exit") == 0)
 		return (CLIENT_CONTROL_WAITEXIT);
+	if (strcmp(next, "binary-frames") == 0)
+		return (CLIENT_CONTROL_FRAMES);
+	if (strcmp(next, "coalesce") == 0) {
+		c->coalesce_age = CLIENT_COALESCE_AGE;
+		c->coalesce_size = 0;
+		return (CLIENT_CONTROL_COALESCE);
+	}
+	if (strncmp(next, "coalesce=", 9) == 0) {
+		c->coalesce_size = 0;
+		switch (sscanf(next + 9, "%u:%u", &c->coalesce_age,
+		    &c->coalesce_size)) {
+		case 1:
+		case 2:
+			return (CLIENT_CONTROL_COALESCE);
+		}
+	}
 	return (0);
 }
 
@@ -2431,6 +2472,8 @@ server_client_set_flags(struct client *c, const char *flags)
 			flag = CLIENT_IGNORESIZE;
 		else if (strcmp(next, "active-pane") == 0)
 			flag = CLIENT_ACTIVEPANE;
+		else if (strcmp(next, "fixed-block") == 0)
+			flag = CLIENT_FIXEDBLOCK;
 		if (flag == 0)
 			continue;
 
@@ -2464,15 +2507,27 @@ server_client_get_flags(struct client *c)
 		strlcat(s, "no-output,", sizeof s);
 	if (c->flags & CLIENT_CONTROL_WAITEXIT)
 		strlcat(s, "wait-exit,", sizeof s);
+	if (c->flags & CLIENT_CONTROL_FRAMES)
+		strlcat(s, "binary-frames,", sizeof s);
 	if (c->flags & CLIENT_CONTROL_PAUSEAFTER) {
 		xsnprintf(tmp, sizeof tmp, "pause-after=%u,",
 		    c->pause_age / 1000);
 		strlcat(s, tmp, sizeof s);
 	}
+	if (c->flags & CLIENT_CONTROL_COALESCE) {
+		if (c->coalesce_size != 0) {
+			xsnprintf(tmp, sizeof tmp, "coalesce=%u:%u,",
+			    c->coalesce_age, c->coalesce_size);
+		} else
+			xsnprintf(tmp, sizeof tmp, "coalesce=%u,", c->coalesce_age);
+		strlcat(s, tmp, sizeof s);
+	}
 	if (c->flags & CLIENT_READONLY)
 		strlcat(s, "read-only,", sizeof s);
 	if (c->flags & CLIENT_ACTIVEPANE)
 		strlcat(s, "active-pane,", sizeof s);
+	if (c->flags & CLIENT_FIXEDBLOCK)
+		strlcat(s, "fixed-block,", sizeof s);
 	if (c->flags & CLIENT_SUSPENDED)
 		strlcat(s, "suspended,", sizeof s);
 	if (c->flags & CLIENT_UTF8)
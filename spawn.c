@@ -262,6 +262,11 @@ spawn_pane(struct spawn_context *sc, char **cause)
 		layout_assign_pane(sc->lc, new_wp);
 	}
 
+	new_wp->base.grid->hcompress = options_get_number(s->options,
+	    "history-compress-after");
+	if (options_get_number(s->options, "history-search-index"))
+		new_wp->base.grid->flags |= GRID_INDEX;
+
 	/*
 	 * Now we have a pane with nothing running in it ready for the new process.
 	 * Work out the command and arguments and store the working directory.
@@ -307,6 +307,7 @@ status_free(struct client *c)
 	for (i = 0; i < nitems(sl->entries); i++) {
 		status_free_ranges(&sl->entries[i].ranges);
 		free((void *)sl->entries[i].expanded);
+		format_free_cache(sl->entries[i].cache);
 	}
 
 	if (event_initialized(&sl->timer))
@@ -319,6 +320,62 @@ status_free(struct client *c)
 	screen_free(&sl->screen);
 }
 
+/* Save a line of the status line before it is drawn. */
+static struct grid_cell *
+status_save_line(struct screen *s, u_int y)
+{
+	struct grid_cell	*saved;
+	u_int			 x, width = screen_size_x(s);
+
+	saved = xreallocarray(NULL, width, sizeof *saved);
+	for (x = 0; x < width; x++)
+		grid_view_get_cell(s->grid, x, y, &saved[x]);
+	return (saved);
+}
+
+/*
+ * Work out which columns of a status line are different from before it was
+ * drawn, including the whole of any wide characters at either end.
+ */
+static void
+status_changed_line(struct status_line_entry *sle, struct screen *s, u_int y,
+    struct grid_cell *saved)
+{
+	struct grid_cell	gc;
+	u_int			x, first = UINT_MAX, last = 0;
+	u_int			width = screen_size_x(s);
+
+	for (x = 0; x < width; x++) {
+		grid_view_get_cell(s->grid, x, y, &gc);
+		if (grid_cells_equal(&gc, &saved[x]))
+			continue;
+		if (first == UINT_MAX)
+			first = x;
+		last = x;
+	}
+	if (first == UINT_MAX) {
+		sle->changednx = 0;
+		return;
+	}
+
+	while (first > 0) {
+		grid_view_get_cell(s->grid, first, y, &gc);
+		if (~gc.flags & GRID_FLAG_PADDING &&
+		    ~saved[first].flags & GRID_FLAG_PADDING)
+			break;
+		first--;
+	}
+	while (last + 1 < width) {
+		grid_view_get_cell(s->grid, last + 1, y, &gc);
+		if (~gc.flags & GRID_FLAG_PADDING &&
+		    ~saved[last + 1].flags & GRID_FLAG_PADDING)
+			break;
+		last++;
+	}
+	sle->changedx = first;
+	sle->changednx = last - first + 1;
+}
+
 /* Draw status line for client. */
 int
 status_redraw(struct client *c)
@@ -333,6 +390,7 @@ status_redraw(struct client *c)
 	struct options_entry		*o;
 	union options_value		*ov;
 	struct format_tree		*ft;
+	struct grid_cell		*saved;
 	char				*expanded;
 
 	log_debug("%s enter", __func__);
@@ -341,6 +399,12 @@ status_redraw(struct client *c)
 	if (sl->active != &sl->screen)
 		fatalx("not the active screen");
 
+	/* Lines are all drawn unless found to be the same as before. */
+	for (i = 0; i < nitems(sl->entries); i++) {
+		sl->entries[i].changedx = 0;
+		sl->entries[i].changednx = width;
+	}
+
 	/* No status line? */
 	lines = status_line_size(c);
 	if (c->tty.sy == 0 || lines == 0)
@@ -391,14 +455,17 @@ status_redraw(struct client *c)
 			}
 			sle = &sl->entries[i];
 
-			expanded = format_expand_time(ft, ov->string);
+			expanded = format_expand_cached(ft, ov->string,
+			    &sle->cache);
 			if (!force &&
 			    sle->expanded != NULL &&
 			    strcmp(expanded, sle->expanded) == 0) {
 				free(expanded);
+				sle->changednx = 0;
 				continue;
 			}
 			changed = 1;
+			saved = (force ? NULL : status_save_line(&sl->screen, i));
 
 			for (n = 0; n < width; n++)
 				screen_write_putc(&ctx, &gc, ' ');
@@ -409,6 +476,11 @@ status_redraw(struct client *c)
 
 			free(sle->expanded);
 			sle->expanded = expanded;
+
+			if (saved != NULL) {
+				status_changed_line(sle, &sl->screen, i, saved);
+				free(saved);
+			}
 		}
 	}
 	screen_write_stop(&ctx);
@@ -48,8 +48,13 @@ struct cmdq_state;
 struct cmds;
 struct control_state;
 struct environ;
+struct format_cache;
 struct format_job_tree;
 struct format_tree;
+struct grid_chunk;
+struct grid_pack;
+struct grid_pack_block;
+struct grid_slab;
 struct input_ctx;
 struct job;
 struct mode_tree_data;
@@ -666,6 +671,7 @@ enum utf8_state {
 #define GRID_LINE_WRAPPED 0x1
 #define GRID_LINE_EXTENDED 0x2
 #define GRID_LINE_DEAD 0x4
+#define GRID_LINE_PACKED 0x8
 
 /* Grid cell data. */
 struct grid_cell {
@@ -701,11 +707,17 @@ struct grid_cell_entry {
 	};
 } __packed;
 
-/* Grid line. */
+/*
+ * Grid line. If GRID_LINE_PACKED is set, the cell and extended cell data are
+ * compressed into a single block (packed) and must be unpacked before use.
+ */
 struct grid_line {
 	u_int			 cellused;
 	u_int			 cellsize;
-	struct grid_cell_entry	*celldata;
+	union {
+		struct grid_cell_entry	*celldata;
+		struct grid_pack	*packed;
+	};
 
 	u_int			 extdsize;
 	struct grid_extd_entry	*extddata;
@@ -717,6 +729,7 @@ struct grid_line {
 struct grid {
 	int			 flags;
 #define GRID_HISTORY 0x1 /* scroll lines into history */
+#define GRID_INDEX 0x2 /* keep search index of lines */
 
 	u_int			 sx;
 	u_int			 sy;
@@ -725,7 +738,54 @@ struct grid {
 	u_int			 hsize;
 	u_int			 hlimit;
 
-	struct grid_line	*linedata;
+	u_int			 hcompress;
+	u_int			 hpacked;
+	u_int			 unpacked;
+	struct grid_pack_block	*pack_block;
+
+	struct grid_slab	*slab;
+
+	struct grid_chunk	**chunks;
+	u_int			  chunkslots;
+	u_int			  chunkfirst;
+	u_int			  nchunks;
+	u_int			  chunkline;
+};
+
+/* Text of a grid line. Offsets is NULL if every cell is one byte. */
+struct grid_text {
+	u_int			 ncells;
+	u_int			*offsets;
+	size_t			 size;
+	char			*text;
+};
+
+/* Buffer for the text of lines searched from other threads. */
+struct grid_search_buffer {
+	char			*text;
+	size_t			 len;
+	size_t			 size;
+
+	struct grid_cell_entry	*cells;
+	u_int			 ncells;
+};
+
+/* Grid memory usage. */
+struct grid_usage {
+	u_int			 nlines;
+	u_int			 ncells;
+	u_int			 nextended;
+	size_t			 bytes;
+
+	u_int			 npacked;
+	size_t			 packed_bytes;
+
+	u_int			 nshared;
+	size_t			 index_bytes;
+
+	size_t			 slab_bytes;
+	size_t			 slab_used;
+	u_int			 slab_blocks;
 };
 
 /* Style alignment. */
@@ -956,6 +1016,7 @@ struct window_pane {
 #define PANE_EMPTY 0x800
 #define PANE_STYLECHANGED 0x1000
 #define PANE_RESIZENOW 0x2000
+#define PANE_PIPEOUT 0x4000
 
 	int		 argc;
 	char	       **argv;
@@ -983,6 +1044,7 @@ struct window_pane {
 
 	int		 pipe_fd;
 	struct bufferevent *pipe_event;
+	struct event	 pipe_write_event;
 	struct window_pane_offset pipe_offset;
 
 	struct screen	*screen;
@@ -1041,6 +1103,12 @@ struct window {
 	u_int		 new_xpixel;
 	u_int		 new_ypixel;
 
+	u_char		*border_cells;
+	u_int		 border_sx;
+	u_int		 border_sy;
+	int		 border_status;
+	struct window_pane *border_zoomed;
+
 	int		 flags;
 #define WINDOW_BELL 0x1
 #define WINDOW_ACTIVITY 0x2
@@ -1048,6 +1116,7 @@ struct window {
 #define WINDOW_ZOOMED 0x8
 #define WINDOW_WASZOOMED 0x10
 #define WINDOW_RESIZE 0x20
+#define WINDOW_BORDERSCHANGED 0x40
 #define WINDOW_ALERTFLAGS (WINDOW_BELL|WINDOW_ACTIVITY|WINDOW_SILENCE)
 
 	int		 alerts_queued;
@@ -1272,6 +1341,17 @@ struct tty_term {
 };
 LIST_HEAD(tty_terms, tty_term);
 
+/* Cell as last written to the terminal. */
+struct tty_shadow_cell {
+	utf8_char	 data; /* zero if not known */
+	u_short		 attr;
+	u_char		 flags;
+	u_char		 width;
+	int		 fg;
+	int		 bg;
+	int		 us;
+};
+
 struct tty {
 	struct client	*client;
 	struct event	 start_timer;
@@ -1307,11 +1387,22 @@ struct tty {
 	struct event	 timer;
 	size_t		 discarded;
 
+	size_t		 drain_rate;
+	size_t		 drain_bytes;
+	uint64_t	 drain_time;
+	struct timeval	 drain_last;
+	int		 drain_pending;
+
 	struct termios	 tio;
 
 	struct grid_cell cell;
 	struct grid_cell last_cell;
 
+	struct tty_shadow_cell *shadow;
+	u_char		*shadowskip;
+	u_int		 shadowx;
+	u_int		 shadowy;
+
 #define TTY_NOCURSOR 0x1
 #define TTY_FREEZE 0x2
 #define TTY_TIMER 0x4
@@ -1522,7 +1613,11 @@ struct cmd_entry {
 #define STATUS_LINES_LIMIT 5
 struct status_line_entry {
 	char			*expanded;
+	struct format_cache	*cache;
 	struct style_ranges	 ranges;
+
+	u_int			 changedx;
+	u_int			 changednx;
 };
 struct status_line {
 	struct event		 timer;
@@ -1583,6 +1678,8 @@ struct client {
 
 	struct control_state *control_state;
 	u_int		 pause_age;
+	u_int		 coalesce_age;
+	u_int		 coalesce_size;
 
 	pid_t		 pid;
 	int		 fd;
@@ -1610,6 +1707,12 @@ struct client {
 	size_t		 discarded;
 	size_t		 redraw;
 
+	u_int		 writes;
+	size_t		 write_depth;
+	u_int		 blocks;
+	struct timeval	 block_start;
+	struct timeval	 block_time;
+
 	struct event	 repeat_timer;
 
 	struct event	 click_timer;
@@ -1652,6 +1755,9 @@ struct client {
 #define CLIENT_ACTIVEPANE 0x80000000ULL
 #define CLIENT_CONTROL_PAUSEAFTER 0x100000000ULL
 #define CLIENT_CONTROL_WAITEXIT 0x200000000ULL
+#define CLIENT_FIXEDBLOCK 0x400000000ULL
+#define CLIENT_CONTROL_FRAMES 0x800000000ULL
+#define CLIENT_CONTROL_COALESCE 0x1000000000ULL
 #define CLIENT_ALLREDRAWFLAGS		\
 	(CLIENT_REDRAWWINDOW|		\
 	 CLIENT_REDRAWSTATUS|		\
@@ -1953,7 +2059,12 @@ void		 format_add_tv(struct format_tree *, const char *,
 void		 format_add_cb(struct format_tree *, const char *, format_cb);
 void		 format_each(struct format_tree *, void (*)(const char *,
 		     const char *, void *), void *);
+void		 format_memo_start(void);
+void		 format_memo_stop(void);
 char		*format_expand_time(struct format_tree *, const char *);
+char		*format_expand_cached(struct format_tree *, const char *,
+		     struct format_cache **);
+void		 format_free_cache(struct format_cache *);
 char		*format_expand(struct format_tree *, const char *);
 char		*format_single(struct cmdq_item *, const char *,
 		     struct client *, struct session *, struct winlink *,
@@ -2124,6 +2235,7 @@ void	tty_send_requests(struct tty *);
 void	tty_stop_tty(struct tty *);
 void	tty_set_title(struct tty *, const char *);
 void	tty_update_mode(struct tty *, int, struct screen *);
+void	tty_shadow_reset(struct tty *);
 void	tty_draw_line(struct tty *, struct screen *, u_int, u_int, u_int,
 	    u_int, u_int, const struct grid_cell *, int *);
 void	tty_sync_start(struct tty *);
@@ -2543,12 +2655,26 @@ void	 grid_move_lines(struct grid *, u_int, u_int, u_int, u_int);
 void	 grid_move_cells(struct grid *, u_int, u_int, u_int, u_int, u_int);
 char	*grid_string_cells(struct grid *, u_int, u_int, u_int,
 	     struct grid_cell **, int, int, int);
+void	 grid_share_lines(struct grid *, struct grid *, u_int);
+int	 grid_index_check(struct grid *, u_int, const char *, u_int *, u_int *);
+const struct grid_text *grid_get_text(struct grid *, u_int);
+size_t	 grid_text_offset(const struct grid_text *, u_int);
+u_int	 grid_text_cell(const struct grid_text *, size_t);
+size_t	 grid_search_text(struct grid *, u_int, struct grid_search_buffer *);
 void	 grid_duplicate_lines(struct grid *, u_int, struct grid *, u_int,
 	     u_int);
 void	 grid_reflow(struct grid *, u_int);
 void	 grid_wrap_position(struct grid *, u_int, u_int, u_int *, u_int *);
 void	 grid_unwrap_position(struct grid *, u_int *, u_int *, u_int, u_int);
 u_int	 grid_line_length(struct grid *, u_int);
+void	 grid_get_usage(struct grid *, struct grid_usage *);
+
+/* grid-search.c */
+#define GRID_SEARCH_FIRST 0
+#define GRID_SEARCH_LAST 1
+#define GRID_SEARCH_COUNT 2
+u_int	 grid_search_regex(struct grid *, const char *, int, u_int, u_int,
+	     int, u_int, u_int *);
 
 /* grid-view.c */
 void	 grid_view_get_cell(struct grid *, u_int, u_int, struct grid_cell *);
@@ -2632,6 +2758,8 @@ void	 screen_write_collect_end(struct screen_write_ctx *);
 void	 screen_write_collect_add(struct screen_write_ctx *,
 	     const struct grid_cell *);
 void	 screen_write_cell(struct screen_write_ctx *, const struct grid_cell *);
+void	 screen_write_cells(struct screen_write_ctx *, const struct grid_cell *,
+	     const char *, size_t);
 void	 screen_write_setselection(struct screen_write_ctx *, u_char *, u_int);
 void	 screen_write_rawstring(struct screen_write_ctx *, u_char *, u_int);
 void	 screen_write_alternateon(struct screen_write_ctx *,
@@ -2724,6 +2852,8 @@ void		 window_destroy_panes(struct window *);
 struct window_pane *window_pane_find_by_id_str(const char *);
 struct window_pane *window_pane_find_by_id(u_int);
 int		 window_pane_destroy_ready(struct window_pane *);
+void		 window_pane_write_pipe(struct window_pane *);
+void		 window_pane_close_pipe(struct window_pane *);
 void		 window_pane_resize(struct window_pane *, u_int, u_int);
 void		 window_pane_set_palette(struct window_pane *, u_int, int);
 void		 window_pane_unset_palette(struct window_pane *, u_int);
@@ -2878,11 +3008,14 @@ void	control_set_pane_on(struct client *, struct window_pane *);
 void	control_set_pane_off(struct client *, struct window_pane *);
 void	control_continue_pane(struct client *, struct window_pane *);
 void	control_pause_pane(struct client *, struct window_pane *);
+void	control_overflow_pane(struct client *, struct window_pane *, size_t);
 struct window_pane_offset *control_pane_offset(struct client *,
 	   struct window_pane *, int *);
 void	control_reset_offsets(struct client *);
 void printflike(2, 3) control_write(struct client *, const char *, ...);
 void	control_write_output(struct client *, struct window_pane *);
+void	control_escape(struct evbuffer *, const u_char *, size_t);
+void	control_free_output(void);
 int	control_all_done(struct client *);
 void	control_add_sub(struct client *, const char *, enum control_sub_type,
     	   int, const char *);
@@ -34,6 +34,9 @@
 
 static int	tty_log_fd = -1;
 
+/* Shortest run of unchanged cells worth moving the cursor over. */
+#define TTY_SHADOW_GAP 8
+
 static int	tty_client_ready(struct client *);
 
 static void	tty_set_italics(struct tty *);
@@ -67,6 +70,8 @@ static void	tty_repeat_space(struct tty *, u_int);
 static void	tty_draw_pane(struct tty *, const struct tty_ctx *, u_int);
 static void	tty_default_attributes(struct tty *, const struct grid_cell *,
 		    int *, u_int);
+static void	tty_shadow_clear(struct tty *, u_int, u_int, u_int, u_int);
+static void	tty_shadow_written(struct tty *, u_int);
 
 #define tty_use_margin(tty) \
 	(tty->term->flags & TERM_DECSLRM)
@@ -77,6 +82,18 @@ static void	tty_default_attributes(struct tty *, const struct grid_cell *,
 #define TTY_BLOCK_START(tty) (1 + ((tty)->sx * (tty)->sy) * 8)
 #define TTY_BLOCK_STOP(tty) (1 + ((tty)->sx * (tty)->sy) / 8)
 
+/*
+ * Limits when the rate the client drains output is known. The interval is
+ * long enough to drain a full redraw at that rate.
+ */
+#define TTY_BLOCK_MIN_INTERVAL (20000 /* 20 milliseconds */)
+#define TTY_BLOCK_MAX_INTERVAL (1000000 /* 1 second */)
+#define TTY_BLOCK_MIN_START(tty) (1 + ((tty)->sx * (tty)->sy) * 2)
+#define TTY_BLOCK_MAX_START(tty) (1 + ((tty)->sx * (tty)->sy) * 64)
+
+/* Time over which to measure the drain rate. */
+#define TTY_DRAIN_PERIOD (250000 /* 250 milliseconds */)
+
 void
 tty_create_log(void)
 {
@@ -172,20 +189,127 @@ tty_read_callback(__unused int fd, __unused short events, void *data)
 		;
 }
 
+static void
+tty_block_stop(struct tty *tty)
+{
+	struct client	*c = tty->client;
+	struct timeval	 tv;
+
+	if (~tty->flags & TTY_BLOCK)
+		return;
+	tty->flags &= ~TTY_BLOCK;
+
+	gettimeofday(&tv, NULL);
+	timersub(&tv, &c->block_start, &tv);
+	timeradd(&c->block_time, &tv, &c->block_time);
+}
+
+/*
+ * Measure how fast the client takes output. Only the time when there was still
+ * output waiting after the last write is counted, otherwise this would be the
+ * rate output is produced rather than the rate the client can take it.
+ */
+static void
+tty_drain_update(struct tty *tty, size_t written)
+{
+	struct client	*c = tty->client;
+	struct timeval	 tv, now;
+	size_t		 rate;
+
+	gettimeofday(&now, NULL);
+	if (tty->drain_pending) {
+		timersub(&now, &tty->drain_last, &tv);
+		tty->drain_time += tv.tv_sec * 1000000ULL + tv.tv_usec;
+		tty->drain_bytes += written;
+	}
+	memcpy(&tty->drain_last, &now, sizeof tty->drain_last);
+	tty->drain_pending = (EVBUFFER_LENGTH(tty->out) != 0);
+
+	if (tty->drain_time < TTY_DRAIN_PERIOD)
+		return;
+	rate = (tty->drain_bytes * 1000000ULL) / tty->drain_time;
+	if (tty->drain_rate == 0)
+		tty->drain_rate = rate;
+	else
+		tty->drain_rate = (tty->drain_rate * 3 + rate) / 4;
+	log_debug("%s: drain rate %zu (measured %zu)", c->name,
+	    tty->drain_rate, rate);
+
+	tty->drain_bytes = 0;
+	tty->drain_time = 0;
+}
+
+/* Bytes waiting to be written when output starts to be discarded. */
+static size_t
+tty_block_start_size(struct tty *tty)
+{
+	size_t	size;
+
+	if ((tty->client->flags & CLIENT_FIXEDBLOCK) || tty->drain_rate == 0)
+		return (TTY_BLOCK_START(tty));
+
+	/* No more than one interval of output. */
+	size = tty->drain_rate / (1000000 / TTY_BLOCK_INTERVAL);
+	if (size < TTY_BLOCK_MIN_START(tty))
+		return (TTY_BLOCK_MIN_START(tty));
+	if (size > TTY_BLOCK_MAX_START(tty))
+		return (TTY_BLOCK_MAX_START(tty));
+	return (size);
+}
+
+/* Time between checks if output should still be discarded. */
+static void
+tty_block_interval(struct tty *tty, struct timeval *tv)
+{
+	uint64_t	usec;
+
+	if ((tty->client->flags & CLIENT_FIXEDBLOCK) || tty->drain_rate == 0)
+		usec = TTY_BLOCK_INTERVAL;
+	else {
+		usec = (TTY_BLOCK_START(tty) * 1000000ULL) / tty->drain_rate;
+		if (usec < TTY_BLOCK_MIN_INTERVAL)
+			usec = TTY_BLOCK_MIN_INTERVAL;
+		if (usec > TTY_BLOCK_MAX_INTERVAL)
+			usec = TTY_BLOCK_MAX_INTERVAL;
+	}
+	tv->tv_sec = usec / 1000000;
+	tv->tv_usec = usec % 1000000;
+}
+
+/*
+ * Discarded bytes in an interval below which output is no longer discarded:
+ * half what the client could have taken in that time.
+ */
+static size_t
+tty_block_stop_size(struct tty *tty, struct timeval *tv)
+{
+	size_t	size;
+
+	if ((tty->client->flags & CLIENT_FIXEDBLOCK) || tty->drain_rate == 0)
+		return (TTY_BLOCK_STOP(tty));
+
+	size = (tty->drain_rate * (tv->tv_sec * 1000000ULL + tv->tv_usec)) /
+	    2000000;
+	if (size < TTY_BLOCK_STOP(tty))
+		return (TTY_BLOCK_STOP(tty));
+	return (size);
+}
+
 static void
 tty_timer_callback(__unused int fd, __unused short events, void *data)
 {
 	struct tty	*tty = data;
 	struct client	*c = tty->client;
-	struct timeval	 tv = { .tv_usec = TTY_BLOCK_INTERVAL };
+	struct timeval	 tv;
 
 	log_debug("%s: %zu discarded", c->name, tty->discarded);
 
 	c->flags |= CLIENT_ALLREDRAWFLAGS;
 	c->discarded += tty->discarded;
 
-	if (tty->discarded < TTY_BLOCK_STOP(tty)) {
-		tty->flags &= ~TTY_BLOCK;
+	tty_block_interval(tty, &tv);
+	if (tty->discarded < tty_block_stop_size(tty, &tv)) {
+		tty_block_stop(tty);
 		tty_invalidate(tty);
 		return;
 	}
@@ -198,21 +322,25 @@ tty_block_maybe(struct tty *tty)
 {
 	struct client	*c = tty->client;
 	size_t		 size = EVBUFFER_LENGTH(tty->out);
-	struct timeval	 tv = { .tv_usec = TTY_BLOCK_INTERVAL };
+	struct timeval	 tv;
 
-	if (size < TTY_BLOCK_START(tty))
+	if (size < tty_block_start_size(tty))
 		return (0);
 
 	if (tty->flags & TTY_BLOCK)
 		return (1);
 	tty->flags |= TTY_BLOCK;
+	c->blocks++;
+	gettimeofday(&c->block_start, NULL);
 
 	log_debug("%s: can't keep up, %zu discarded", c->name, size);
 
 	evbuffer_drain(tty->out, size);
 	c->discarded += size;
+	tty->drain_pending = 0;
 
 	tty->discarded = 0;
+	tty_block_interval(tty, &tv);
 	evtimer_add(&tty->timer, &tv);
 	return (1);
 }
@@ -226,9 +354,12 @@ tty_write_callback(__unused int fd, __unused short events, void *data)
 	int		 nwrite;
 
 	nwrite = evbuffer_write(tty->out, c->fd);
+	c->writes++;
+	c->write_depth += size;
 	if (nwrite == -1)
 		return;
 	log_debug("%s: wrote %d bytes (of %zu)", c->name, nwrite, size);
+	tty_drain_update(tty, nwrite);
 
 	if (c->redraw > 0) {
 		if ((size_t)nwrite >= c->redraw)
@@ -371,7 +502,7 @@ tty_stop_tty(struct tty *tty)
 	evtimer_del(&tty->start_timer);
 
 	event_del(&tty->timer);
-	tty->flags &= ~TTY_BLOCK;
+	tty_block_stop(tty);
 
 	event_del(&tty->event_in);
 	event_del(&tty->event_out);
@@ -446,6 +577,8 @@ tty_free(struct tty *tty)
 {
 	tty_close(tty);
 	free(tty->ccolour);
+	free(tty->shadow);
+	free(tty->shadowskip);
 }
 
 void
@@ -455,6 +588,7 @@ tty_update_features(struct tty *tty)
 
 	if (tty_apply_features(tty->term, c->term_features))
 		tty_term_apply_overrides(tty->term);
+	tty_shadow_reset(tty);
 
 	if (tty_use_margin(tty))
 		tty_putcode(tty, TTYC_ENMG);
@@ -570,6 +704,9 @@ tty_putc(struct tty *tty, u_char ch)
 	    tty->cx + 1 >= tty->sx)
 		return;
 
+	if (ch >= 0x20 && ch != 0x7f)
+		tty_shadow_written(tty, 1);
+
 	if (tty->cell.attr & GRID_ATTR_CHARSET) {
 		acs = tty_acs_get(tty, ch);
 		if (acs != NULL)
@@ -605,6 +742,7 @@ tty_putn(struct tty *tty, const void *buf, size_t len, u_int width)
 	    tty->cx + len >= tty->sx)
 		len = tty->sx - tty->cx - 1;
 
+	tty_shadow_written(tty, width);
 	tty_add(tty, buf, len);
 	if (tty->cx + width > tty->sx) {
 		tty->cx = (tty->cx + width) - tty->sx;
@@ -1021,6 +1159,7 @@ tty_clear_line(struct tty *tty, const struct grid_cell *defaults, u_int py,
 	/* Nothing to clear. */
 	if (nx == 0)
 		return;
+	tty_shadow_clear(tty, px, py, nx, 1);
 
 	/* If genuine BCE is available, can try escape sequences. */
 	if (!tty_fake_bce(tty, defaults, bg)) {
@@ -1141,6 +1280,7 @@ tty_clear_area(struct tty *tty, const struct grid_cell *defaults, u_int py,
 	/* Nothing to clear. */
 	if (nx == 0 || ny == 0)
 		return;
+	tty_shadow_clear(tty, px, py, nx, ny);
 
 	/* If genuine BCE is available, can try escape sequences. */
 	if (!tty_fake_bce(tty, defaults, bg)) {
@@ -1270,6 +1410,216 @@ tty_check_overlay(struct tty *tty, u_int px, u_int py)
 	return (c->overlay_check(c, px, py));
 }
 
+/*
+ * The shadow is a copy of what each cell on the terminal is known to contain,
+ * so tty_draw_line can skip cells that are not changing. Anything else that
+ * writes to the terminal marks the cells it touches as not known.
+ */
+
+/* Make sure the shadow is the same size as the terminal. */
+static void
+tty_shadow_check(struct tty *tty)
+{
+	if (tty->shadow != NULL &&
+	    tty->shadowx == tty->sx &&
+	    tty->shadowy == tty->sy)
+		return;
+
+	free(tty->shadow);
+	tty->shadow = xcalloc(tty->sx * tty->sy, sizeof *tty->shadow);
+	free(tty->shadowskip);
+	tty->shadowskip = xmalloc(tty->sx);
+	tty->shadowx = tty->sx;
+	tty->shadowy = tty->sy;
+}
+
+/* Forget the contents of the entire terminal. */
+void
+tty_shadow_reset(struct tty *tty)
+{
+	if (tty->shadow != NULL) {
+		memset(tty->shadow, 0, tty->shadowx * tty->shadowy *
+		    sizeof *tty->shadow);
+	}
+}
+
+/* Forget the contents of an area of the terminal. */
+static void
+tty_shadow_clear(struct tty *tty, u_int px, u_int py, u_int nx, u_int ny)
+{
+	u_int	yy;
+
+	if (tty->shadow == NULL || px >= tty->shadowx || py >= tty->shadowy)
+		return;
+	if (nx > tty->shadowx - px)
+		nx = tty->shadowx - px;
+	if (ny > tty->shadowy - py)
+		ny = tty->shadowy - py;
+
+	for (yy = py; yy < py + ny; yy++) {
+		memset(&tty->shadow[yy * tty->shadowx + px], 0,
+		    nx * sizeof *tty->shadow);
+	}
+}
+
+/* Forget cells about to be written at the cursor. */
+static void
+tty_shadow_written(struct tty *tty, u_int width)
+{
+	u_int	x = tty->cx, y = tty->cy;
+
+	if (tty->shadow == NULL)
+		return;
+
+	if (x != UINT_MAX && x >= tty->sx && y != tty->rlower) {
+		x = 0;
+		y++;
+	}
+	if (x >= tty->sx || y >= tty->sy || x + width > tty->sx) {
+		tty_shadow_reset(tty);
+		return;
+	}
+	tty_shadow_clear(tty, x, y, width, 1);
+}
+
+/* Work out what a cell will look like on the terminal. */
+static void
+tty_shadow_make(struct tty *tty, struct screen *s, const struct grid_cell *gc,
+    const struct grid_cell *defaults, int *palette, struct tty_shadow_cell *sc)
+{
+	struct grid_cell	gc2;
+
+	if (gc->flags & GRID_FLAG_SELECTED)
+		screen_select_cell(s, &gc2, gc);
+	else
+		memcpy(&gc2, gc, sizeof gc2);
+	if (gc2.fg == 8)
+		gc2.fg = defaults->fg;
+	if (gc2.bg == 8)
+		gc2.bg = defaults->bg;
+	tty_check_fg(tty, palette, &gc2);
+	tty_check_bg(tty, palette, &gc2);
+	tty_check_us(tty, palette, &gc2);
+
+	sc->flags = 0;
+	sc->width = 1;
+	sc->bg = gc2.bg;
+	if (gc->flags & GRID_FLAG_CLEARED) {
+		sc->data = utf8_build_one(' ');
+		sc->attr = 0;
+		sc->fg = 8;
+		sc->us = 0;
+		return;
+	}
+	if (gc2.data.size == 1)
+		sc->data = utf8_build_one(gc2.data.data[0]);
+	else if (utf8_from_data(&gc2.data, &sc->data) != UTF8_DONE)
+		sc->data = 0;
+	sc->width = gc2.data.width;
+	sc->attr = gc2.attr;
+	sc->fg = gc2.fg;
+	sc->us = gc2.us;
+}
+
+/* Is this cell already on the terminal? */
+static int
+tty_shadow_same(struct tty *tty, u_int px, u_int py,
+    const struct tty_shadow_cell *sc)
+{
+	struct tty_shadow_cell	*tc;
+
+	if (sc->data == 0 || px >= tty->shadowx || py >= tty->shadowy)
+		return (0);
+	tc = &tty->shadow[py * tty->shadowx + px];
+	return (tc->data == sc->data &&
+	    tc->flags == sc->flags &&
+	    tc->attr == sc->attr &&
+	    tc->fg == sc->fg &&
+	    tc->bg == sc->bg &&
+	    tc->us == sc->us);
+}
+
+/*
+ * Work out which cells of a line are already on the terminal. Short runs of
+ * unchanged cells between changed cells are drawn anyway, because moving the
+ * cursor over them costs more than writing them.
+ */
+static int
+tty_shadow_line(struct tty *tty, struct screen *s, u_int px, u_int py,
+    u_int sx, u_int nx, u_int atx, u_int aty, const struct grid_cell *defaults,
+    int *palette)
+{
+	struct tty_shadow_cell	*line, sc;
+	struct grid_cell	 gc;
+	const struct grid_cell	*gcp;
+	u_char			*skip = tty->shadowskip;
+	u_int			 i, j;
+
+	if (atx >= tty->sx || aty >= tty->sy)
+		return (0);
+	line = &tty->shadow[aty * tty->shadowx + atx];
+	for (i = 0; i < sx && atx + i < tty->sx; i++) {
+		if (line[i].data != 0)
+			break;
+	}
+	if (i == sx || atx + i == tty->sx)
+		return (0);
+
+	for (i = 0; i < sx; i++) {
+		grid_view_get_cell(s->grid, px + i, py, &gc);
+		gcp = tty_check_codeset(tty, &gc);
+		if (gcp->flags & GRID_FLAG_PADDING)
+			skip[i] = (i != 0 && skip[i - 1]);
+		else if (i + gcp->data.width > nx)
+			skip[i] = 0;
+		else {
+			tty_shadow_make(tty, s, gcp, defaults, palette, &sc);
+			skip[i] = tty_shadow_same(tty, atx + i, aty, &sc);
+		}
+	}
+
+	for (i = 0; i < sx; i = j) {
+		if (!skip[i]) {
+			j = i + 1;
+			continue;
+		}
+		for (j = i; j < sx && skip[j]; j++)
+			/* nothing */;
+		if (i != 0 && j != sx && j - i < TTY_SHADOW_GAP)
+			memset(skip + i, 0, j - i);
+	}
+	return (1);
+}
+
+/* Record cells written to the terminal. */
+static void
+tty_shadow_set(struct tty *tty, u_int px, u_int py,
+    const struct tty_shadow_cell *sc, u_int n)
+{
+	struct tty_shadow_cell	*tc;
+	u_int			 i, j, width;
+
+	if (py >= tty->shadowy)
+		return;
+	for (i = 0; i < n; i++) {
+		width = sc[i].width;
+		if (px + width > tty->shadowx)
+			break;
+		if ((tty->term->flags & TERM_NOAM) &&
+		    py == tty->sy - 1 &&
+		    px + width >= tty->sx)
+			break;
+
+		tc = &tty->shadow[py * tty->shadowx + px];
+		memcpy(tc, &sc[i], sizeof *tc);
+		for (j = 1; j < width; j++) {
+			memcpy(&tc[j], &sc[i], sizeof *tc);
+			tc[j].flags |= GRID_FLAG_PADDING;
+		}
+		px += width;
+	}
+}
+
 void
 tty_draw_line(struct tty *tty, struct screen *s, u_int px, u_int py, u_int nx,
     u_int atx, u_int aty, const struct grid_cell *defaults, int *palette)
@@ -1279,10 +1629,11 @@ tty_draw_line(struct tty *tty, struct screen *s, u_int px, u_int py, u_int nx,
 	const struct grid_cell	*gcp;
 	struct grid_line	*gl;
 	u_int			 i, j, ux, sx, width;
-	int			 flags, cleared = 0, wrapped = 0;
+	int			 flags, cleared = 0, wrapped = 0, skip, same;
 	char			 buf[512];
 	size_t			 len;
-	u_int			 cellsize;
+	u_int			 cellsize, nrun;
+	struct tty_shadow_cell	 run[sizeof buf], sc, blank;
 
 	log_debug("%s: px=%u py=%u nx=%u atx=%u aty=%u", __func__,
 	    px, py, nx, atx, aty);
@@ -1300,6 +1651,11 @@ tty_draw_line(struct tty *tty, struct screen *s, u_int px, u_int py, u_int nx,
 	tty_region_off(tty);
 	tty_margin_off(tty);
 
+	tty_shadow_check(tty);
+	memcpy(&gc, &grid_default_cell, sizeof gc);
+	gc.flags |= GRID_FLAG_CLEARED;
+	tty_shadow_make(tty, s, &gc, defaults, palette, &blank);
+
 	/*
 	 * Clamp the width to cellsize - note this is not cellused, because
 	 * there may be empty background cells after it (from BCE).
@@ -1328,11 +1684,15 @@ tty_draw_line(struct tty *tty, struct screen *s, u_int px, u_int py, u_int nx,
 		if (nx < tty->sx &&
 		    atx == 0 &&
 		    px + sx != nx &&
+		    aty < tty->sy &&
+		    tty->shadow[aty * tty->sx].data == 0 &&
 		    tty_term_has(tty->term, TTYC_EL1) &&
 		    !tty_fake_bce(tty, defaults, 8)) {
 			tty_default_attributes(tty, defaults, palette, 8);
 			tty_cursor(tty, nx - 1, aty);
 			tty_putcode(tty, TTYC_EL1);
+			for (i = 0; i < nx; i++)
+				tty_shadow_set(tty, i, aty, &blank, 1);
 			cleared = 1;
 		}
 	} else {
@@ -1343,12 +1703,26 @@ tty_draw_line(struct tty *tty, struct screen *s, u_int px, u_int py, u_int nx,
 	memcpy(&last, &grid_default_cell, sizeof last);
 	len = 0;
 	width = 0;
+	nrun = 0;
+
+	skip = tty_shadow_line(tty, s, px, py, sx, nx, atx, aty, defaults,
+	    palette);
 
 	for (i = 0; i < sx; i++) {
 		grid_view_get_cell(gd, px + i, py, &gc);
 		gcp = tty_check_codeset(tty, &gc);
+		if (gcp->flags & GRID_FLAG_PADDING)
+			same = 0;
+		else {
+			same = (skip && tty->shadowskip[i]);
+			if (!same) {
+				tty_shadow_make(tty, s, gcp, defaults, palette,
+				    &sc);
+			}
+		}
 		if (len != 0 &&
 		    (!tty_check_overlay(tty, atx + ux + width, aty) ||
+		    same ||
 		    (gcp->attr & GRID_ATTR_CHARSET) ||
 		    gcp->flags != last.flags ||
 		    gcp->attr != last.attr ||
@@ -1367,10 +1741,12 @@ tty_draw_line(struct tty *tty, struct screen *s, u_int px, u_int py, u_int nx,
 					tty_cursor(tty, atx + ux, aty);
 				tty_putn(tty, buf, len, width);
 			}
+			tty_shadow_set(tty, atx + ux, aty, run, nrun);
 			ux += width;
 
 			len = 0;
 			width = 0;
+			nrun = 0;
 			wrapped = 0;
 		}
 
@@ -1378,7 +1754,7 @@ tty_draw_line(struct tty *tty, struct screen *s, u_int px, u_int py, u_int nx,
 			screen_select_cell(s, &last, gcp);
 		else
 			memcpy(&last, gcp, sizeof last);
-		if (!tty_check_overlay(tty, atx + ux, aty)) {
+		if (same || !tty_check_overlay(tty, atx + ux, aty)) {
 			if (~gcp->flags & GRID_FLAG_PADDING)
 				ux += gcp->data.width;
 		} else if (ux + gcp->data.width > nx) {
@@ -1395,11 +1771,13 @@ tty_draw_line(struct tty *tty, struct screen *s, u_int px, u_int py, u_int nx,
 			tty_cursor(tty, atx + ux, aty);
 			for (j = 0; j < gcp->data.size; j++)
 				tty_putc(tty, gcp->data.data[j]);
+			tty_shadow_set(tty, atx + ux, aty, &sc, 1);
 			ux += gcp->data.width;
 		} else if (~gcp->flags & GRID_FLAG_PADDING) {
 			memcpy(buf + len, gcp->data.data, gcp->data.size);
 			len += gcp->data.size;
 			width += gcp->data.width;
+			memcpy(&run[nrun++], &sc, sizeof run[0]);
 		}
 	}
 	if (len != 0 && ((~last.flags & GRID_FLAG_CLEARED) || last.bg != 8)) {
@@ -1413,14 +1791,24 @@ tty_draw_line(struct tty *tty, struct screen *s, u_int px, u_int py, u_int nx,
 				tty_cursor(tty, atx + ux, aty);
 			tty_putn(tty, buf, len, width);
 		}
+		tty_shadow_set(tty, atx + ux, aty, run, nrun);
 		ux += width;
 	}
 
 	if (!cleared && ux < nx) {
-		log_debug("%s: %u to end of line (%zu cleared)", __func__,
-		    nx - ux, len);
-		tty_default_attributes(tty, defaults, palette, 8);
-		tty_clear_line(tty, defaults, aty, atx + ux, nx - ux, 8);
+		for (i = ux; i < nx; i++) {
+			if (!tty_shadow_same(tty, atx + i, aty, &blank))
+				break;
+		}
+		if (i != nx) {
+			log_debug("%s: %u to end of line (%zu cleared)",
+			    __func__, nx - ux, len);
+			tty_default_attributes(tty, defaults, palette, 8);
+			tty_clear_line(tty, defaults, aty, atx + ux, nx - ux,
+			    8);
+			for (i = ux; i < nx; i++)
+				tty_shadow_set(tty, atx + i, aty, &blank, 1);
+		}
 	}
 
 	tty->flags = (tty->flags & ~TTY_NOCURSOR) | flags;
@@ -1505,6 +1893,7 @@ tty_cmd_insertcharacter(struct tty *tty, const struct tty_ctx *ctx)
 	tty_default_attributes(tty, &ctx->defaults, ctx->palette, ctx->bg);
 
 	tty_cursor_pane(tty, ctx, ctx->ocx, ctx->ocy);
+	tty_shadow_clear(tty, 0, tty->cy, tty->sx, 1);
 
 	tty_emulate_repeat(tty, TTYC_ICH, TTYC_ICH1, ctx->num);
 }
@@ -1524,6 +1913,7 @@ tty_cmd_deletecharacter(struct tty *tty, const struct tty_ctx *ctx)
 	tty_default_attributes(tty, &ctx->defaults, ctx->palette, ctx->bg);
 
 	tty_cursor_pane(tty, ctx, ctx->ocx, ctx->ocy);
+	tty_shadow_clear(tty, 0, tty->cy, tty->sx, 1);
 
 	tty_emulate_repeat(tty, TTYC_DCH, TTYC_DCH1, ctx->num);
 }
@@ -1541,9 +1931,10 @@ tty_cmd_clearcharacter(struct tty *tty, const struct tty_ctx *ctx)
 	tty_cursor_pane(tty, ctx, ctx->ocx, ctx->ocy);
 
 	if (tty_term_has(tty->term, TTYC_ECH) &&
-	    !tty_fake_bce(tty, &ctx->defaults, 8))
+	    !tty_fake_bce(tty, &ctx->defaults, 8)) {
+		tty_shadow_clear(tty, tty->cx, tty->cy, ctx->num, 1);
 		tty_putcode1(tty, TTYC_ECH, ctx->num);
-	else
+	} else
 		tty_repeat_space(tty, ctx->num);
 }
 
@@ -1566,6 +1957,8 @@ tty_cmd_insertline(struct tty *tty, const struct tty_ctx *ctx)
 	tty_region_pane(tty, ctx, ctx->orupper, ctx->orlower);
 	tty_margin_off(tty);
 	tty_cursor_pane(tty, ctx, ctx->ocx, ctx->ocy);
+	tty_shadow_clear(tty, 0, tty->rupper, tty->sx,
+	    tty->rlower - tty->rupper + 1);
 
 	tty_emulate_repeat(tty, TTYC_IL, TTYC_IL1, ctx->num);
 	tty->cx = tty->cy = UINT_MAX;
@@ -1590,6 +1983,8 @@ tty_cmd_deleteline(struct tty *tty, const struct tty_ctx *ctx)
 	tty_region_pane(tty, ctx, ctx->orupper, ctx->orlower);
 	tty_margin_off(tty);
 	tty_cursor_pane(tty, ctx, ctx->ocx, ctx->ocy);
+	tty_shadow_clear(tty, 0, tty->rupper, tty->sx,
+	    tty->rlower - tty->rupper + 1);
 
 	tty_emulate_repeat(tty, TTYC_DL, TTYC_DL1, ctx->num);
 	tty->cx = tty->cy = UINT_MAX;
@@ -1644,6 +2039,8 @@ tty_cmd_reverseindex(struct tty *tty, const struct tty_ctx *ctx)
 	tty_region_pane(tty, ctx, ctx->orupper, ctx->orlower);
 	tty_margin_pane(tty, ctx);
 	tty_cursor_pane(tty, ctx, ctx->ocx, ctx->orupper);
+	tty_shadow_clear(tty, 0, tty->rupper, tty->sx,
+	    tty->rlower - tty->rupper + 1);
 
 	if (tty_term_has(tty->term, TTYC_RI))
 		tty_putcode(tty, TTYC_RI);
@@ -1686,6 +2083,8 @@ tty_cmd_linefeed(struct tty *tty, const struct tty_ctx *ctx)
 			tty_cursor(tty, tty->rright, ctx->yoff + ctx->ocy);
 	} else
 		tty_cursor_pane(tty, ctx, ctx->ocx, ctx->ocy);
+	tty_shadow_clear(tty, 0, tty->rupper, tty->sx,
+	    tty->rlower - tty->rupper + 1);
 
 	tty_putc(tty, '\n');
 }
@@ -1709,6 +2108,8 @@ tty_cmd_scrollup(struct tty *tty, const struct tty_ctx *ctx)
 
 	tty_region_pane(tty, ctx, ctx->orupper, ctx->orlower);
 	tty_margin_pane(tty, ctx);
+	tty_shadow_clear(tty, 0, tty->rupper, tty->sx,
+	    tty->rlower - tty->rupper + 1);
 
 	if (ctx->num == 1 || !tty_term_has(tty->term, TTYC_INDN)) {
 		if (!tty_use_margin(tty))
@@ -1748,6 +2149,8 @@ tty_cmd_scrolldown(struct tty *tty, const struct tty_ctx *ctx)
 	tty_region_pane(tty, ctx, ctx->orupper, ctx->orlower);
 	tty_margin_pane(tty, ctx);
 	tty_cursor_pane(tty, ctx, ctx->ocx, ctx->orupper);
+	tty_shadow_clear(tty, 0, tty->rupper, tty->sx,
+	    tty->rlower - tty->rupper + 1);
 
 	if (tty_term_has(tty->term, TTYC_RIN))
 		tty_putcode1(tty, TTYC_RIN, ctx->num);
@@ -1987,6 +2390,8 @@ tty_invalidate(struct tty *tty)
 	tty->rupper = tty->rleft = UINT_MAX;
 	tty->rlower = tty->rright = UINT_MAX;
 
+	tty_shadow_reset(tty);
+
 	if (tty->flags & TTY_STARTED) {
 		if (tty_use_margin(tty))
 			tty_putcode(tty, TTYC_ENMG);
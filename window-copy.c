@@ -55,21 +55,22 @@ static void	window_copy_write_lines(struct window_mode_entry *,
 static char    *window_copy_match_at_cursor(struct window_copy_mode_data *);
 static void	window_copy_scroll_to(struct window_mode_entry *, u_int, u_int,
 		    int);
-static int	window_copy_search_compare(struct grid *, u_int, u_int,
-		    struct grid *, u_int, int);
-static int	window_copy_search_lr(struct grid *, struct grid *, u_int *,
+static int	window_copy_search_lr(struct grid *, const char *, u_int *,
 		    u_int, u_int, u_int, int);
-static int	window_copy_search_rl(struct grid *, struct grid *, u_int *,
+static int	window_copy_search_rl(struct grid *, const char *, u_int *,
 		    u_int, u_int, u_int, int);
 static int	window_copy_last_regex(struct grid *, u_int, u_int, u_int,
-		    u_int, u_int *, u_int *, const char *, const regex_t *,
-		    int);
+		    u_int *, u_int *, const char *, const regex_t *, int);
 static char    *window_copy_stringify(struct grid *, u_int, u_int, u_int,
 		    char *, u_int *);
-static void	window_copy_cstrtocellpos(struct grid *, u_int, u_int *,
-		    u_int *, const char *);
+static char    *window_copy_stringify_wrapped(struct grid *, u_int, char *,
+		    u_int *);
+static void	window_copy_cstrtocellpos(struct grid *, u_int *, u_int *,
+		    size_t);
 static int	window_copy_search_marks(struct window_mode_entry *,
 		    struct screen *, int, int);
+static void	window_copy_search_count(struct window_mode_entry *);
+static void	window_copy_search_stop(struct window_mode_entry *);
 static void	window_copy_clear_marks(struct window_mode_entry *);
 static void	window_copy_move_left(struct screen *, u_int *, u_int *, int);
 static int	window_copy_is_lowercase(const char *);
@@ -194,6 +195,35 @@ struct window_copy_cmd_state {
 	struct winlink			*wl;
 };
 
+/*
+ * Search for marking matches. Matches in the whole grid are counted a slice at
+ * a time from a timer so a long history does not block the server.
+ */
+struct window_copy_search {
+	int			 regex;
+	regex_t			 reg;
+	char			*pattern;
+	int			 cflags;
+	char			*text;
+	int			 cis;
+	u_int			 width;
+
+	u_int			 first;	/* lines skipped using the index */
+	u_int			 last;
+
+	u_int			 py;	/* next line to count */
+	u_int			 end;
+	u_int			 nfound;
+
+	int			 track;	/* look for the match at the cursor */
+	u_int			 cx;
+	u_int			 cy;
+	int			 which;
+
+	struct event		 timer;
+	uint64_t		 drawn;	/* when progress was last drawn */
+};
+
 /*
  * Copy mode's visible screen (the "screen" field) is filled from one of two
  * sources: the original contents of the pane (used when we actually enter via
@@ -273,6 +303,7 @@ struct window_copy_mode_data {
 	int		 searchcount;
 	int		 searchmore;
 	int		 searchthis;
+	struct window_copy_search *searchall; /* counting matches */
 	int		 searchx;
 	int		 searchy;
 	int		 searcho;
@@ -280,7 +311,9 @@ struct window_copy_mode_data {
 
 	int		 timeout;	/* search has timed out */
 #define WINDOW_COPY_SEARCH_TIMEOUT 10000
-#define WINDOW_COPY_SEARCH_ALL_TIMEOUT 200
+#define WINDOW_COPY_SEARCH_ALL_SLICE 5
+#define WINDOW_COPY_SEARCH_ALL_REDRAW 100
+#define WINDOW_COPY_SEARCH_ALL_LINES 256
 
 	int		 jumptype;
 	char		 jumpchar;
@@ -313,6 +346,25 @@ window_copy_scroll_timer(__unused int fd, __unused short events, void *arg)
 	}
 }
 
+static void
+window_copy_search_timer(__unused int fd, __unused short events, void *arg)
+{
+	struct window_mode_entry	*wme = arg;
+	struct window_copy_mode_data	*data = wme->data;
+	struct window_copy_search	*all;
+	uint64_t			 t;
+
+	window_copy_search_count(wme);
+	if ((all = data->searchall) != NULL) {
+		t = get_timer();
+		if (t - all->drawn < WINDOW_COPY_SEARCH_ALL_REDRAW)
+			return;
+		all->drawn = t;
+	}
+	if (TAILQ_FIRST(&wme->wp->modes) == wme && data->searchmark != NULL)
+		window_copy_redraw_lines(wme, 0, 1);
+}
+
 static struct screen *
 window_copy_clone_screen(struct screen *src, struct screen *hint, u_int *cx,
     u_int *cy, int trim)
@@ -340,10 +392,11 @@ window_copy_clone_screen(struct screen *src, struct screen *hint, u_int *cx,
 
 	/*
 	 * Ensure history is on for the backing grid so lines are not deleted
-	 * during resizing.
+	 * during resizing. The lines are shared with the source grid, and only
+	 * copied when either grid changes them.
 	 */
 	dst->grid->flags |= GRID_HISTORY;
-	grid_duplicate_lines(dst->grid, 0, src->grid, 0, sy);
+	grid_share_lines(dst->grid, src->grid, sy);
 
 	dst->grid->sy = sy - screen_hsize(src);
 	dst->grid->hsize = screen_hsize(src);
@@ -476,6 +529,7 @@ window_copy_free(struct window_mode_entry *wme)
 	struct window_copy_mode_data	*data = wme->data;
 
 	evtimer_del(&data->dragtimer);
+	window_copy_search_stop(wme);
 
 	free(data->searchmark);
 	free(data->searchstr);
@@ -1366,7 +1420,7 @@ window_copy_cmd_next_matching_bracket(struct window_copy_cmd_state *cs)
 	u_int				 px, py, xx, yy, sx, sy, n;
 	struct grid_cell		 gc;
 	int				 failed;
-	struct grid_line		*gl;
+	const struct grid_line		*gl;
 
 	for (; np != 0; np--) {
 		/* Get cursor position and line length. */
@@ -1429,7 +1483,7 @@ window_copy_cmd_next_matching_bracket(struct window_copy_cmd_state *cs)
 			if (px > xx) {
 				if (py == yy)
 					continue;
-				gl = grid_get_line(s->grid, py);
+				gl = grid_peek_line(s->grid, py);
 				if (~gl->flags & GRID_LINE_WRAPPED)
 					continue;
 				if (gl->cellsize > s->grid->sx)
@@ -2338,6 +2392,10 @@ window_copy_command(struct window_mode_entry *wme, struct client *c,
 			data->searchthis = -1;
 			action = WINDOW_COPY_CMD_REDRAW;
 		}
+		if (data->searchall != NULL) {
+			data->searchall->track = 0;
+			data->searchall->which = -1;
+		}
 		if (action == WINDOW_COPY_CMD_NOTHING)
 			action = WINDOW_COPY_CMD_REDRAW;
 	}
@@ -2383,99 +2441,85 @@ window_copy_scroll_to(struct window_mode_entry *wme, u_int px, u_int py,
 		window_copy_redraw_screen(wme);
 }
 
-static int
-window_copy_search_compare(struct grid *gd, u_int px, u_int py,
-    struct grid *sgd, u_int spx, int cis)
+/*
+ * Stringify a line from first and any lines it wraps onto to search for text.
+ * Offsets of cells before last are less than limit.
+ */
+static char *
+window_copy_search_stringify(struct grid *gd, u_int py, u_int first,
+    u_int last, int cis, size_t *limit, u_int *size)
 {
-	struct grid_cell	 gc, sgc;
-	const struct utf8_data	*ud, *sud;
-
-	grid_get_cell(gd, px, py, &gc);
-	ud = &gc.data;
-	grid_get_cell(sgd, spx, 0, &sgc);
-	sud = &sgc.data;
-
-	if (ud->size != sud->size || ud->width != sud->width)
-		return (0);
+	char	*buf, *cp;
 
-	if (cis && ud->size == 1)
-		return (tolower(ud->data[0]) == sud->data[0]);
-
-	return (memcmp(ud->data, sud->data, ud->size) == 0);
+	*size = 1;
+	buf = xmalloc(*size);
+	buf[0] = '\0';
+	buf = window_copy_stringify(gd, py, first, last, buf, size);
+	*limit = *size - 1;
+	buf = window_copy_stringify(gd, py, last, gd->sx, buf, size);
+	buf = window_copy_stringify_wrapped(gd, py, buf, size);
+
+	if (cis) {
+		for (cp = buf; *cp != '\0'; cp++) {
+			if ((u_char)*cp < 0x80)
+				*cp = tolower((u_char)*cp);
+		}
+	}
+	return (buf);
 }
 
 static int
-window_copy_search_lr(struct grid *gd, struct grid *sgd, u_int *ppx, u_int py,
+window_copy_search_lr(struct grid *gd, const char *text, u_int *ppx, u_int py,
     u_int first, u_int last, int cis)
 {
-	u_int			 ax, bx, px, pywrap, endline;
-	int			 matched;
-	struct grid_line	*gl;
-
-	endline = gd->hsize + gd->sy - 1;
-	for (ax = first; ax < last; ax++) {
-		for (bx = 0; bx < sgd->sx; bx++) {
-			px = ax + bx;
-			pywrap = py;
-			/* Wrap line. */
-			while (px >= gd->sx && pywrap < endline) {
-				gl = grid_get_line(gd, pywrap);
-				if (~gl->flags & GRID_LINE_WRAPPED)
-					break;
-				px -= gd->sx;
-				pywrap++;
-			}
-			/* We have run off the end of the grid. */
-			if (px >= gd->sx)
-				break;
-			matched = window_copy_search_compare(gd, px, pywrap,
-			    sgd, bx, cis);
-			if (!matched)
-				break;
-		}
-		if (bx == sgd->sx) {
-			*ppx = ax;
-			return (1);
-		}
+	u_int	 size;
+	size_t	 limit;
+	char	*buf, *cp;
+
+	if (first >= last)
+		return (0);
+	buf = window_copy_search_stringify(gd, py, first, last, cis, &limit,
+	    &size);
+
+	cp = memmem(buf, size - 1, text, strlen(text));
+	if (cp == NULL || (size_t)(cp - buf) >= limit) {
+		free(buf);
+		return (0);
 	}
-	return (0);
+	*ppx = first;
+	window_copy_cstrtocellpos(gd, ppx, &py, cp - buf);
+	free(buf);
+	return (1);
 }
 
 static int
-window_copy_search_rl(struct grid *gd,
-    struct grid *sgd, u_int *ppx, u_int py, u_int first, u_int last, int cis)
-{
-	u_int			 ax, bx, px, pywrap, endline;
-	int			 matched;
-	struct grid_line	*gl;
-
-	endline = gd->hsize + gd->sy - 1;
-	for (ax = last; ax > first; ax--) {
-		for (bx = 0; bx < sgd->sx; bx++) {
-			px = ax - 1 + bx;
-			pywrap = py;
-			/* Wrap line. */
-			while (px >= gd->sx && pywrap < endline) {
-				gl = grid_get_line(gd, pywrap);
-				if (~gl->flags & GRID_LINE_WRAPPED)
-					break;
-				px -= gd->sx;
-				pywrap++;
-			}
-			/* We have run off the end of the grid. */
-			if (px >= gd->sx)
-				break;
-			matched = window_copy_search_compare(gd, px, pywrap,
-			    sgd, bx, cis);
-			if (!matched)
-				break;
-		}
-		if (bx == sgd->sx) {
-			*ppx = ax - 1;
-			return (1);
-		}
+window_copy_search_rl(struct grid *gd, const char *text, u_int *ppx, u_int py,
+    u_int first, u_int last, int cis)
+{
+	u_int	 size;
+	size_t	 limit, len = strlen(text);
+	char	*buf, *cp, *end, *found = NULL;
+
+	if (first >= last)
+		return (0);
+	buf = window_copy_search_stringify(gd, py, first, last, cis, &limit,
+	    &size);
+
+	end = buf + size - 1;
+	for (cp = buf; cp <= end; cp++) {
+		cp = memmem(cp, end - cp, text, len);
+		if (cp == NULL || (size_t)(cp - buf) >= limit)
+			break;
+		found = cp;
 	}
-	return (0);
+	if (found == NULL) {
+		free(buf);
+		return (0);
+	}
+	*ppx = first;
+	window_copy_cstrtocellpos(gd, ppx, &py, found - buf);
+	free(buf);
+	return (1);
 }
 
 static int
@@ -2483,10 +2527,9 @@ window_copy_search_lr_regex(struct grid *gd, u_int *ppx, u_int *psx, u_int py,
     u_int first, u_int last, regex_t *reg)
 {
 	int			eflags = 0;
-	u_int			endline, foundx, foundy, len, pywrap, size = 1;
+	u_int			foundx, foundy, size = 1;
 	char		       *buf;
 	regmatch_t		regmatch;
-	struct grid_line       *gl;
 
 	/*
 	 * This can happen during search if the last match was the last
@@ -2503,29 +2546,18 @@ window_copy_search_lr_regex(struct grid *gd, u_int *ppx, u_int *psx, u_int py,
 	buf = xmalloc(size);
 	buf[0] = '\0';
 	buf = window_copy_stringify(gd, py, first, gd->sx, buf, &size);
-	len = gd->sx - first;
-	endline = gd->hsize + gd->sy - 1;
-	pywrap = py;
-	while (buf != NULL && pywrap <= endline) {
-		gl = grid_get_line(gd, pywrap);
-		if (~gl->flags & GRID_LINE_WRAPPED)
-			break;
-		pywrap++;
-		buf = window_copy_stringify(gd, pywrap, 0, gd->sx, buf, &size);
-		len += gd->sx;
-	}
+	buf = window_copy_stringify_wrapped(gd, py, buf, &size);
 
 	if (regexec(reg, buf, 1, &regmatch, eflags) == 0 &&
 	    regmatch.rm_so != regmatch.rm_eo) {
 		foundx = first;
 		foundy = py;
-		window_copy_cstrtocellpos(gd, len, &foundx, &foundy,
-		    buf + regmatch.rm_so);
+		window_copy_cstrtocellpos(gd, &foundx, &foundy,
+		    regmatch.rm_so);
 		if (foundy == py && foundx < last) {
 			*ppx = foundx;
-			len -= foundx - first;
-			window_copy_cstrtocellpos(gd, len, &foundx, &foundy,
-			    buf + regmatch.rm_eo);
+			window_copy_cstrtocellpos(gd, &foundx, &foundy,
+			    regmatch.rm_eo - regmatch.rm_so);
 			*psx = foundx;
 			while (foundy > py) {
 				*psx += gd->sx;
@@ -2548,9 +2580,8 @@ window_copy_search_rl_regex(struct grid *gd, u_int *ppx, u_int *psx, u_int py,
     u_int first, u_int last, regex_t *reg)
 {
 	int			eflags = 0;
-	u_int			endline, len, pywrap, size = 1;
+	u_int			size = 1;
 	char		       *buf;
-	struct grid_line       *gl;
 
 	/* Set flags for regex search. */
 	if (first != 0)
@@ -2560,20 +2591,10 @@ window_copy_search_rl_regex(struct grid *gd, u_int *ppx, u_int *psx, u_int py,
 	buf = xmalloc(size);
 	buf[0] = '\0';
 	buf = window_copy_stringify(gd, py, first, gd->sx, buf, &size);
-	len = gd->sx - first;
-	endline = gd->hsize + gd->sy - 1;
-	pywrap = py;
-	while (buf != NULL && (pywrap <= endline)) {
-		gl = grid_get_line(gd, pywrap);
-		if (~gl->flags & GRID_LINE_WRAPPED)
-			break;
-		pywrap++;
-		buf = window_copy_stringify(gd, pywrap, 0, gd->sx, buf, &size);
-		len += gd->sx;
-	}
+	buf = window_copy_stringify_wrapped(gd, py, buf, &size);
 
-	if (window_copy_last_regex(gd, py, first, last, len, ppx, psx, buf,
-	    reg, eflags))
+	if (window_copy_last_regex(gd, py, first, last, ppx, psx, buf, reg,
+	    eflags))
 	{
 		free(buf);
 		return (1);
@@ -2585,64 +2606,26 @@ window_copy_search_rl_regex(struct grid *gd, u_int *ppx, u_int *psx, u_int py,
 	return (0);
 }
 
-static const char *
-window_copy_cellstring(const struct grid_line *gl, u_int px, size_t *size,
-    int *allocated)
-{
-	static struct utf8_data	 ud;
-	struct grid_cell_entry	*gce;
-	char			*copy;
-
-	if (px >= gl->cellsize) {
-		*size = 1;
-		*allocated = 0;
-		return (" ");
-	}
-
-	gce = &gl->celldata[px];
-	if (gce->flags & GRID_FLAG_PADDING) {
-		*size = 0;
-		*allocated = 0;
-		return (NULL);
-	}
-	if (~gce->flags & GRID_FLAG_EXTENDED) {
-		*size = 1;
-		*allocated = 0;
-		return (&gce->data.data);
-	}
-
-	utf8_to_data(gl->extddata[gce->offset].data, &ud);
-	*size = ud.size;
-	*allocated = 1;
-
-	copy = xmalloc(ud.size);
-	memcpy(copy, ud.data, ud.size);
-	return (copy);
-}
-
 /* Find last match in given range. */
 static int
 window_copy_last_regex(struct grid *gd, u_int py, u_int first, u_int last,
-    u_int len, u_int *ppx, u_int *psx, const char *buf, const regex_t *preg,
-    int eflags)
+    u_int *ppx, u_int *psx, const char *buf, const regex_t *preg, int eflags)
 {
-	u_int		foundx, foundy, oldx, px = 0, savepx, savesx = 0;
+	u_int		foundx, foundy, px = 0, savepx, savesx = 0;
 	regmatch_t	regmatch;
 
 	foundx = first;
 	foundy = py;
-	oldx = first;
 	while (regexec(preg, buf + px, 1, &regmatch, eflags) == 0) {
 		if (regmatch.rm_so == regmatch.rm_eo)
 			break;
-		window_copy_cstrtocellpos(gd, len, &foundx, &foundy,
-		    buf + px + regmatch.rm_so);
+		window_copy_cstrtocellpos(gd, &foundx, &foundy,
+		    regmatch.rm_so);
 		if (foundy > py || foundx >= last)
 			break;
-		len -= foundx - oldx;
 		savepx = foundx;
-		window_copy_cstrtocellpos(gd, len, &foundx, &foundy,
-		    buf + px + regmatch.rm_eo);
+		window_copy_cstrtocellpos(gd, &foundx, &foundy,
+		    regmatch.rm_eo - regmatch.rm_so);
 		if (foundy > py || foundx >= last) {
 			*ppx = savepx;
 			*psx = foundx;
@@ -2652,11 +2635,8 @@ window_copy_last_regex(struct grid *gd, u_int py, u_int first, u_int last,
 			}
 			*psx -= *ppx;
 			return (1);
-		} else {
+		} else
 			savesx = foundx - savepx;
-			len -= savesx;
-			oldx = foundx;
-		}
 		px += regmatch.rm_eo;
 	}
 
@@ -2676,127 +2656,97 @@ static char *
 window_copy_stringify(struct grid *gd, u_int py, u_int first, u_int last,
     char *buf, u_int *size)
 {
-	u_int			 ax, bx, newsize = *size;
-	const struct grid_line	*gl;
-	const char		*d;
-	size_t			 bufsize = 1024, dlen;
-	int			 allocated;
-
-	while (bufsize < newsize)
-		bufsize *= 2;
-	buf = xrealloc(buf, bufsize);
-
-	gl = grid_peek_line(gd, py);
-	bx = *size - 1;
-	for (ax = first; ax < last; ax++) {
-		d = window_copy_cellstring(gl, ax, &dlen, &allocated);
-		newsize += dlen;
-		while (bufsize < newsize) {
-			bufsize *= 2;
-			buf = xrealloc(buf, bufsize);
-		}
-		if (dlen == 1)
-			buf[bx++] = *d;
-		else {
-			memcpy(buf + bx, d, dlen);
-			bx += dlen;
-		}
-		if (allocated)
-			free((void *)d);
-	}
-	buf[newsize - 1] = '\0';
+	const struct grid_text	*gt;
+	u_int			 end = 0;
+	size_t			 start = 0, len = 0, spaces = 0;
+	char			*cp;
+
+	gt = grid_get_text(gd, py);
+	if (gt != NULL)
+		end = gt->ncells;
+	if (end > last)
+		end = last;
+	if (first < end) {
+		start = grid_text_offset(gt, first);
+		len = grid_text_offset(gt, end) - start;
+	} else
+		end = first;
+
+	/* Cells after the end of the line are spaces. */
+	if (last > end)
+		spaces = last - end;
+
+	buf = xrealloc(buf, *size + len + spaces);
+	cp = buf + *size - 1;
+	if (len != 0)
+		memcpy(cp, gt->text + start, len);
+	memset(cp + len, ' ', spaces);
+	cp[len + spaces] = '\0';
 
-	*size = newsize;
+	*size += len + spaces;
 	return (buf);
 }
 
-/* Map start of C string containing UTF-8 data to grid cell position. */
-static void
-window_copy_cstrtocellpos(struct grid *gd, u_int ncells, u_int *ppx, u_int *ppy,
-    const char *str)
+/* Stringify lines which line py wraps onto and append to input buffer. */
+static char *
+window_copy_stringify_wrapped(struct grid *gd, u_int py, char *buf,
+    u_int *size)
 {
-	u_int			 cell, ccell, px, pywrap, pos, len;
-	int			 match;
 	const struct grid_line	*gl;
-	const char		*d;
-	size_t			 dlen;
-	struct {
-		const char	*d;
-		size_t		 dlen;
-		int		 allocated;
-	} *cells;
-
-	/* Populate the array of cell data. */
-	cells = xreallocarray(NULL, ncells, sizeof cells[0]);
-	cell = 0;
-	px = *ppx;
-	pywrap = *ppy;
-	gl = grid_peek_line(gd, pywrap);
-	while (cell < ncells) {
-		cells[cell].d = window_copy_cellstring(gl, px,
-		    &cells[cell].dlen, &cells[cell].allocated);
-		cell++;
-		px++;
-		if (px == gd->sx) {
-			px = 0;
-			pywrap++;
-			gl = grid_peek_line(gd, pywrap);
-		}
+	u_int			 endline = gd->hsize + gd->sy - 1;
+
+	while (py < endline) {
+		gl = grid_peek_line(gd, py);
+		if (~gl->flags & GRID_LINE_WRAPPED)
+			break;
+		py++;
+		buf = window_copy_stringify(gd, py, 0, gd->sx, buf, size);
 	}
+	return (buf);
+}
+
+/*
+ * Map an offset in a string from window_copy_stringify to a grid cell
+ * position, starting from the cell at the start of the string.
+ */
+static void
+window_copy_cstrtocellpos(struct grid *gd, u_int *ppx, u_int *ppy,
+    size_t offset)
+{
+	const struct grid_text	*gt;
+	u_int			 px = *ppx, py = *ppy, end;
+	size_t			 start, size;
 
-	/* Locate starting cell. */
-	cell = 0;
-	len = strlen(str);
-	while (cell < ncells) {
-		ccell = cell;
-		pos = 0;
-		match = 1;
-		while (ccell < ncells) {
-			if (str[pos] == '\0') {
-				match = 0;
+	while (offset != 0 && px <= gd->sx) {
+		gt = grid_get_text(gd, py);
+		if (gt == NULL)
+			break;
+		end = gt->ncells;
+		if (end > gd->sx)
+			end = gd->sx;
+		if (px < end) {
+			start = grid_text_offset(gt, px);
+			size = grid_text_offset(gt, end) - start;
+			if (offset < size) {
+				px = grid_text_cell(gt, start + offset);
 				break;
 			}
-			d = cells[ccell].d;
-			dlen = cells[ccell].dlen;
-			if (dlen == 1) {
-				if (str[pos] != *d) {
-					match = 0;
-					break;
-				}
-				pos++;
-			} else {
-				if (dlen > len - pos)
-					dlen = len - pos;
-				if (memcmp(str + pos, d, dlen) != 0) {
-					match = 0;
-					break;
-				}
-				pos += dlen;
-			}
-			ccell++;
+			offset -= size;
+			px = end;
 		}
-		if (match)
-			break;
-		cell++;
-	}
 
-	/* If not found this will be one past the end. */
-	px = *ppx + cell;
-	pywrap = *ppy;
-	while (px >= gd->sx) {
-		px -= gd->sx;
-		pywrap++;
+		/* Cells after the end of the line are spaces. */
+		if (offset < gd->sx - px) {
+			px += offset;
+			break;
+		}
+		offset -= gd->sx - px;
+		px = 0;
+		py++;
 	}
 
 	*ppx = px;
-	*ppy = pywrap;
-
-	/* Free cell data. */
-	for (cell = 0; cell < ncells; cell++) {
-		if (cells[cell].allocated)
-			free((void *)cells[cell].d);
-	}
-	free(cells);
+	*ppy = py;
 }
 
 static void
@@ -2816,6 +2766,20 @@ window_copy_move_left(struct screen *s, u_int *fx, u_int *fy, int wrapflag)
 		*fx = *fx - 1;
 }
 
+/*
+ * Check the grid's search index for a line. If the text cannot be found on the
+ * line, return 0 and set first and last to the lines which may be skipped. The
+ * lines last checked are kept in first and last and not checked again.
+ */
+static int
+window_copy_search_index(struct grid *gd, const char *text, u_int py,
+    u_int *first, u_int *last)
+{
+	if (text == NULL || (py >= *first && py <= *last))
+		return (1);
+	return (grid_index_check(gd, py, text, first, last));
+}
+
 static int
 window_copy_is_lowercase(const char *ptr)
 {
@@ -2838,33 +2802,51 @@ window_copy_search_jump(struct window_mode_entry *wme, struct grid *gd,
     struct grid *sgd, u_int fx, u_int fy, u_int endline, int cis, int wrap,
     int direction, int regex, u_int *foundlen)
 {
-	u_int	 i, px, sx, ssize = 1;
+	u_int	 i, px, sx, ssize = 1, first = 1, last = 0, threads, line;
 	int	 found = 0, cflags = REG_EXTENDED;
-	char	*sbuf;
+	char	*sbuf, *text = NULL;
 	regex_t	 reg;
 
+	sbuf = xmalloc(ssize);
+	sbuf[0] = '\0';
+	sbuf = window_copy_stringify(sgd, 0, 0, sgd->sx, sbuf, &ssize);
 	if (regex) {
-		sbuf = xmalloc(ssize);
-		sbuf[0] = '\0';
-		sbuf = window_copy_stringify(sgd, 0, 0, sgd->sx, sbuf, &ssize);
 		if (cis)
 			cflags |= REG_ICASE;
 		if (regcomp(&reg, sbuf, cflags) != 0) {
 			free(sbuf);
 			return (0);
 		}
-		free(sbuf);
-	}
+	} else
+		text = sbuf;
+	threads = options_get_number(global_options, "search-threads");
 
+	/*
+	 * With threads, only the first line is searched here and the threads
+	 * look for the next line with a match.
+	 */
 	if (direction) {
 		for (i = fy; i <= endline; i++) {
+			if (regex && threads > 1 && i != fy) {
+				if (!grid_search_regex(gd, sbuf, cflags, i,
+				    endline + 1, GRID_SEARCH_FIRST, threads,
+				    &line))
+					break;
+				i = line;
+			}
+			if (!window_copy_search_index(gd, text, i, &first,
+			    &last)) {
+				i = last;
+				fx = 0;
+				continue;
+			}
 			if (regex) {
 				found = window_copy_search_lr_regex(gd,
 				    &px, &sx, i, fx, gd->sx, &reg);
 				if (found)
 					*foundlen = sx;
 			} else {
-				found = window_copy_search_lr(gd, sgd,
+				found = window_copy_search_lr(gd, text,
 				    &px, i, fx, gd->sx, cis);
 				if (found)
 					*foundlen = sgd->sx;
@@ -2876,11 +2858,24 @@ window_copy_search_jump(struct window_mode_entry *wme, struct grid *gd,
 	} else {
 		*foundlen = 0;
 		for (i = fy + 1; endline < i; i--) {
+			if (regex && threads > 1 && i != fy + 1) {
+				if (!grid_search_regex(gd, sbuf, cflags,
+				    endline, i, GRID_SEARCH_LAST, threads,
+				    &line))
+					break;
+				i = line + 1;
+			}
+			if (!window_copy_search_index(gd, text, i - 1, &first,
+			    &last)) {
+				i = first + 1;
+				fx = gd->sx - 1;
+				continue;
+			}
 			if (regex) {
 				found = window_copy_search_rl_regex(gd,
 				    &px, &sx, i - 1, 0, fx + 1, &reg);
 			} else {
-				found = window_copy_search_rl(gd, sgd,
+				found = window_copy_search_rl(gd, text,
 				    &px, i - 1, 0, fx + 1, cis);
 			}
 			if (found) {
@@ -2892,6 +2887,7 @@ window_copy_search_jump(struct window_mode_entry *wme, struct grid *gd,
 	}
 	if (regex)
 		regfree(&reg);
+	free(sbuf);
 
 	if (found) {
 		window_copy_scroll_to(wme, px, i, 1);
@@ -3001,147 +2997,237 @@ window_copy_search_mark_at(struct window_copy_mode_data *data, u_int px,
 	return (0);
 }
 
+/* Set up a search for marking matches. */
 static int
-window_copy_search_marks(struct window_mode_entry *wme, struct screen *ssp,
-    int regex, int visible_only)
+window_copy_search_init(struct window_mode_entry *wme, struct screen *ssp,
+    int regex, struct window_copy_search *ws)
 {
 	struct window_copy_mode_data	*data = wme->data;
-	struct screen			*s = data->backing, ss;
+	struct screen			 ss;
 	struct screen_write_ctx		 ctx;
-	struct grid			*gd = s->grid;
-	int				 found, cis, which = -1, stopped = 0;
 	int				 cflags = REG_EXTENDED;
-	u_int				 px, py, i, b, nfound = 0, width;
-	u_int				 ssize = 1, start, end;
+	u_int				 ssize = 1;
 	char				*sbuf;
-	regex_t				 reg;
-	uint64_t			 stop = 0, tstart, t;
+
+	memset(ws, 0, sizeof *ws);
+	ws->regex = regex;
+	ws->first = 1;
+	ws->which = -1;
 
 	if (ssp == NULL) {
-		width = screen_write_strlen("%s", data->searchstr);
-		screen_init(&ss, width, 1, 0);
+		ws->width = screen_write_strlen("%s", data->searchstr);
+		screen_init(&ss, ws->width, 1, 0);
 		screen_write_start(&ctx, &ss);
 		screen_write_nputs(&ctx, -1, &grid_default_cell, "%s",
 		    data->searchstr);
 		screen_write_stop(&ctx);
-		ssp = &ss;
 	} else
-		width = screen_size_x(ssp);
+		ws->width = screen_size_x(ssp);
 
-	cis = window_copy_is_lowercase(data->searchstr);
+	ws->cis = window_copy_is_lowercase(data->searchstr);
 
-	if (regex) {
-		sbuf = xmalloc(ssize);
-		sbuf[0] = '\0';
+	sbuf = xmalloc(ssize);
+	sbuf[0] = '\0';
+	if (ssp == NULL) {
+		sbuf = window_copy_stringify(ss.grid, 0, 0, ss.grid->sx, sbuf,
+		    &ssize);
+		screen_free(&ss);
+	} else {
 		sbuf = window_copy_stringify(ssp->grid, 0, 0, ssp->grid->sx,
 		    sbuf, &ssize);
-		if (cis)
+	}
+	if (regex) {
+		if (ws->cis)
 			cflags |= REG_ICASE;
-		if (regcomp(&reg, sbuf, cflags) != 0) {
+		if (regcomp(&ws->reg, sbuf, cflags) != 0) {
 			free(sbuf);
-			return (0);
+			return (-1);
+		}
+		ws->pattern = sbuf;
+		ws->cflags = cflags;
+	} else
+		ws->text = sbuf;
+	return (0);
+}
+
+/* Free a search for marking matches. */
+static void
+window_copy_search_free(struct window_copy_search *ws)
+{
+	if (ws->regex)
+		regfree(&ws->reg);
+	free(ws->pattern);
+	free(ws->text);
+}
+
+/* Find matches on a line, marking them if they are visible and mark is set. */
+static void
+window_copy_search_line(struct window_mode_entry *wme,
+    struct window_copy_search *ws, u_int py, int mark)
+{
+	struct window_copy_mode_data	*data = wme->data;
+	struct grid			*gd = data->backing->grid;
+	u_int				 px = 0, width, i, b;
+	int				 found;
+
+	if (!window_copy_search_index(gd, ws->text, py, &ws->first, &ws->last))
+		return;
+	for (;;) {
+		width = ws->width;
+		if (ws->regex) {
+			found = window_copy_search_lr_regex(gd, &px, &width, py,
+			    px, gd->sx, &ws->reg);
+		} else {
+			found = window_copy_search_lr(gd, ws->text, &px, py, px,
+			    gd->sx, ws->cis);
 		}
-		free(sbuf);
+		if (!found)
+			break;
+
+		ws->nfound++;
+		if (ws->track && px == ws->cx && py == ws->cy)
+			ws->which = ws->nfound;
+
+		if (mark && window_copy_search_mark_at(data, px, py, &b) == 0) {
+			if (b + width > gd->sx * gd->sy)
+				width = (gd->sx * gd->sy) - b;
+			for (i = b; i < b + width; i++)
+				data->searchmark[i] = data->searchgen;
+			if (data->searchgen == UCHAR_MAX)
+				data->searchgen = 1;
+			else
+				data->searchgen++;
+		}
+
+		px += width;
 	}
-	tstart = get_timer();
+}
 
-	if (visible_only)
-		window_copy_visible_lines(data, &start, &end);
-	else {
-		start = 0;
-		end = gd->hsize + gd->sy;
-		stop = get_timer() + WINDOW_COPY_SEARCH_ALL_TIMEOUT;
+static int
+window_copy_search_marks(struct window_mode_entry *wme, struct screen *ssp,
+    int regex, int visible_only)
+{
+	struct window_copy_mode_data	*data = wme->data;
+	struct grid			*gd = data->backing->grid;
+	struct window_copy_search	*ws;
+	u_int				 py, start, end;
+	uint64_t			 tstart;
+
+	ws = xmalloc(sizeof *ws);
+	if (window_copy_search_init(wme, ssp, regex, ws) != 0) {
+		free(ws);
+		return (0);
 	}
+	tstart = get_timer();
 
-again:
 	free(data->searchmark);
 	data->searchmark = xcalloc(gd->sx, gd->sy);
 	data->searchgen = 1;
 
+	/* Mark the visible lines now. */
+	window_copy_visible_lines(data, &start, &end);
 	for (py = start; py < end; py++) {
-		px = 0;
-		for (;;) {
-			if (regex) {
-				found = window_copy_search_lr_regex(gd,
-				    &px, &width, py, px, gd->sx, &reg);
-				if (!found)
-					break;
-			} else {
-				found = window_copy_search_lr(gd, ssp->grid,
-				    &px, py, px, gd->sx, cis);
-				if (!found)
-					break;
-			}
-
-			nfound++;
-			if (px == data->cx &&
-			    py == gd->hsize + data->cy - data->oy)
-				which = nfound;
-
-			if (window_copy_search_mark_at(data, px, py, &b) == 0) {
-				if (b + width > gd->sx * gd->sy)
-					width = (gd->sx * gd->sy) - b;
-				for (i = b; i < b + width; i++)
-					data->searchmark[i] = data->searchgen;
-				if (data->searchgen == UCHAR_MAX)
-					data->searchgen = 1;
-				else
-					data->searchgen++;
-			}
-
-			px += width;
-		}
-
-		t = get_timer();
-		if (t - tstart > WINDOW_COPY_SEARCH_TIMEOUT) {
+		window_copy_search_line(wme, ws, py, 1);
+		if (get_timer() - tstart > WINDOW_COPY_SEARCH_TIMEOUT) {
 			data->timeout = 1;
 			break;
 		}
-		if (stop != 0 && t > stop) {
-			stopped = 1;
-			break;
-		}
 	}
-	if (data->timeout) {
+	if (data->timeout)
 		window_copy_clear_marks(wme);
-		goto out;
+	if (data->timeout || visible_only) {
+		window_copy_search_free(ws);
+		free(ws);
+		return (1);
 	}
 
-	if (stopped && stop != 0) {
-		/* Try again but just the visible context. */
-		window_copy_visible_lines(data, &start, &end);
-		stop = 0;
-		goto again;
-	}
+	/* Then count the matches in the whole grid. */
+	window_copy_search_stop(wme);
+	ws->first = 1;
+	ws->last = 0;
+	ws->py = 0;
+	ws->end = gd->hsize + gd->sy;
+	ws->nfound = 0;
+	ws->track = 1;
+	ws->cx = data->cx;
+	ws->cy = gd->hsize + data->cy - data->oy;
+	ws->drawn = get_timer();
+	evtimer_set(&ws->timer, window_copy_search_timer, wme);
+	data->searchall = ws;
+	window_copy_search_count(wme);
+	return (1);
+}
 
-	if (!visible_only) {
-		if (stopped) {
-			data->searchthis = -1;
-			if (nfound > 1000)
-				data->searchcount = 1000;
-			else if (nfound > 100)
-				data->searchcount = 100;
-			else if (nfound > 10)
-				data->searchcount = 10;
-			else
-				data->searchcount = -1;
-			data->searchmore = 1;
+/*
+ * Count matches in the whole grid for a slice of time, starting a timer to
+ * continue if not finished.
+ */
+static void
+window_copy_search_count(struct window_mode_entry *wme)
+{
+	struct window_copy_mode_data	*data = wme->data;
+	struct window_copy_search	*all = data->searchall;
+	struct grid			*gd = data->backing->grid;
+	struct timeval			 tv = { 0 };
+	u_int				 end, threads, n;
+	uint64_t			 stop;
+
+	stop = get_timer() + WINDOW_COPY_SEARCH_ALL_SLICE;
+	end = all->end;
+	if (end > gd->hsize + gd->sy)
+		end = gd->hsize + gd->sy;
+	threads = options_get_number(global_options, "search-threads");
+	while (all->py < end) {
+		/*
+		 * With threads, count a block of lines at once, except for the
+		 * line with the cursor.
+		 */
+		if (all->regex && threads > 1 &&
+		    (!all->track || all->py != all->cy)) {
+			n = all->py + threads * WINDOW_COPY_SEARCH_ALL_LINES;
+			if (n > end)
+				n = end;
+			if (all->track && all->cy > all->py && all->cy < n)
+				n = all->cy;
+			all->nfound += grid_search_regex(gd, all->pattern,
+			    all->cflags, all->py, n, GRID_SEARCH_COUNT, threads,
+			    NULL);
+			all->py = n;
 		} else {
-			if (which != -1)
-				data->searchthis = 1 + nfound - which;
-			else
-				data->searchthis = -1;
-			data->searchcount = nfound;
-			data->searchmore = 0;
+			window_copy_search_line(wme, all, all->py, 0);
+			all->py++;
 		}
+		if (get_timer() > stop)
+			break;
 	}
 
-out:
-	if (ssp == &ss)
-		screen_free(&ss);
-	if (regex)
-		regfree(&reg);
-	return (1);
+	data->searchcount = all->nfound;
+	if (all->py < end) {
+		data->searchthis = -1;
+		data->searchmore = 1;
+		evtimer_add(&all->timer, &tv);
+		return;
+	}
+	if (all->which != -1)
+		data->searchthis = 1 + all->nfound - all->which;
+	else
+		data->searchthis = -1;
+	data->searchmore = 0;
+	window_copy_search_stop(wme);
+}
+
+/* Stop counting matches. */
+static void
+window_copy_search_stop(struct window_mode_entry *wme)
+{
+	struct window_copy_mode_data	*data = wme->data;
+
+	if (data->searchall == NULL)
+		return;
+	evtimer_del(&data->searchall->timer);
+	window_copy_search_free(data->searchall);
+	free(data->searchall);
+	data->searchall = NULL;
 }
 
 static void
@@ -3149,6 +3235,7 @@ window_copy_clear_marks(struct window_mode_entry *wme)
 {
 	struct window_copy_mode_data	*data = wme->data;
 
+	window_copy_search_stop(wme);
 	free(data->searchmark);
 	data->searchmark = NULL;
 }
@@ -3339,6 +3426,7 @@ window_copy_write_line(struct window_mode_entry *wme,
 	struct window_copy_mode_data	*data = wme->data;
 	struct screen			*s = &data->screen;
 	struct options			*oo = wp->window->options;
+	struct window_copy_search	*all;
 	struct grid_cell		 gc, mgc, cgc, mkgc;
 	char				 hdr[512];
 	size_t				 size = 0;
@@ -3363,7 +3451,14 @@ window_copy_write_line(struct window_mode_entry *wme,
 				    "[%u/%u]", data->oy, hsize);
 			}
 		} else {
-			if (data->searchcount == -1) {
+			if (data->searchall != NULL) {
+				all = data->searchall;
+				size = xsnprintf(hdr, sizeof hdr,
+				    "(%d+ results, %u%%) [%u/%u]",
+				    data->searchcount,
+				    (u_int)((uint64_t)all->py * 100 / all->end),
+				    data->oy, hsize);
+			} else if (data->searchcount == -1) {
 				size = xsnprintf(hdr, sizeof hdr,
 				    "[%u/%u]", data->oy, hsize);
 			} else if (data->searchthis == -1) {
@@ -3896,7 +3991,7 @@ window_copy_copy_line(struct window_mode_entry *wme, char **buf, size_t *off,
 	struct window_copy_mode_data	*data = wme->data;
 	struct grid			*gd = data->backing->grid;
 	struct grid_cell		 gc;
-	struct grid_line		*gl;
+	const struct grid_line		*gl;
 	struct utf8_data		 ud;
 	u_int				 i, xx, wrapped = 0;
 	const char			*s;
@@ -3908,7 +4003,7 @@ window_copy_copy_line(struct window_mode_entry *wme, char **buf, size_t *off,
 	 * Work out if the line was wrapped at the screen edge and all of it is
 	 * on screen.
 	 */
-	gl = grid_get_line(gd, sy);
+	gl = grid_peek_line(gd, sy);
 	if (gl->flags & GRID_LINE_WRAPPED && gl->cellsize <= gd->sx)
 		wrapped = 1;
 
@@ -3999,7 +4094,7 @@ window_copy_cursor_start_of_line(struct window_mode_entry *wme)
 	if (data->cx == 0 && data->lineflag == LINE_SEL_NONE) {
 		py = screen_hsize(back_s) + data->cy - data->oy;
 		while (py > 0 &&
-		    grid_get_line(gd, py - 1)->flags & GRID_LINE_WRAPPED) {
+		    grid_peek_line(gd, py - 1)->flags & GRID_LINE_WRAPPED) {
 			window_copy_cursor_up(wme, 0);
 			py = screen_hsize(back_s) + data->cy - data->oy;
 		}
@@ -4038,7 +4133,7 @@ window_copy_cursor_end_of_line(struct window_mode_entry *wme)
 	struct window_copy_mode_data	*data = wme->data;
 	struct screen			*back_s = data->backing;
 	struct grid			*gd = back_s->grid;
-	struct grid_line		*gl;
+	const struct grid_line		*gl;
 	u_int				 px, py;
 
 	py = screen_hsize(back_s) + data->cy - data->oy;
@@ -4047,10 +4142,10 @@ window_copy_cursor_end_of_line(struct window_mode_entry *wme)
 	if (data->cx == px && data->lineflag == LINE_SEL_NONE) {
 		if (data->screen.sel != NULL && data->rectflag)
 			px = screen_size_x(back_s);
-		gl = grid_get_line(gd, py);
+		gl = grid_peek_line(gd, py);
 		if (gl->flags & GRID_LINE_WRAPPED) {
 			while (py < gd->sy + gd->hsize) {
-				gl = grid_get_line(gd, py);
+				gl = grid_peek_line(gd, py);
 				if (~gl->flags & GRID_LINE_WRAPPED)
 					break;
 				window_copy_cursor_down(wme, 0);
@@ -355,6 +355,7 @@ window_destroy(struct window *w)
 	if (w->saved_layout_root != NULL)
 		layout_free_cell(w->saved_layout_root);
 	free(w->old_layout);
+	free(w->border_cells);
 
 	window_destroy_panes(w);
 
@@ -376,9 +377,15 @@ int
 window_pane_destroy_ready(struct window_pane *wp)
 {
 	int	n;
+	size_t	size;
 
-	if (wp->pipe_fd != -1) {
-		if (EVBUFFER_LENGTH(wp->pipe_event->output) != 0)
+	/*
+	 * Output not yet written to the pipe is in the pane's buffer, which is
+	 * gone if the pane has already been destroyed (with remain-on-exit).
+	 */
+	if (wp->pipe_fd != -1 && wp->event != NULL) {
+		window_pane_get_new_data(wp, &wp->pipe_offset, &size);
+		if (size != 0)
 			return (0);
 		if (ioctl(wp->fd, FIONREAD, &n) != -1 && n > 0)
 			return (0);
@@ -928,10 +935,7 @@ window_pane_destroy(struct window_pane *wp)
 
 	screen_free(&wp->base);
 
-	if (wp->pipe_fd != -1) {
-		bufferevent_free(wp->pipe_event);
-		close(wp->pipe_fd);
-	}
+	window_pane_close_pipe(wp);
 
 	if (event_initialized(&wp->resize_timer))
 		event_del(&wp->resize_timer);
@@ -948,24 +952,88 @@ window_pane_destroy(struct window_pane *wp)
 	free(wp);
 }
 
+/* Pipe is writable again, write any more output. */
 static void
-window_pane_read_callback(__unused struct bufferevent *bufev, void *data)
+window_pane_pipe_write_callback(__unused int fd, __unused short events,
+    void *data)
+{
+	struct window_pane	*wp = data;
+
+	window_pane_write_pipe(wp);
+	if (window_pane_destroy_ready(wp))
+		server_destroy_pane(wp, 1);
+}
+
+/*
+ * Write new output to the pipe. This is written straight from the pane's
+ * buffer rather than copied to the pipe's bufferevent first; anything the pipe
+ * cannot yet take stays in the pane's buffer (held by the pipe offset) and is
+ * written when it becomes writable.
+ */
+void
+window_pane_write_pipe(struct window_pane *wp)
 {
-	struct window_pane		*wp = data;
-	struct evbuffer			*evb = wp->event->input;
 	struct window_pane_offset	*wpo = &wp->pipe_offset;
-	size_t				 size = EVBUFFER_LENGTH(evb);
 	char				*new_data;
 	size_t				 new_size;
-	struct client			*c;
+	ssize_t				 n;
+
+	if (wp->pipe_fd == -1 || wp->event == NULL)
+		return;
+	if (~wp->flags & PANE_PIPEOUT) {
+		window_pane_update_used_data(wp, wpo, SIZE_MAX);
+		return;
+	}
+	if (event_initialized(&wp->pipe_write_event) &&
+	    event_pending(&wp->pipe_write_event, EV_WRITE, NULL))
+		return;
 
-	if (wp->pipe_fd != -1) {
-		new_data = window_pane_get_new_data(wp, wpo, &new_size);
-		if (new_size > 0) {
-			bufferevent_write(wp->pipe_event, new_data, new_size);
-			window_pane_update_used_data(wp, wpo, new_size);
+	new_data = window_pane_get_new_data(wp, wpo, &new_size);
+	if (new_size == 0)
+		return;
+	n = write(wp->pipe_fd, new_data, new_size);
+	if (n == -1) {
+		if (errno != EAGAIN && errno != EINTR) {
+			log_debug("%%%u pipe error: %s", wp->id,
+			    strerror(errno));
+			window_pane_close_pipe(wp);
+			return;
 		}
+		n = 0;
+	}
+	log_debug("%%%u pipe wrote %zd of %zu", wp->id, n, new_size);
+	window_pane_update_used_data(wp, wpo, n);
+
+	if ((size_t)n != new_size) {
+		event_set(&wp->pipe_write_event, wp->pipe_fd, EV_WRITE,
+		    window_pane_pipe_write_callback, wp);
+		event_add(&wp->pipe_write_event, NULL);
 	}
+}
+
+/* Close the pipe for a pane. */
+void
+window_pane_close_pipe(struct window_pane *wp)
+{
+	if (wp->pipe_fd == -1)
+		return;
+
+	if (event_initialized(&wp->pipe_write_event))
+		event_del(&wp->pipe_write_event);
+	bufferevent_free(wp->pipe_event);
+	close(wp->pipe_fd);
+	wp->pipe_fd = -1;
+}
+
+static void
+window_pane_read_callback(__unused struct bufferevent *bufev, void *data)
+{
+	struct window_pane		*wp = data;
+	struct evbuffer			*evb = wp->event->input;
+	size_t				 size = EVBUFFER_LENGTH(evb);
+	struct client			*c;
+
+	window_pane_write_pipe(wp);
 
 	log_debug("%%%u has %zu bytes", wp->id, size);
 	TAILQ_FOREACH(c, &clients, entry) {